@@ -0,0 +1,687 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "async_log.h"
+#include "pipeline_metrics.h"
+
+#define LOG_RECORD_MAX 4096
+#define LOG_STRING_MAX 1024
+#define LOG_MAX_CATEGORIES 32
+#define LOG_DEFAULT_RING_BYTES (64 * 1024)
+#define LOG_MAX_RING_BYTES (64 * 1024 * 1024)
+#define LOG_DRAIN_IDLE_US 5000
+#define LOG_PAD 0x80000000u
+#define LOG_CAT_SELF "LOG"
+
+typedef enum {
+    ARG_PERCENT,
+    ARG_INVALID,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+    ARG_COUNT
+} ArgKind;
+
+typedef struct {
+    const gchar *start;  /* the '%' */
+    const gchar *end;    /* past the conversion character */
+    guint stars;         /* '*' width and precision arguments */
+    ArgKind kind;
+} Conversion;
+
+/* A captured message. The arguments follow in 8-byte slots, in format
+ * order: '*' values and numbers widened to 64 bits, strings as a slot with
+ * their length (G_MAXUINT32 for NULL) then the NUL terminated bytes padded
+ * to 8. */
+typedef struct {
+    guint32 size;          /* whole record, multiple of 8; LOG_PAD: skip to the ring start */
+    gint32 priority;
+    gint64 time;
+    const gchar *category;
+    const gchar *format;
+    guint32 conversions;   /* captured, fewer than in the format if it did not fit */
+    guint32 reserved;
+} LogRecord;
+
+/* Single producer (the owning thread), single consumer (the drain thread)
+ * ring; head and tail count bytes and only grow. */
+typedef struct {
+    guint8 *data;
+    guint64 mask;
+    guint64 head;
+    guint64 tail;
+    guint dropped;         /* written by the owner only */
+    guint dropped_seen;    /* drain thread */
+    gboolean exited;       /* guarded by logger.lock */
+    guint64 scratch[LOG_RECORD_MAX / sizeof(guint64)];
+} LogRing;
+
+typedef struct {
+    const gchar *name;
+    gint64 second;
+    gint count;
+    gint suppressed;
+    gint suppressed_seen;  /* drain thread */
+} LogCategory;
+
+typedef struct {
+    gint64 time;
+    gint priority;
+    const gchar *category;
+    gchar *message;
+} LogEntry;
+
+static struct {
+    GMutex lock;           /* rings and the drain thread */
+    GCond cond;
+    GPtrArray *rings;
+    GThread *thread;
+    gboolean stopping;
+    gint running;
+
+    gchar *path;
+    gint max_priority;
+    guint rate;
+    guint ring_bytes;
+    FILE *file;
+    gboolean use_syslog;
+
+    guint64 messages;
+    guint64 dropped;
+    LogCategory categories[LOG_MAX_CATEGORIES];
+} logger = {
+    .max_priority = LOG_INFO,
+    .ring_bytes = LOG_DEFAULT_RING_BYTES,
+};
+
+static void ring_thread_exit(gpointer data);
+
+static GPrivate thread_ring = G_PRIVATE_INIT(ring_thread_exit);
+
+void async_log_configure(const gchar *path, gint max_priority, guint rate, guint ring_bytes) {
+    g_free(logger.path);
+    logger.path = g_strdup(path);
+    logger.max_priority = max_priority;
+    logger.rate = rate;
+    logger.ring_bytes = ring_bytes ? ring_bytes : LOG_DEFAULT_RING_BYTES;
+}
+
+gboolean async_log_enabled(gint priority) {
+    return priority <= logger.max_priority;
+}
+
+/* Finds the next conversion from `p`; the literal text in between runs
+ * from `p` to conv->start. */
+static gboolean next_conversion(const gchar *p, Conversion *conv) {
+    const gchar *q = strchr(p, '%');
+    ArgKind integer = ARG_INT;
+    gboolean long_double = FALSE;
+
+    if (!q)
+        return FALSE;
+    conv->start = q++;
+    conv->stars = 0;
+    if (*q == '%') {
+        conv->end = q + 1;
+        conv->kind = ARG_PERCENT;
+        return TRUE;
+    }
+    while (*q && strchr("-+ #0'", *q))
+        q++;
+    if (*q == '*') {
+        conv->stars++;
+        q++;
+    }
+    while (g_ascii_isdigit(*q))
+        q++;
+    if (*q == '.') {
+        q++;
+        if (*q == '*') {
+            conv->stars++;
+            q++;
+        }
+        while (g_ascii_isdigit(*q))
+            q++;
+    }
+    switch (*q) {
+        case 'h':
+            q += q[1] == 'h' ? 2 : 1;
+            break;
+        case 'l':
+            integer = q[1] == 'l' ? ARG_LLONG : ARG_LONG;
+            q += q[1] == 'l' ? 2 : 1;
+            break;
+        case 'j':
+            integer = ARG_LLONG;
+            q++;
+            break;
+        case 'z':
+            integer = ARG_SIZE;
+            q++;
+            break;
+        case 't':
+            integer = ARG_PTRDIFF;
+            q++;
+            break;
+        case 'L':
+            long_double = TRUE;
+            q++;
+            break;
+        default:
+            break;
+    }
+    switch (*q) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+            conv->kind = integer;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            conv->kind = long_double ? ARG_LDOUBLE : ARG_DOUBLE;
+            break;
+        case 's':
+            conv->kind = ARG_STRING;
+            break;
+        case 'p':
+            conv->kind = ARG_POINTER;
+            break;
+        case 'n':
+            conv->kind = ARG_COUNT;
+            break;
+        default:
+            /* printed as is, consumes nothing */
+            conv->kind = ARG_INVALID;
+            conv->end = *q ? q + 1 : q;
+            return TRUE;
+    }
+    conv->end = q + 1;
+    return TRUE;
+}
+
+/* Copies the arguments behind the header in `buf`; returns the record
+ * size. Stops at the first conversion that does not fit. */
+static guint32 capture(guint8 *buf, const gchar *format, va_list ap) {
+    LogRecord *record = (LogRecord *) buf;
+    gsize at = sizeof(LogRecord);
+    const gchar *p = format;
+    Conversion conv;
+
+    record->conversions = 0;
+    while (next_conversion(p, &conv)) {
+        guint64 slots[3];
+        guint n = 0;
+        const gchar *str = NULL;
+        gsize len = 0;
+
+        p = conv.end;
+        if (conv.kind == ARG_PERCENT || conv.kind == ARG_INVALID)
+            continue;
+        for (guint i = 0; i < conv.stars; i++)
+            slots[n++] = (guint64) (gint64) va_arg(ap, int);
+        switch (conv.kind) {
+            case ARG_INT:
+                slots[n++] = (guint64) (gint64) va_arg(ap, int);
+                break;
+            case ARG_LONG:
+                slots[n++] = (guint64) va_arg(ap, long);
+                break;
+            case ARG_LLONG:
+                slots[n++] = (guint64) va_arg(ap, long long);
+                break;
+            case ARG_SIZE:
+                slots[n++] = (guint64) va_arg(ap, size_t);
+                break;
+            case ARG_PTRDIFF:
+                slots[n++] = (guint64) va_arg(ap, ptrdiff_t);
+                break;
+            case ARG_DOUBLE:
+            case ARG_LDOUBLE: {
+                gdouble v = conv.kind == ARG_DOUBLE ? va_arg(ap, double) : (gdouble) va_arg(ap, long double);
+                memcpy(&slots[n++], &v, sizeof(v));
+                break;
+            }
+            case ARG_POINTER:
+                slots[n++] = (guint64) (guintptr) va_arg(ap, void *);
+                break;
+            case ARG_STRING:
+                str = va_arg(ap, const char *);
+                len = str ? MIN(strlen(str), LOG_STRING_MAX) : 0;
+                slots[n++] = str ? len : G_MAXUINT32;
+                break;
+            case ARG_COUNT:
+                (void) va_arg(ap, void *);
+                break;
+            default:
+                break;
+        }
+        /* strings may be cut short, the rest of the record may not */
+        if (str && at + n * 8 + 8 <= LOG_RECORD_MAX)
+            len = MIN(len, LOG_RECORD_MAX - (at + n * 8) - 1);
+        if (at + n * 8 + (str ? (len + 8) & ~(gsize) 7 : 0) > LOG_RECORD_MAX)
+            break;
+        if (str)
+            slots[n - 1] = len;
+        memcpy(buf + at, slots, n * 8);
+        at += n * 8;
+        if (str) {
+            memcpy(buf + at, str, len);
+            memset(buf + at + len, 0, 8 - len % 8);
+            at += (len + 8) & ~(gsize) 7;
+        }
+        record->conversions++;
+    }
+    return (guint32) at;
+}
+
+static gboolean read_slot(const guint8 **p, const guint8 *end, guint64 *value) {
+    if (*p + 8 > end)
+        return FALSE;
+    memcpy(value, *p, 8);
+    *p += 8;
+    return TRUE;
+}
+
+/* Replays the format with the captured arguments, one conversion at a
+ * time; '*' values are written into the conversion itself. */
+static void format_record(GString *out, const LogRecord *record) {
+    const guint8 *p = (const guint8 *) (record + 1);
+    const guint8 *end = (const guint8 *) record + record->size;
+    const gchar *f = record->format;
+    guint done = 0;
+    Conversion conv;
+
+    while (next_conversion(f, &conv)) {
+        gchar spec[64];
+        guint len = 0;
+        guint64 stars[2], value = 0;
+        guint star = 0;
+
+        g_string_append_len(out, f, conv.start - f);
+        f = conv.end;
+        if (conv.kind == ARG_PERCENT) {
+            g_string_append_c(out, '%');
+            continue;
+        }
+        if (conv.kind == ARG_INVALID) {
+            g_string_append_len(out, conv.start, conv.end - conv.start);
+            continue;
+        }
+        if (done++ == record->conversions)
+            goto truncated;
+        for (guint i = 0; i < conv.stars; i++)
+            if (!read_slot(&p, end, &stars[i]))
+                goto truncated;
+        if (conv.kind != ARG_COUNT && !read_slot(&p, end, &value))
+            goto truncated;
+        for (const gchar *c = conv.start; c < conv.end; c++) {
+            if (len + 24 >= sizeof(spec))
+                goto truncated;
+            if (*c == '*')
+                len += (guint) g_snprintf(spec + len, sizeof(spec) - len, "%d", (gint) stars[star++]);
+            else if (*c != 'L')
+                spec[len++] = *c;
+        }
+        spec[len] = '\0';
+
+        switch (conv.kind) {
+            case ARG_INT:
+                g_string_append_printf(out, spec, (int) value);
+                break;
+            case ARG_LONG:
+                g_string_append_printf(out, spec, (long) value);
+                break;
+            case ARG_LLONG:
+                g_string_append_printf(out, spec, (long long) value);
+                break;
+            case ARG_SIZE:
+                g_string_append_printf(out, spec, (size_t) value);
+                break;
+            case ARG_PTRDIFF:
+                g_string_append_printf(out, spec, (ptrdiff_t) value);
+                break;
+            case ARG_DOUBLE:
+            case ARG_LDOUBLE: {
+                gdouble v;
+                memcpy(&v, &value, sizeof(v));
+                g_string_append_printf(out, spec, v);
+                break;
+            }
+            case ARG_POINTER:
+                g_string_append_printf(out, spec, (void *) (guintptr) value);
+                break;
+            case ARG_STRING:
+                if (value == G_MAXUINT32) {
+                    g_string_append_printf(out, spec, "(null)");
+                } else {
+                    if (p + value + 1 > end)
+                        goto truncated;
+                    g_string_append_printf(out, spec, (const char *) p);
+                    p += (value + 8) & ~(guint64) 7;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    g_string_append(out, f);
+    return;
+
+truncated:
+    g_string_append(out, "...");
+}
+
+static LogCategory *get_category(const gchar *name) {
+    for (guint i = 0; i < LOG_MAX_CATEGORIES; i++) {
+        LogCategory *category = &logger.categories[i];
+        const gchar *known = g_atomic_pointer_get(&category->name);
+        if (!known) {
+            if (g_atomic_pointer_compare_and_exchange(&category->name, NULL, name))
+                return category;
+            known = g_atomic_pointer_get(&category->name);
+        }
+        if (known == name || strcmp(known, name) == 0)
+            return category;
+    }
+    return NULL;
+}
+
+/* At most logger.rate messages per category and wall clock second. */
+static gboolean rate_allows(LogCategory *category, gint64 time) {
+    gint64 second = time / G_USEC_PER_SEC;
+    gint64 current = __atomic_load_n(&category->second, __ATOMIC_RELAXED);
+
+    if (current != second &&
+        __atomic_compare_exchange_n(&category->second, &current, second, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        g_atomic_int_set(&category->count, 0);
+    if ((guint) g_atomic_int_add(&category->count, 1) < logger.rate)
+        return TRUE;
+    g_atomic_int_inc(&category->suppressed);
+    return FALSE;
+}
+
+static LogRing *get_ring(void) {
+    LogRing *ring = g_private_get(&thread_ring);
+    guint size = 2 * LOG_RECORD_MAX;
+
+    if (ring)
+        return ring;
+    while (size < MIN(logger.ring_bytes, LOG_MAX_RING_BYTES))
+        size <<= 1;
+    ring = g_new0(LogRing, 1);
+    ring->data = g_malloc(size);
+    ring->mask = size - 1;
+    g_private_set(&thread_ring, ring);
+    g_mutex_lock(&logger.lock);
+    g_ptr_array_add(logger.rings, ring);
+    g_mutex_unlock(&logger.lock);
+    return ring;
+}
+
+static void ring_free(LogRing *ring) {
+    g_free(ring->data);
+    g_free(ring);
+}
+
+/* A ring outlives its thread until the drain thread has emptied it. */
+static void ring_thread_exit(gpointer data) {
+    LogRing *ring = data;
+
+    g_mutex_lock(&logger.lock);
+    if (logger.thread) {
+        ring->exited = TRUE;
+    } else {
+        g_ptr_array_remove_fast(logger.rings, ring);
+        ring_free(ring);
+    }
+    g_mutex_unlock(&logger.lock);
+}
+
+static gboolean ring_push(LogRing *ring, const LogRecord *record) {
+    guint64 capacity = ring->mask + 1;
+    guint64 head = ring->head;
+    guint64 tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    guint64 offset = head & ring->mask;
+    guint64 pad = capacity - offset < record->size ? capacity - offset : 0;
+
+    if (head + pad + record->size - tail > capacity)
+        return FALSE;
+    if (pad) {
+        guint32 marker = (guint32) pad | LOG_PAD;
+        memcpy(ring->data + offset, &marker, sizeof(marker));
+        head += pad;
+        offset = 0;
+    }
+    memcpy(ring->data + offset, record, record->size);
+    __atomic_store_n(&ring->head, head + record->size, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+static void write_line(FILE *file, gint64 time, gint priority, const gchar *category, const gchar *message) {
+    static const gchar *names[] = {"EMERG", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG"};
+    time_t seconds = (time_t) (time / G_USEC_PER_SEC);
+    struct tm tm;
+    gchar stamp[32];
+
+    gmtime_r(&seconds, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    fprintf(file, "%s.%06dZ %s %s %s\n", stamp, (gint) (time % G_USEC_PER_SEC), category,
+            names[CLAMP(priority, LOG_EMERG, LOG_DEBUG)], message);
+}
+
+void nvds_log(const char *category, int priority, const char *data, ...) {
+    LogRing *ring;
+    LogRecord *record;
+    LogCategory *slot;
+    va_list ap;
+
+    if (priority > logger.max_priority)
+        return;
+    va_start(ap, data);
+    if (!g_atomic_int_get(&logger.running)) {
+        /* not opened: synchronous, like g_printerr */
+        gchar *message = g_strdup_vprintf(data, ap);
+        write_line(stderr, g_get_real_time(), priority, category, message);
+        g_free(message);
+        va_end(ap);
+        return;
+    }
+    ring = get_ring();
+    record = (LogRecord *) ring->scratch;
+    record->time = g_get_real_time();
+    slot = get_category(category);
+    if (slot && logger.rate && !rate_allows(slot, record->time)) {
+        va_end(ap);
+        return;
+    }
+    record->priority = priority;
+    record->category = slot ? slot->name : category;
+    record->format = data;
+    record->size = capture((guint8 *) record, data, ap);
+    va_end(ap);
+    if (!ring_push(ring, record))
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+}
+
+static void add_entry(GArray *entries, gint64 time, gint priority, const gchar *category, gchar *message) {
+    LogEntry entry = {time, priority, category, message};
+    g_array_append_val(entries, entry);
+}
+
+/* Called with logger.lock held. Formats what every ring holds and the
+ * drop and rate limit reports. */
+static void drain_rings(GArray *entries) {
+    GString *out = g_string_new(NULL);
+    gint64 now = g_get_real_time();
+
+    for (guint i = 0; i < logger.rings->len; i++) {
+        LogRing *ring = g_ptr_array_index(logger.rings, i);
+        guint64 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        guint64 tail = ring->tail;
+        guint dropped;
+
+        while (tail != head) {
+            const LogRecord *record = (const LogRecord *) (ring->data + (tail & ring->mask));
+            if (record->size & LOG_PAD) {
+                tail += record->size & ~LOG_PAD;
+                continue;
+            }
+            g_string_truncate(out, 0);
+            format_record(out, record);
+            add_entry(entries, record->time, record->priority, record->category, g_strdup(out->str));
+            tail += record->size;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->dropped_seen) {
+            add_entry(entries, now, LOG_WARNING, LOG_CAT_SELF,
+                      g_strdup_printf("%u messages dropped, ring of a logging thread full", dropped - ring->dropped_seen));
+            __atomic_add_fetch(&logger.dropped, dropped - ring->dropped_seen, __ATOMIC_RELAXED);
+            ring->dropped_seen = dropped;
+        }
+        if (ring->exited) {
+            g_ptr_array_remove_index_fast(logger.rings, i--);
+            ring_free(ring);
+        }
+    }
+    for (guint i = 0; i < LOG_MAX_CATEGORIES; i++) {
+        LogCategory *category = &logger.categories[i];
+        const gchar *name = g_atomic_pointer_get(&category->name);
+        gint suppressed = g_atomic_int_get(&category->suppressed);
+        if (!name)
+            break;
+        if (suppressed != category->suppressed_seen) {
+            add_entry(entries, now, LOG_WARNING, LOG_CAT_SELF,
+                      g_strdup_printf("%d %s messages suppressed by the rate limit", suppressed - category->suppressed_seen,
+                                      name));
+            category->suppressed_seen = suppressed;
+        }
+    }
+    g_string_free(out, TRUE);
+}
+
+static gint compare_entries(gconstpointer a, gconstpointer b) {
+    const LogEntry *x = a, *y = b;
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+static void write_entries(GArray *entries) {
+    /* rings are ordered, interleave the threads by time */
+    g_array_sort(entries, compare_entries);
+    for (guint i = 0; i < entries->len; i++) {
+        LogEntry *entry = &g_array_index(entries, LogEntry, i);
+        if (logger.use_syslog)
+            syslog(entry->priority, "%s: %s", entry->category, entry->message);
+        else
+            write_line(logger.file, entry->time, entry->priority, entry->category, entry->message);
+        g_free(entry->message);
+    }
+    if (entries->len && logger.file)
+        fflush(logger.file);
+    __atomic_add_fetch(&logger.messages, entries->len, __ATOMIC_RELAXED);
+    g_array_set_size(entries, 0);
+}
+
+static gpointer drain_thread(gpointer data) {
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(LogEntry));
+
+    g_mutex_lock(&logger.lock);
+    for (;;) {
+        gboolean stopping = logger.stopping;
+        gboolean idle;
+
+        drain_rings(entries);
+        idle = entries->len == 0;
+        g_mutex_unlock(&logger.lock);
+        write_entries(entries);
+        g_mutex_lock(&logger.lock);
+        if (stopping)
+            break;
+        if (idle && !logger.stopping)
+            g_cond_wait_until(&logger.cond, &logger.lock, g_get_monotonic_time() + LOG_DRAIN_IDLE_US);
+    }
+    g_mutex_unlock(&logger.lock);
+    g_array_free(entries, TRUE);
+    return NULL;
+}
+
+static void collect_log_metrics(GString *out, gpointer user_data) {
+    g_string_append_printf(out, "ds_log_messages_total %" G_GUINT64_FORMAT "\n",
+                           __atomic_load_n(&logger.messages, __ATOMIC_RELAXED));
+    g_string_append_printf(out, "ds_log_dropped_total %" G_GUINT64_FORMAT "\n",
+                           __atomic_load_n(&logger.dropped, __ATOMIC_RELAXED));
+    for (guint i = 0; i < LOG_MAX_CATEGORIES; i++) {
+        const gchar *name = g_atomic_pointer_get(&logger.categories[i].name);
+        if (!name)
+            break;
+        g_string_append_printf(out, "ds_log_rate_limited_total{category=\"%s\"} %d\n", name,
+                               g_atomic_int_get(&logger.categories[i].suppressed));
+    }
+}
+
+void nvds_log_open(void) {
+    g_mutex_lock(&logger.lock);
+    if (logger.thread) {
+        g_mutex_unlock(&logger.lock);
+        return;
+    }
+    if (!logger.rings)
+        logger.rings = g_ptr_array_new();
+    logger.use_syslog = g_strcmp0(logger.path, "syslog") == 0;
+    logger.file = NULL;
+    if (logger.use_syslog) {
+        openlog(DSLOG_SYSLOG_IDENT, LOG_NDELAY | LOG_PID, LOG_USER);
+    } else if (logger.path) {
+        logger.file = fopen(logger.path, "a");
+        if (!logger.file)
+            g_printerr("Unable to open log file %s, logging to stderr\n", logger.path);
+    }
+    if (!logger.use_syslog && !logger.file)
+        logger.file = stderr;
+    logger.stopping = FALSE;
+    logger.thread = g_thread_new("nvds-log", drain_thread, NULL);
+    g_atomic_int_set(&logger.running, TRUE);
+    g_mutex_unlock(&logger.lock);
+    metrics_register("log", collect_log_metrics, NULL);
+}
+
+void nvds_log_close(void) {
+    GThread *thread;
+
+    g_mutex_lock(&logger.lock);
+    if (!logger.thread) {
+        g_mutex_unlock(&logger.lock);
+        return;
+    }
+    /* later messages go to stderr directly, the drain thread empties the
+     * rings once more on its way out */
+    g_atomic_int_set(&logger.running, FALSE);
+    logger.stopping = TRUE;
+    g_cond_signal(&logger.cond);
+    thread = logger.thread;
+    g_mutex_unlock(&logger.lock);
+    g_thread_join(thread);
+    metrics_unregister("log");
+
+    g_mutex_lock(&logger.lock);
+    logger.thread = NULL;
+    for (guint i = 0; i < logger.rings->len; i++) {
+        LogRing *ring = g_ptr_array_index(logger.rings, i);
+        if (ring->exited) {
+            g_ptr_array_remove_index_fast(logger.rings, i--);
+            ring_free(ring);
+        }
+    }
+    if (logger.use_syslog)
+        closelog();
+    else if (logger.file != stderr)
+        fclose(logger.file);
+    logger.file = NULL;
+    g_mutex_unlock(&logger.lock);
+}
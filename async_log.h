@@ -0,0 +1,46 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <glib.h>
+#include "nvds_logger.h"
+
+G_BEGIN_DECLS
+
+/* Implementation of the nvds_logger.h API (nvds_log_open / nvds_log /
+ * nvds_log_close) that never blocks the calling thread.
+ *
+ * nvds_log() only captures: it checks the priority and the rate limit of
+ * the category, then copies the format pointer and the raw arguments
+ * (strings by value) into a ring buffer owned by the calling thread. A
+ * single drain thread formats the records of all rings, ordered by time,
+ * and writes them to a file, stderr or syslog. When a ring is full the
+ * message is dropped and the drain thread reports how many were lost.
+ *
+ * Formatting is deferred, so the category and the format must outlive the
+ * call (string literals, as in every nvds_log call); %n is not supported,
+ * strings are cut at 1024 bytes and a record at 4096. Before
+ * nvds_log_open() and after nvds_log_close() messages are formatted and
+ * written to stderr synchronously.
+ *
+ * Published via pipeline_metrics:
+ *
+ *   ds_log_messages_total
+ *   ds_log_dropped_total
+ *   ds_log_rate_limited_total{category="CR"}  */
+
+#define DSLOG_CAT_APP "APP"
+
+/* Call before nvds_log_open(). `path` is a file to append to, "syslog",
+ * or NULL for stderr; messages above `max_priority` (syslog levels,
+ * LOG_DEBUG is the most verbose) are discarded on capture; at most
+ * `rate` messages per second are kept per category (0: no limit);
+ * `ring_bytes` is the ring size of every logging thread. */
+void async_log_configure(const gchar *path, gint max_priority, guint rate, guint ring_bytes);
+
+/* TRUE if a message of `priority` would be captured, to skip building
+ * expensive arguments. */
+gboolean async_log_enabled(gint priority);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,336 @@
+#include "batch_controller.h"
+#include "async_log.h"
+#include "pipeline_metrics.h"
+
+/* Batches between two decisions. */
+#define BATCH_CONTROLLER_WINDOW 32
+/* Longest wait for a branch to drain; past it the switch is forced. */
+#define BATCH_CONTROLLER_DRAIN_MS 1000
+
+typedef struct {
+    BatchController *bc;
+    PipelineBranch branch;
+    GstPad *pgie_pad;
+    gulong pgie_probe;
+    /* the branch bin's ghost pads: batches in and out, counted on the
+     * branch itself so late ones are never charged to another */
+    GstPad *in_pad;
+    gulong in_probe;
+    GstPad *out_pad;
+    gulong out_probe;
+    gulong block_probe;         /* output held back while the previous branch drains */
+    guint64 entered;
+    guint64 exited;
+    guint64 batches;
+    guint64 violations;
+} SizeState;
+
+struct _BatchController {
+    PipelineGraph *graph;
+    SourceSet *sources;
+    gint64 slo_us;
+    SizeState sizes[PIPELINE_MAX_BRANCHES];
+    guint num_sizes;
+    GstPad *mux_pad;
+    gulong mux_probe;
+    GstPad *merge_pad;
+    gulong merge_probe;
+
+    GMutex lock;                /* everything below, and the SizeState counters */
+    GHashTable *started;        /* batch buffer -> gint64 muxer output time */
+    guint current;              /* branch the muxer feeds */
+    guint pending;              /* branch it is to feed from the next batch */
+    guint merged;               /* branch the input-selector passes on */
+    guint drain_id;             /* switch timeout while `merged` drains */
+    guint window_batches;
+    guint window_violations;
+    gint64 window_max_us;
+    guint64 switches;
+    guint64 switch_timeouts;
+    guint idle_id;              /* muxer batch size update */
+};
+
+static void collect_batch_metrics(GString *out, gpointer user_data) {
+    BatchController *bc = user_data;
+    guint64 batches = 0, violations = 0;
+
+    g_mutex_lock(&bc->lock);
+    g_string_append_printf(out, "ds_batch_size %u\n", bc->sizes[bc->current].branch.batch_size);
+    for (guint i = 0; i < bc->num_sizes; i++) {
+        const SizeState *size = &bc->sizes[i];
+        g_string_append_printf(out, "ds_batches_total{batch_size=\"%u\"} %" G_GUINT64_FORMAT "\n",
+                               size->branch.batch_size, size->batches);
+        g_string_append_printf(out, "ds_batch_slo_violations_total{batch_size=\"%u\"} %" G_GUINT64_FORMAT "\n",
+                               size->branch.batch_size, size->violations);
+        batches += size->batches;
+        violations += size->violations;
+    }
+    g_string_append_printf(out, "ds_batch_slo_violation_ratio %.4f\n", batches ? (gdouble) violations / batches : 0.0);
+    g_string_append_printf(out, "ds_batch_switches_total %" G_GUINT64_FORMAT "\n", bc->switches);
+    g_string_append_printf(out, "ds_batch_switch_timeouts_total %" G_GUINT64_FORMAT "\n", bc->switch_timeouts);
+    g_mutex_unlock(&bc->lock);
+}
+
+/* Smallest size taking `sources` frames in one batch, else the largest. */
+static guint fit_index(BatchController *bc, guint sources) {
+    for (guint i = 0; i < bc->num_sizes; i++) {
+        if (bc->sizes[i].branch.batch_size >= sources)
+            return i;
+    }
+    return bc->num_sizes - 1;
+}
+
+static gboolean apply_batch_size(gpointer data) {
+    BatchController *bc = data;
+    guint batch_size;
+
+    g_mutex_lock(&bc->lock);
+    batch_size = bc->sizes[bc->pending].branch.batch_size;
+    bc->idle_id = 0;
+    g_mutex_unlock(&bc->lock);
+    g_object_set(G_OBJECT (bc->graph->streammux), "batch-size", batch_size, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+/* End of a window, with the lock held. */
+static void decide(BatchController *bc) {
+    guint fit = fit_index(bc, MAX(source_set_count(bc->sources), 1));
+    guint target = bc->pending;
+
+    if (bc->window_violations * 20 > bc->window_batches && target > 0)
+        target--;
+    else if (target < fit && bc->window_max_us * 10 < bc->slo_us * 7)
+        target++;
+    else if (target > fit)
+        target = fit;
+    bc->window_batches = 0;
+    bc->window_violations = 0;
+    bc->window_max_us = 0;
+    if (target == bc->pending)
+        return;
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Batch size %u -> %u", bc->sizes[bc->pending].branch.batch_size,
+             bc->sizes[target].branch.batch_size);
+    bc->pending = target;
+    /* the muxer property is not set from a streaming thread */
+    if (!bc->idle_id)
+        bc->idle_id = g_idle_add(apply_batch_size, bc);
+}
+
+static GstPadProbeReturn hold_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    return GST_PAD_PROBE_OK;
+}
+
+/* Passes the output of the branch the muxer feeds on and lets it through,
+ * with the lock held. */
+static void finish_switch(BatchController *bc) {
+    SizeState *size = &bc->sizes[bc->current];
+
+    bc->merged = bc->current;
+    pipeline_branch_merge(bc->graph, &size->branch);
+    if (size->block_probe) {
+        gst_pad_remove_probe(size->out_pad, size->block_probe);
+        size->block_probe = 0;
+    }
+    if (bc->drain_id) {
+        g_source_remove(bc->drain_id);
+        bc->drain_id = 0;
+    }
+    bc->switches++;
+}
+
+/* Main loop: the old branch still holds batches after a second, likely
+ * flushed or stuck; its output is given up, the input-selector drops it. */
+static gboolean drain_timeout(gpointer data) {
+    BatchController *bc = data;
+    SizeState *old;
+
+    g_mutex_lock(&bc->lock);
+    /* drained while this was being dispatched */
+    if (bc->merged == bc->current) {
+        g_mutex_unlock(&bc->lock);
+        return G_SOURCE_REMOVE;
+    }
+    old = &bc->sizes[bc->merged];
+    nvds_log(DSLOG_CAT_APP, LOG_WARNING, "Batch size %u switched with %" G_GUINT64_FORMAT " batches still in flight "
+             "after %d ms, those are dropped", old->branch.batch_size, old->entered - old->exited,
+             BATCH_CONTROLLER_DRAIN_MS);
+    bc->drain_id = 0;
+    bc->switch_timeouts++;
+    finish_switch(bc);
+    g_mutex_unlock(&bc->lock);
+    return G_SOURCE_REMOVE;
+}
+
+/* Muxer thread: times the batch and routes it. A switch never waits here:
+ * new batches go to the new branch at once, whose output is held at its
+ * src pad until the old branch has delivered everything it was sent
+ * (merge_src_probe), since the input-selector only passes one of them. */
+static GstPadProbeReturn mux_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    BatchController *bc = user_data;
+    gint64 *start = g_new(gint64, 1);
+
+    g_mutex_lock(&bc->lock);
+    if (bc->pending != bc->current && bc->merged == bc->current) {
+        SizeState *old = &bc->sizes[bc->current], *next = &bc->sizes[bc->pending];
+        bc->current = bc->pending;
+        if (old->entered == old->exited) {
+            pipeline_branch_route(bc->graph, &next->branch);
+            finish_switch(bc);
+        } else {
+            next->block_probe = gst_pad_add_probe(next->out_pad, GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER,
+                                                  hold_probe, NULL, NULL);
+            pipeline_branch_route(bc->graph, &next->branch);
+            bc->drain_id = g_timeout_add(BATCH_CONTROLLER_DRAIN_MS, drain_timeout, bc);
+        }
+    }
+    *start = g_get_monotonic_time();
+    g_hash_table_replace(bc->started, info->data, start);
+    g_mutex_unlock(&bc->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+/* nvinfer works in place, the batch is the same buffer as at the muxer. */
+static GstPadProbeReturn pgie_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SizeState *size = user_data;
+    BatchController *bc = size->bc;
+    gint64 *start, us;
+
+    g_mutex_lock(&bc->lock);
+    start = g_hash_table_lookup(bc->started, info->data);
+    if (start) {
+        us = g_get_monotonic_time() - *start;
+        g_hash_table_remove(bc->started, info->data);
+        size->batches++;
+        bc->window_batches++;
+        bc->window_max_us = MAX(bc->window_max_us, us);
+        if (us > bc->slo_us) {
+            size->violations++;
+            bc->window_violations++;
+        }
+        if (bc->window_batches == BATCH_CONTROLLER_WINDOW)
+            decide(bc);
+    }
+    g_mutex_unlock(&bc->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Branch threads: batches into and out of a branch. A flush empties the
+ * branch without anything coming out. */
+static GstPadProbeReturn in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SizeState *size = user_data;
+
+    g_mutex_lock(&size->bc->lock);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+        size->entered++;
+    else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_FLUSH_STOP)
+        size->entered = size->exited;
+    g_mutex_unlock(&size->bc->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    SizeState *size = user_data;
+
+    g_mutex_lock(&size->bc->lock);
+    size->exited++;
+    g_mutex_unlock(&size->bc->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Past the input-selector, in the thread of the branch it passes: once the
+ * drained branch's last batch got through, the new one takes over. */
+static GstPadProbeReturn merge_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    BatchController *bc = user_data;
+    SizeState *old;
+
+    g_mutex_lock(&bc->lock);
+    old = &bc->sizes[bc->merged];
+    if (bc->merged != bc->current && old->entered == old->exited)
+        finish_switch(bc);
+    g_mutex_unlock(&bc->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+BatchController *batch_controller_new(PipelineGraph *graph, SourceSet *sources, guint latency_slo_ms) {
+    BatchController *bc = g_new0(BatchController, 1);
+
+    bc->graph = graph;
+    bc->sources = sources;
+    bc->slo_us = (gint64) latency_slo_ms * 1000;
+    bc->num_sizes = graph->num_branches;
+    g_mutex_init(&bc->lock);
+    bc->started = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    for (guint i = 0; i < bc->num_sizes; i++) {
+        SizeState *size = &bc->sizes[i];
+        size->bc = bc;
+        size->branch = graph->branches[i];
+        size->pgie_pad = gst_element_get_static_pad(size->branch.pgie, "src");
+        size->pgie_probe = gst_pad_add_probe(size->pgie_pad, GST_PAD_PROBE_TYPE_BUFFER, pgie_src_probe, size, NULL);
+        size->in_pad = gst_element_get_static_pad(size->branch.bin, "sink");
+        size->in_probe = gst_pad_add_probe(size->in_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+                                           in_probe, size, NULL);
+        size->out_pad = gst_element_get_static_pad(size->branch.bin, "src");
+        size->out_probe = gst_pad_add_probe(size->out_pad, GST_PAD_PROBE_TYPE_BUFFER, out_probe, size, NULL);
+    }
+    bc->merge_pad = gst_element_get_static_pad(graph->branch_merge, "src");
+    bc->merge_probe = gst_pad_add_probe(bc->merge_pad, GST_PAD_PROBE_TYPE_BUFFER, merge_src_probe, bc, NULL);
+
+    /* not playing yet, so no draining or deferring */
+    bc->current = bc->pending = bc->merged = fit_index(bc, MAX(source_set_count(sources), 1));
+    pipeline_branch_select(graph, &bc->sizes[bc->current].branch);
+    g_object_set(G_OBJECT (graph->streammux), "batch-size", bc->sizes[bc->current].branch.batch_size, NULL);
+    source_set_manage_batch_size(sources, FALSE);
+
+    bc->mux_pad = gst_element_get_static_pad(graph->streammux, "src");
+    bc->mux_probe = gst_pad_add_probe(bc->mux_pad, GST_PAD_PROBE_TYPE_BUFFER, mux_src_probe, bc, NULL);
+    metrics_register("batch-controller", collect_batch_metrics, bc);
+    return bc;
+}
+
+void batch_controller_report(BatchController *bc) {
+    GString *text = g_string_new(NULL);
+    guint64 batches = 0, violations = 0;
+
+    g_mutex_lock(&bc->lock);
+    for (guint i = 0; i < bc->num_sizes; i++) {
+        const SizeState *size = &bc->sizes[i];
+        g_string_append_printf(text, "%sbatch %u: %" G_GUINT64_FORMAT, i ? ", " : "", size->branch.batch_size,
+                               size->batches);
+        batches += size->batches;
+        violations += size->violations;
+    }
+    nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "Latency SLO %" G_GINT64_FORMAT " ms missed by %" G_GUINT64_FORMAT " of %"
+             G_GUINT64_FORMAT " batches (%.2f%%), %" G_GUINT64_FORMAT " switches, %" G_GUINT64_FORMAT
+             " forced; %s", bc->slo_us / 1000, violations, batches, batches ? violations * 100.0 / batches : 0.0,
+             bc->switches, bc->switch_timeouts, text->str);
+    g_mutex_unlock(&bc->lock);
+    g_string_free(text, TRUE);
+}
+
+void batch_controller_free(BatchController *bc) {
+    if (!bc)
+        return;
+    metrics_unregister("batch-controller");
+    if (bc->idle_id)
+        g_source_remove(bc->idle_id);
+    if (bc->drain_id)
+        g_source_remove(bc->drain_id);
+    gst_pad_remove_probe(bc->mux_pad, bc->mux_probe);
+    gst_object_unref(bc->mux_pad);
+    gst_pad_remove_probe(bc->merge_pad, bc->merge_probe);
+    gst_object_unref(bc->merge_pad);
+    for (guint i = 0; i < bc->num_sizes; i++) {
+        SizeState *size = &bc->sizes[i];
+        gst_pad_remove_probe(size->pgie_pad, size->pgie_probe);
+        gst_object_unref(size->pgie_pad);
+        gst_pad_remove_probe(size->in_pad, size->in_probe);
+        gst_object_unref(size->in_pad);
+        gst_pad_remove_probe(size->out_pad, size->out_probe);
+        if (size->block_probe)
+            gst_pad_remove_probe(size->out_pad, size->block_probe);
+        gst_object_unref(size->out_pad);
+    }
+    g_hash_table_destroy(bc->started);
+    g_mutex_clear(&bc->lock);
+    g_free(bc);
+}
@@ -0,0 +1,51 @@
+#ifndef BATCH_CONTROLLER_H
+#define BATCH_CONTROLLER_H
+
+#include <gst/gst.h>
+#include "pipeline_builder.h"
+#include "source_set.h"
+
+G_BEGIN_DECLS
+
+/* Runtime choice among prebuilt engine batch sizes.
+ *
+ * With several batch sizes in the description the graph carries one
+ * inference branch per size, every engine loaded (pipeline_builder.h). Each
+ * batch is timed from the muxer to the pgie output, and at the end of every
+ * window of batches the controller moves towards:
+ *
+ *   - the smallest size that takes every active source in one batch, which
+ *     is the most throughput per inference call;
+ *   - one size down while more than 5% of the window missed the latency
+ *     SLO, however many sources there are;
+ *   - one size up again only once a whole window stayed under 70% of it.
+ *
+ * The muxer batch size follows from the main loop. The muxer never waits
+ * for a switch: the next batch already goes to the new branch, whose output
+ * is held at its src pad until every batch sent to the old one has come out
+ * of the input-selector, which only passes the selected branch. Batches are
+ * counted in and out on each branch's own pads. If the old branch has not
+ * drained after a second the switch is forced, its remaining batches are
+ * dropped and it counts as a timeout. Published via pipeline_metrics:
+ *
+ *   ds_batch_size
+ *   ds_batches_total{batch_size="4"}
+ *   ds_batch_slo_violations_total{batch_size="4"}
+ *   ds_batch_slo_violation_ratio
+ *   ds_batch_switches_total
+ *   ds_batch_switch_timeouts_total */
+
+typedef struct _BatchController BatchController;
+
+/* Starts on the size that fits the sources already added; call before
+ * PLAYING. The muxer batch size is the controller's from now on. */
+BatchController *batch_controller_new(PipelineGraph *graph, SourceSet *sources, guint latency_slo_ms);
+
+/* Logs the SLO violation rate and the batches run at each size. */
+void batch_controller_report(BatchController *bc);
+
+void batch_controller_free(BatchController *bc);
+
+G_END_DECLS
+
+#endif
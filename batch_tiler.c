@@ -0,0 +1,355 @@
+#include <math.h>
+#include <gst/base/gstbasetransform.h>
+#include "batch_tiler.h"
+#include "gstnvdsmeta.h"
+#include "nvbufsurftransform.h"
+#include "pipeline_metrics.h"
+
+#define TILER_CAPS "video/x-raw(memory:NVMM), format=(string)RGBA"
+
+/* Cached transform of one tile; recomputed only when the source resolution
+ * or the grid changes. */
+typedef struct {
+    /* batched surface size and the resolution the source delivered, which
+     * sets the aspect ratio of the tile */
+    guint surface_width;
+    guint surface_height;
+    guint source_width;
+    guint source_height;
+    NvBufSurfTransformRect src;
+    NvBufSurfTransformRect dst;
+    gboolean drawn;
+    guint64 drawn_in;           /* sequence of the batch that last drew it */
+} TileLayout;
+
+typedef struct {
+    GstBaseTransform parent;
+
+    guint width;
+    guint height;
+    guint gpu_id;
+    gchar *branch;              /* metrics label */
+    gchar *metrics_key;         /* unique among the tilers of all branches */
+
+    guint num_tiles;
+    guint columns;
+    guint rows;
+    TileLayout *tiles;
+    guint64 sequence;           /* batches seen by transform() */
+    /* scratch lists handed to NvBufSurfTransformComposite */
+    NvBufSurfaceParams *params;
+    NvBufSurfTransformRect *src_rects;
+    NvBufSurfTransformRect *dst_rects;
+
+    NvBufSurface *canvas;
+    /* output surfaces not owned by a downstream buffer */
+    GAsyncQueue *free_surfaces;
+
+    GMutex stats_lock;
+    guint64 batches;
+    guint64 tiles_composited;
+    guint64 tiles_skipped;
+    guint64 layout_changes;
+    gint64 composite_us;
+} BatchTiler;
+
+typedef struct {
+    GstBaseTransformClass parent_class;
+} BatchTilerClass;
+
+/* Returns an output surface to the tiler once its buffer is freed. */
+typedef struct {
+    BatchTiler *tiler;
+    NvBufSurface *surface;
+} TilerSurface;
+
+static GType batch_tiler_get_type(void);
+
+G_DEFINE_TYPE (BatchTiler, batch_tiler, GST_TYPE_BASE_TRANSFORM);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+        GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS (TILER_CAPS));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+        GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS (TILER_CAPS));
+
+static NvBufSurface *create_surface(BatchTiler *tiler) {
+    NvBufSurfaceCreateParams params = {0};
+    NvBufSurface *surface = NULL;
+
+    params.gpuId = tiler->gpu_id;
+    params.width = tiler->width;
+    params.height = tiler->height;
+    params.colorFormat = NVBUF_COLOR_FORMAT_RGBA;
+    params.layout = NVBUF_LAYOUT_PITCH;
+    params.memType = NVBUF_MEM_DEFAULT;
+    if (NvBufSurfaceCreate(&surface, 1, &params) != 0)
+        return NULL;
+    surface->numFilled = 1;
+    return surface;
+}
+
+static void release_surface(gpointer data) {
+    TilerSurface *ts = data;
+
+    g_async_queue_push(ts->tiler->free_surfaces, ts->surface);
+    gst_object_unref(ts->tiler);
+    g_free(ts);
+}
+
+/* Grid with at least as many cells as the batch, as square as possible.
+ * All tiles are laid out again afterwards. */
+static void update_grid(BatchTiler *tiler, guint num_tiles) {
+    if (num_tiles == tiler->num_tiles)
+        return;
+    tiler->num_tiles = num_tiles;
+    tiler->columns = (guint) ceil(sqrt(num_tiles));
+    tiler->rows = (num_tiles + tiler->columns - 1) / tiler->columns;
+    g_free(tiler->tiles);
+    g_free(tiler->params);
+    g_free(tiler->src_rects);
+    g_free(tiler->dst_rects);
+    tiler->tiles = g_new0(TileLayout, num_tiles);
+    tiler->params = g_new0(NvBufSurfaceParams, num_tiles);
+    tiler->src_rects = g_new0(NvBufSurfTransformRect, num_tiles);
+    tiler->dst_rects = g_new0(NvBufSurfTransformRect, num_tiles);
+}
+
+/* Letterboxes the whole surface into the tile's cell, keeping the aspect
+ * ratio of the source. */
+static void layout_tile(BatchTiler *tiler, guint index, TileLayout *tile,
+                        const NvBufSurfaceParams *surface,
+                        guint source_width, guint source_height) {
+    guint cell_width = tiler->width / tiler->columns;
+    guint cell_height = tiler->height / tiler->rows;
+    gdouble scale = MIN((gdouble) cell_width / source_width, (gdouble) cell_height / source_height);
+    guint width = (guint) (source_width * scale) & ~1u;
+    guint height = (guint) (source_height * scale) & ~1u;
+
+    tile->surface_width = surface->width;
+    tile->surface_height = surface->height;
+    tile->source_width = source_width;
+    tile->source_height = source_height;
+    tile->src.left = 0;
+    tile->src.top = 0;
+    tile->src.width = surface->width;
+    tile->src.height = surface->height;
+    tile->dst.left = (index % tiler->columns) * cell_width + (cell_width - width) / 2;
+    tile->dst.top = (index / tiler->columns) * cell_height + (cell_height - height) / 2;
+    tile->dst.width = width;
+    tile->dst.height = height;
+    tile->drawn = FALSE;
+}
+
+static GstCaps *
+batch_tiler_transform_caps(GstBaseTransform *trans, GstPadDirection direction,
+                           GstCaps *caps, GstCaps *filter) {
+    BatchTiler *tiler = (BatchTiler *) trans;
+    GstCaps *ret = gst_caps_copy(caps);
+
+    for (guint i = 0; i < gst_caps_get_size(ret); i++) {
+        GstStructure *s = gst_caps_get_structure(ret, i);
+        if (direction == GST_PAD_SINK)
+            gst_structure_set(s, "width", G_TYPE_INT, (gint) tiler->width,
+                              "height", G_TYPE_INT, (gint) tiler->height, NULL);
+        else
+            gst_structure_set(s, "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+                              "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+        gst_structure_remove_field(s, "pixel-aspect-ratio");
+    }
+    if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full(filter, ret, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(ret);
+        ret = tmp;
+    }
+    return ret;
+}
+
+static GstFlowReturn
+batch_tiler_prepare_output_buffer(GstBaseTransform *trans, GstBuffer *inbuf, GstBuffer **outbuf) {
+    BatchTiler *tiler = (BatchTiler *) trans;
+    TilerSurface *ts;
+
+    if (!tiler->canvas && !(tiler->canvas = create_surface(tiler))) {
+        GST_ELEMENT_ERROR (tiler, RESOURCE, NO_SPACE_LEFT, ("Cannot allocate tiler canvas"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    ts = g_new(TilerSurface, 1);
+    ts->tiler = gst_object_ref(tiler);
+    ts->surface = g_async_queue_try_pop(tiler->free_surfaces);
+    if (!ts->surface && !(ts->surface = create_surface(tiler))) {
+        gst_object_unref(tiler);
+        g_free(ts);
+        GST_ELEMENT_ERROR (tiler, RESOURCE, NO_SPACE_LEFT, ("Cannot allocate tiler output"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    *outbuf = gst_buffer_new_wrapped_full(0, ts->surface, sizeof(NvBufSurface), 0,
+                                          sizeof(NvBufSurface), ts, release_surface);
+    /* the NvDsBatchMeta travels on with the composited frame */
+    gst_buffer_copy_into(*outbuf, inbuf, GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META, 0, -1);
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+batch_tiler_transform(GstBaseTransform *trans, GstBuffer *inbuf, GstBuffer *outbuf) {
+    BatchTiler *tiler = (BatchTiler *) trans;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(inbuf);
+    NvBufSurfTransformConfigParams session = {NvBufSurfTransformCompute_Default, (int32_t) tiler->gpu_id, NULL};
+    NvBufSurfTransformCompositeParams composite = {0};
+    GstMapInfo in_map, out_map;
+    NvBufSurface *src, *dst;
+    NvDsMetaList *l_frame;
+    guint count = 0, skipped = 0, layout_changes = 0;
+    gint64 start = g_get_monotonic_time();
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!batch_meta) {
+        GST_ELEMENT_ERROR (tiler, STREAM, FAILED, ("Buffer has no NvDsBatchMeta"), (NULL));
+        return GST_FLOW_ERROR;
+    }
+    if (!gst_buffer_map(inbuf, &in_map, GST_MAP_READ))
+        return GST_FLOW_ERROR;
+    if (!gst_buffer_map(outbuf, &out_map, GST_MAP_WRITE)) {
+        gst_buffer_unmap(inbuf, &in_map);
+        return GST_FLOW_ERROR;
+    }
+    src = (NvBufSurface *) in_map.data;
+    dst = (NvBufSurface *) out_map.data;
+
+    update_grid(tiler, MAX(batch_meta->max_frames_in_batch, 1));
+    tiler->sequence++;
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        NvBufSurfaceParams *params;
+        TileLayout *tile;
+        guint source_width, source_height;
+
+        if (frame_meta->source_id >= tiler->num_tiles || frame_meta->batch_id >= src->numFilled)
+            continue;
+        tile = &tiler->tiles[frame_meta->source_id];
+        params = &src->surfaceList[frame_meta->batch_id];
+        source_width = frame_meta->source_frame_width ? frame_meta->source_frame_width : params->width;
+        source_height = frame_meta->source_frame_height ? frame_meta->source_frame_height : params->height;
+        if (params->width != tile->surface_width || params->height != tile->surface_height
+            || source_width != tile->source_width || source_height != tile->source_height) {
+            layout_tile(tiler, frame_meta->source_id, tile, params, source_width, source_height);
+            layout_changes++;
+        }
+        tile->drawn = TRUE;
+        tile->drawn_in = tiler->sequence;
+        tiler->params[count] = *params;
+        tiler->src_rects[count] = tile->src;
+        tiler->dst_rects[count] = tile->dst;
+        count++;
+    }
+    /* The muxer only batches sources with a new frame; the others keep
+     * their tile from an earlier batch, unless the canvas is cleared. */
+    for (guint i = 0; i < tiler->num_tiles; i++) {
+        TileLayout *tile = &tiler->tiles[i];
+        if (!tile->drawn || tile->drawn_in == tiler->sequence)
+            continue;
+        if (layout_changes)
+            tile->drawn = FALSE;
+        else
+            skipped++;
+    }
+    if (layout_changes)
+        NvBufSurfaceMemSet(tiler->canvas, 0, 0, 0);
+
+    NvBufSurfTransformSetSessionParams(&session);
+    if (count) {
+        NvBufSurface batch = *src;
+        batch.batchSize = batch.numFilled = count;
+        batch.surfaceList = tiler->params;
+        composite.composite_flag = NVBUFSURF_TRANSFORM_COMPOSITE;
+        composite.input_buf_count = count;
+        composite.src_comp_rect = tiler->src_rects;
+        composite.dst_comp_rect = tiler->dst_rects;
+        if (NvBufSurfTransformComposite(&batch, tiler->canvas, &composite) != NvBufSurfTransformError_Success) {
+            GST_ELEMENT_ERROR (tiler, STREAM, FAILED, ("NvBufSurfTransformComposite failed"), (NULL));
+            ret = GST_FLOW_ERROR;
+        }
+    }
+    if (ret == GST_FLOW_OK && NvBufSurfaceCopy(tiler->canvas, dst) != 0) {
+        GST_ELEMENT_ERROR (tiler, STREAM, FAILED, ("Cannot copy tiler canvas"), (NULL));
+        ret = GST_FLOW_ERROR;
+    }
+    gst_buffer_unmap(outbuf, &out_map);
+    gst_buffer_unmap(inbuf, &in_map);
+
+    g_mutex_lock(&tiler->stats_lock);
+    tiler->batches++;
+    tiler->tiles_composited += count;
+    tiler->tiles_skipped += skipped;
+    tiler->layout_changes += layout_changes;
+    tiler->composite_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&tiler->stats_lock);
+    return ret;
+}
+
+static void collect_tiler_metrics(GString *out, gpointer user_data) {
+    BatchTiler *tiler = user_data;
+
+    g_mutex_lock(&tiler->stats_lock);
+    g_string_append_printf(out, "ds_tiler_tiles_composited_total{branch=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                           tiler->branch, tiler->tiles_composited);
+    g_string_append_printf(out, "ds_tiler_tiles_skipped_total{branch=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                           tiler->branch, tiler->tiles_skipped);
+    g_string_append_printf(out, "ds_tiler_layout_changes_total{branch=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                           tiler->branch, tiler->layout_changes);
+    g_string_append_printf(out, "ds_tiler_batch_ms{branch=\"%s\"} %.3f\n", tiler->branch,
+                           tiler->batches ? tiler->composite_us / 1000.0 / tiler->batches : 0.0);
+    g_mutex_unlock(&tiler->stats_lock);
+}
+
+static void batch_tiler_finalize(GObject *object) {
+    BatchTiler *tiler = (BatchTiler *) object;
+    NvBufSurface *surface;
+
+    metrics_unregister(tiler->metrics_key);
+    while ((surface = g_async_queue_try_pop(tiler->free_surfaces)) != NULL)
+        NvBufSurfaceDestroy(surface);
+    g_async_queue_unref(tiler->free_surfaces);
+    if (tiler->canvas)
+        NvBufSurfaceDestroy(tiler->canvas);
+    g_free(tiler->tiles);
+    g_free(tiler->params);
+    g_free(tiler->src_rects);
+    g_free(tiler->dst_rects);
+    g_mutex_clear(&tiler->stats_lock);
+    g_free(tiler->branch);
+    g_free(tiler->metrics_key);
+    G_OBJECT_CLASS (batch_tiler_parent_class)->finalize(object);
+}
+
+static void batch_tiler_class_init(BatchTilerClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+    GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+
+    gobject_class->finalize = batch_tiler_finalize;
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_set_static_metadata(element_class, "Batch tiler", "Filter/Video",
+                                          "Composites a batch into a grid", "deepstream-test1");
+    trans_class->transform_caps = batch_tiler_transform_caps;
+    trans_class->prepare_output_buffer = batch_tiler_prepare_output_buffer;
+    trans_class->transform = batch_tiler_transform;
+    trans_class->passthrough_on_same_caps = FALSE;
+}
+
+static void batch_tiler_init(BatchTiler *tiler) {
+    tiler->free_surfaces = g_async_queue_new();
+    g_mutex_init(&tiler->stats_lock);
+}
+
+GstElement *batch_tiler_new(const gchar *name, const gchar *branch, guint width, guint height, guint gpu_id) {
+    BatchTiler *tiler = g_object_new(batch_tiler_get_type(), "name", name, NULL);
+
+    tiler->width = width & ~1u;
+    tiler->height = height & ~1u;
+    tiler->gpu_id = gpu_id;
+    tiler->branch = g_strdup(branch ? branch : "");
+    tiler->metrics_key = g_strdup_printf("batch-tiler-%p", (gpointer) tiler);
+    metrics_register(tiler->metrics_key, collect_tiler_metrics, tiler);
+    return GST_ELEMENT (tiler);
+}
@@ -0,0 +1,25 @@
+#ifndef BATCH_TILER_H
+#define BATCH_TILER_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Composites a batch of RGBA NVMM frames into one width x height grid with
+ * NvBufSurfTransformComposite, so N streams can be shown on one sink.
+ *
+ * Tile i shows source i, letterboxed into its cell. The source and
+ * destination rectangles of every tile are cached and only recomputed when
+ * the batch size or a source resolution changes. Tiles are composited into
+ * a persistent canvas: a source missing from the batch keeps its last
+ * tile. The canvas is then copied into the output buffer, which carries the
+ * batch meta on. Place after nvdsosd so boxes are already drawn.
+ *
+ * Composited and skipped tiles and the composite time are published
+ * through pipeline_metrics, labelled with the inference `branch` the tiler
+ * belongs to. */
+GstElement *batch_tiler_new(const gchar *name, const gchar *branch, guint width, guint height, guint gpu_id);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,253 @@
+#include <string.h>
+#include "class_counts.h"
+#include "pipeline_metrics.h"
+
+typedef guint32 BucketCounts[CLASS_COUNTS_MAX_SOURCES][CLASS_COUNTS_MAX_CLASSES];
+
+/* Running totals of one streaming thread. Only that thread writes them,
+ * with relaxed atomic stores of the incremented value (a plain mov, no
+ * lock prefix); the roll-up thread reads them with relaxed loads. */
+typedef struct {
+    guint64 totals[CLASS_COUNTS_MAX_SOURCES][CLASS_COUNTS_MAX_CLASSES];
+} ThreadBlock;
+
+typedef struct {
+    gint64 start;
+    BucketCounts counts;
+} Bucket;
+
+typedef struct {
+    gchar tag;
+    gint64 span;         /* seconds per bucket */
+    guint length;
+    Bucket *ring;
+    guint head;          /* next slot to fill */
+    guint filled;
+    Bucket current;      /* bucket being accumulated */
+} Tier;
+
+enum {
+    TIER_SECONDS,
+    TIER_MINUTES,
+    TIER_HOURS,
+    NUM_TIERS
+};
+
+struct _ClassCounts {
+    guint instance;
+    gchar *snapshot_path;
+
+    /* blocks of all threads that counted, guarded by blocks_lock */
+    GMutex blocks_lock;
+    GPtrArray *blocks;
+
+    /* owned by the roll-up thread, read by the metrics collector */
+    GMutex lock;
+    GCond cond;
+    gboolean stopping;
+    GThread *thread;
+    guint64 seen[CLASS_COUNTS_MAX_SOURCES][CLASS_COUNTS_MAX_CLASSES];
+    BucketCounts delta;
+    Tier tiers[NUM_TIERS];
+};
+
+/* Owned by the thread; the block belongs to the ClassCounts identified by
+ * `instance`, the latest one the thread counted into. */
+typedef struct {
+    guint instance;
+    ThreadBlock *block;
+} ThreadSlot;
+
+static GPrivate thread_slot = G_PRIVATE_INIT(g_free);
+static gint next_instance = 1;
+
+static ThreadBlock *get_thread_block(ClassCounts *counts) {
+    ThreadSlot *slot = g_private_get(&thread_slot);
+
+    if (!slot) {
+        slot = g_new0(ThreadSlot, 1);
+        g_private_set(&thread_slot, slot);
+    }
+    if (slot->block && slot->instance == counts->instance)
+        return slot->block;
+    slot->instance = counts->instance;
+    slot->block = g_new0(ThreadBlock, 1);
+    g_mutex_lock(&counts->blocks_lock);
+    g_ptr_array_add(counts->blocks, slot->block);
+    g_mutex_unlock(&counts->blocks_lock);
+    return slot->block;
+}
+
+void class_counts_add_batch(ClassCounts *counts, NvDsBatchMeta *batch_meta) {
+    ThreadBlock *block = get_thread_block(counts);
+    NvDsMetaList *l_frame, *l_obj;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        guint64 *totals;
+        if (frame_meta->source_id >= CLASS_COUNTS_MAX_SOURCES)
+            continue;
+        totals = block->totals[frame_meta->source_id];
+        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+            guint class_id = (guint) obj_meta->class_id;
+            if (class_id < CLASS_COUNTS_MAX_CLASSES)
+                __atomic_store_n(&totals[class_id], totals[class_id] + 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void tier_init(Tier *tier, gchar tag, gint64 span, guint length) {
+    tier->tag = tag;
+    tier->span = span;
+    tier->length = length;
+    tier->ring = g_new0(Bucket, length);
+}
+
+static void tier_add(Tier *tier, gint64 second, BucketCounts delta) {
+    gint64 start = second - second % tier->span;
+
+    if (tier->current.start != start) {
+        if (tier->current.start) {
+            tier->ring[tier->head] = tier->current;
+            tier->head = (tier->head + 1) % tier->length;
+            tier->filled = MIN(tier->filled + 1, tier->length);
+        }
+        memset(&tier->current, 0, sizeof(tier->current));
+        tier->current.start = start;
+    }
+    for (guint s = 0; s < CLASS_COUNTS_MAX_SOURCES; s++)
+        for (guint c = 0; c < CLASS_COUNTS_MAX_CLASSES; c++)
+            tier->current.counts[s][c] += delta[s][c];
+}
+
+static const Bucket *tier_latest(const Tier *tier) {
+    return tier->filled ? &tier->ring[(tier->head + tier->length - 1) % tier->length] : NULL;
+}
+
+/* Called with counts->lock held. */
+static void roll_up(ClassCounts *counts, gint64 second) {
+    guint64 sums[CLASS_COUNTS_MAX_SOURCES][CLASS_COUNTS_MAX_CLASSES] = {{0}};
+
+    g_mutex_lock(&counts->blocks_lock);
+    for (guint i = 0; i < counts->blocks->len; i++) {
+        ThreadBlock *block = g_ptr_array_index(counts->blocks, i);
+        for (guint s = 0; s < CLASS_COUNTS_MAX_SOURCES; s++)
+            for (guint c = 0; c < CLASS_COUNTS_MAX_CLASSES; c++)
+                sums[s][c] += __atomic_load_n(&block->totals[s][c], __ATOMIC_RELAXED);
+    }
+    g_mutex_unlock(&counts->blocks_lock);
+
+    for (guint s = 0; s < CLASS_COUNTS_MAX_SOURCES; s++)
+        for (guint c = 0; c < CLASS_COUNTS_MAX_CLASSES; c++) {
+            counts->delta[s][c] = (guint32) (sums[s][c] - counts->seen[s][c]);
+            counts->seen[s][c] = sums[s][c];
+        }
+    for (guint t = 0; t < NUM_TIERS; t++)
+        tier_add(&counts->tiers[t], second, counts->delta);
+}
+
+static void append_bucket(GString *out, gchar tag, const Bucket *bucket) {
+    g_string_append_printf(out, "%c %" G_GINT64_FORMAT, tag, bucket->start);
+    for (guint s = 0; s < CLASS_COUNTS_MAX_SOURCES; s++)
+        for (guint c = 0; c < CLASS_COUNTS_MAX_CLASSES; c++)
+            if (bucket->counts[s][c])
+                g_string_append_printf(out, " %u:%u:%u", s, c, bucket->counts[s][c]);
+    g_string_append_c(out, '\n');
+}
+
+/* Called with counts->lock held. Oldest bucket first in every tier, the
+ * last one is still being filled. */
+static void write_snapshot(ClassCounts *counts) {
+    GString *out = g_string_new(NULL);
+    GError *error = NULL;
+
+    for (guint t = 0; t < NUM_TIERS; t++) {
+        const Tier *tier = &counts->tiers[t];
+        for (guint i = 0; i < tier->filled; i++)
+            append_bucket(out, tier->tag, &tier->ring[(tier->head + tier->length - tier->filled + i) % tier->length]);
+        if (tier->current.start)
+            append_bucket(out, tier->tag, &tier->current);
+    }
+    if (!g_file_set_contents(counts->snapshot_path, out->str, (gssize) out->len, &error)) {
+        g_printerr("class counts: %s\n", error->message);
+        g_error_free(error);
+    }
+    g_string_free(out, TRUE);
+}
+
+static gpointer rollup_thread(gpointer data) {
+    ClassCounts *counts = data;
+
+    g_mutex_lock(&counts->lock);
+    while (!counts->stopping) {
+        /* wake just after the next wall clock second */
+        gint64 now = g_get_real_time();
+        gint64 deadline = g_get_monotonic_time() + G_USEC_PER_SEC - now % G_USEC_PER_SEC;
+        while (!counts->stopping && g_cond_wait_until(&counts->cond, &counts->lock, deadline));
+        /* the increase belongs to the second that just ended */
+        roll_up(counts, g_get_real_time() / G_USEC_PER_SEC - 1);
+        if (counts->snapshot_path)
+            write_snapshot(counts);
+    }
+    g_mutex_unlock(&counts->lock);
+    return NULL;
+}
+
+static void collect_class_count_metrics(GString *out, gpointer user_data) {
+    ClassCounts *counts = user_data;
+    const Bucket *minute, *hour;
+
+    g_mutex_lock(&counts->lock);
+    minute = tier_latest(&counts->tiers[TIER_MINUTES]);
+    hour = tier_latest(&counts->tiers[TIER_HOURS]);
+    for (guint s = 0; s < CLASS_COUNTS_MAX_SOURCES; s++)
+        for (guint c = 0; c < CLASS_COUNTS_MAX_CLASSES; c++) {
+            if (!counts->seen[s][c])
+                continue;
+            g_string_append_printf(out, "ds_class_count_total{source=\"%u\",class=\"%u\"} %" G_GUINT64_FORMAT "\n",
+                                   s, c, counts->seen[s][c]);
+            g_string_append_printf(out, "ds_class_count_last_minute{source=\"%u\",class=\"%u\"} %u\n",
+                                   s, c, minute ? minute->counts[s][c] : 0);
+            g_string_append_printf(out, "ds_class_count_last_hour{source=\"%u\",class=\"%u\"} %u\n",
+                                   s, c, hour ? hour->counts[s][c] : 0);
+        }
+    g_mutex_unlock(&counts->lock);
+}
+
+ClassCounts *class_counts_new(const gchar *snapshot_path) {
+    ClassCounts *counts = g_new0(ClassCounts, 1);
+
+    counts->instance = (guint) g_atomic_int_add(&next_instance, 1);
+    counts->snapshot_path = g_strdup(snapshot_path);
+    counts->blocks = g_ptr_array_new_with_free_func(g_free);
+    g_mutex_init(&counts->blocks_lock);
+    g_mutex_init(&counts->lock);
+    g_cond_init(&counts->cond);
+    tier_init(&counts->tiers[TIER_SECONDS], 's', 1, 60);
+    tier_init(&counts->tiers[TIER_MINUTES], 'm', 60, 60);
+    tier_init(&counts->tiers[TIER_HOURS], 'h', 3600, 24);
+    counts->thread = g_thread_new("class-counts", rollup_thread, counts);
+    metrics_register("class-counts", collect_class_count_metrics, counts);
+    return counts;
+}
+
+void class_counts_free(ClassCounts *counts) {
+    if (!counts)
+        return;
+    metrics_unregister("class-counts");
+    g_mutex_lock(&counts->lock);
+    counts->stopping = TRUE;
+    g_cond_signal(&counts->cond);
+    g_mutex_unlock(&counts->lock);
+    /* the thread rolls up and writes once more on its way out */
+    g_thread_join(counts->thread);
+    for (guint t = 0; t < NUM_TIERS; t++)
+        g_free(counts->tiers[t].ring);
+    g_ptr_array_free(counts->blocks, TRUE);
+    g_cond_clear(&counts->cond);
+    g_mutex_clear(&counts->lock);
+    g_mutex_clear(&counts->blocks_lock);
+    g_free(counts->snapshot_path);
+    g_free(counts);
+}
@@ -0,0 +1,51 @@
+#ifndef CLASS_COUNTS_H
+#define CLASS_COUNTS_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+
+G_BEGIN_DECLS
+
+/* Per-source, per-class detection counts over time, kept in process
+ * instead of being recomputed from the detection log.
+ *
+ * Streaming threads only increment counters in a block of their own, so
+ * the probe never takes a lock or a locked instruction. Once a second a
+ * background thread sums the blocks and rolls the increase up into three
+ * rings of fixed size, aligned to wall clock time:
+ *
+ *   seconds  the last 60 seconds
+ *   minutes  the last 60 minutes
+ *   hours    the last 24 hours
+ *
+ * The latest complete minute and hour are published via pipeline_metrics:
+ *
+ *   ds_class_count_total{source="0",class="2"}
+ *   ds_class_count_last_minute{source="0",class="2"}
+ *   ds_class_count_last_hour{source="0",class="2"}
+ *
+ * and, with a snapshot path, all three rings are written every second
+ * (atomically replaced), one line per bucket with its non-zero counts,
+ * oldest first; the last bucket of every tier is still being filled:
+ *
+ *   <s|m|h> <bucket start, unix seconds> <source>:<class>:<count> ...
+ *
+ * Class ids of CLASS_COUNTS_MAX_CLASSES and above are not counted. */
+
+#define CLASS_COUNTS_MAX_SOURCES 64
+#define CLASS_COUNTS_MAX_CLASSES 16
+
+typedef struct _ClassCounts ClassCounts;
+
+/* `snapshot_path` may be NULL. Starts the roll-up thread. */
+ClassCounts *class_counts_new(const gchar *snapshot_path);
+
+/* Counts the objects of a batch; call from any streaming thread. */
+void class_counts_add_batch(ClassCounts *counts, NvDsBatchMeta *batch_meta);
+
+/* Rolls up the last increments, writes a final snapshot and stops. */
+void class_counts_free(ClassCounts *counts);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,136 @@
+/* Decode cost per stream under a decode policy (decode_policy.h): decodes
+ * --streams copies of one input through the same source bins as the app,
+ * each into a fakesink, and reports the CPU used as streams per core, e.g.
+ *
+ *   ./decode_bench_ --streams 8 --software-decode --decode-cpu-budget 8 rtsp://cam1
+ *
+ * The app's own report cannot give this figure: its process also runs
+ * inference, the OSD, muxing and logging. Here the process does nothing
+ * but demux, parse, decode and upload. */
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include "async_log.h"
+#include "source_bin.h"
+
+static gint opt_streams = 4;
+static gint opt_duration = 30;
+static gint opt_threads = 0;
+static gint opt_cpu_budget = 0;
+static gboolean opt_keyframe_only = FALSE;
+static gboolean opt_software = FALSE;
+
+static GOptionEntry entries[] = {
+        {"streams", 'n', 0, G_OPTION_ARG_INT, &opt_streams, "Copies of the input decoded at once (default 4)", "N"},
+        {"duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration, "Seconds to measure (default 30)", "SEC"},
+        {"decode-threads", 0, 0, G_OPTION_ARG_INT, &opt_threads, "Decoder threads per stream", "N"},
+        {"decode-cpu-budget", 0, 0, G_OPTION_ARG_INT, &opt_cpu_budget, "Cores shared by all decoders", "N"},
+        {"keyframe-only", 'k', 0, G_OPTION_ARG_NONE, &opt_keyframe_only, "Decode keyframes only", NULL},
+        {"software-decode", 0, 0, G_OPTION_ARG_NONE, &opt_software, "Use libav even with nvv4l2decoder", NULL},
+        {NULL}
+};
+
+static gdouble cpu_seconds(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / (gdouble) G_USEC_PER_SEC;
+}
+
+static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
+    GMainLoop *loop = data;
+    GError *error = NULL;
+
+    switch (GST_MESSAGE_TYPE (msg)) {
+        case GST_MESSAGE_EOS:
+            g_main_loop_quit(loop);
+            break;
+        case GST_MESSAGE_ERROR:
+            gst_message_parse_error(msg, &error, NULL);
+            g_printerr("%s: %s\n", GST_OBJECT_NAME (msg->src), error->message);
+            g_error_free(error);
+            g_main_loop_quit(loop);
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+static gboolean stop(gpointer data) {
+    g_main_loop_quit(data);
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("URI - measure decode cost per stream");
+    GError *error = NULL;
+    GMainLoop *loop;
+    GstElement *pipeline;
+    GstBus *bus;
+    DecodePolicy *policy;
+    gint64 start;
+    gdouble cpu, wall, cores;
+    gint ret = 0;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_option_context_free(ctx);
+    if (argc != 2 || opt_streams < 1 || opt_duration < 1) {
+        g_printerr("Usage: %s [--streams N] [--duration SEC] URI\n", argv[0]);
+        return 1;
+    }
+
+    async_log_configure(NULL, LOG_WARNING, 0, 0);
+    nvds_log_open();
+    source_bin_set_software_decode(opt_software);
+    policy = decode_policy_new(opt_threads, opt_cpu_budget, opt_keyframe_only);
+    decode_policy_set_num_sources(policy, (guint) opt_streams);
+    loop = g_main_loop_new(NULL, FALSE);
+    pipeline = gst_pipeline_new("decode-bench");
+    for (gint i = 0; i < opt_streams; i++) {
+        GstElement *bin = create_source_bin((guint) i, argv[1], policy);
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+        if (!bin || !sink) {
+            g_printerr("Unable to create stream %d\n", i);
+            return 1;
+        }
+        g_object_set(G_OBJECT (sink), "sync", FALSE, NULL);
+        gst_bin_add_many(GST_BIN (pipeline), bin, sink, NULL);
+        if (!gst_element_link(bin, sink)) {
+            g_printerr("Unable to link stream %d\n", i);
+            return 1;
+        }
+    }
+    bus = gst_pipeline_get_bus(GST_PIPELINE (pipeline));
+    gst_bus_add_watch(bus, bus_call, loop);
+    gst_object_unref(bus);
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Unable to start the pipeline\n");
+        ret = 1;
+    } else {
+        cpu = cpu_seconds();
+        start = g_get_monotonic_time();
+        g_timeout_add_seconds((guint) opt_duration, stop, loop);
+        g_main_loop_run(loop);
+        cpu = cpu_seconds() - cpu;
+        wall = (g_get_monotonic_time() - start) / (gdouble) G_USEC_PER_SEC;
+        cores = wall > 0 ? cpu / wall : 0;
+        decode_policy_report(policy);
+        g_print("  %d streams on %.2f cores = %.2f streams/core\n", opt_streams, cores,
+                cores > 0 ? opt_streams / cores : 0.0);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    g_main_loop_unref(loop);
+    decode_policy_free(policy);
+    nvds_log_close();
+    return ret;
+}
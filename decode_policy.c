@@ -0,0 +1,153 @@
+#include "decode_policy.h"
+
+typedef struct {
+    gchar *name;
+    GWeakRef decoder;   /* cleared when its source goes away */
+    gint threads;
+    gint passed;
+    gint dropped;
+} DecoderStats;
+
+struct _DecodePolicy {
+    gint threads_per_stream;
+    gint cpu_budget;
+    gboolean keyframe_only;
+    /* decoders are attached from pad-added callbacks of several sources */
+    GMutex lock;
+    guint num_sources;
+    GPtrArray *decoders;
+    gint64 start_time;
+};
+
+static void decoder_stats_free(gpointer data) {
+    DecoderStats *stats = data;
+    g_weak_ref_clear(&stats->decoder);
+    g_free(stats->name);
+    g_free(stats);
+}
+
+DecodePolicy *decode_policy_new(gint threads_per_stream, gint cpu_budget,
+                                gboolean keyframe_only) {
+    DecodePolicy *policy = g_new0(DecodePolicy, 1);
+    policy->threads_per_stream = MAX(threads_per_stream, 0);
+    policy->cpu_budget = MAX(cpu_budget, 0);
+    policy->keyframe_only = keyframe_only;
+    g_mutex_init(&policy->lock);
+    policy->decoders = g_ptr_array_new_with_free_func(decoder_stats_free);
+    policy->start_time = g_get_monotonic_time();
+    return policy;
+}
+
+/* h264parse marks every access unit that is not an IDR/keyframe with
+ * DELTA_UNIT, so the decoder never sees (nor spends time on) them. */
+static GstPadProbeReturn
+keyframe_filter_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    GstBuffer *buf = (GstBuffer *) info->data;
+    DecoderStats *stats = (DecoderStats *) u_data;
+
+    if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        g_atomic_int_inc(&stats->dropped);
+        return GST_PAD_PROBE_DROP;
+    }
+    g_atomic_int_inc(&stats->passed);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+count_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    g_atomic_int_inc(&((DecoderStats *) u_data)->passed);
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean is_libav_decoder(GstElement *decoder) {
+    GstElementFactory *factory = gst_element_get_factory(decoder);
+    return factory && g_str_has_prefix(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), "avdec_");
+}
+
+/* With the lock held. */
+static gint decoder_threads(DecodePolicy *policy) {
+    if (policy->threads_per_stream > 0)
+        return policy->threads_per_stream;
+    if (policy->cpu_budget > 0)
+        return MAX(policy->cpu_budget / (gint) MAX(policy->num_sources, 1), 1);
+    return 0;
+}
+
+/* max-threads=0 lets libav pick one thread per core for every stream,
+ * which is what saturates the host with more than a few cameras. */
+static void apply_threads(DecoderStats *stats, GstElement *decoder, gint threads) {
+    if (threads > 0 && is_libav_decoder(decoder)) {
+        g_object_set(G_OBJECT (decoder), "max-threads", threads, NULL);
+        stats->threads = threads;
+    }
+}
+
+gboolean decode_policy_attach(DecodePolicy *policy, GstElement *decoder) {
+    DecoderStats *stats;
+    GstPad *sinkpad;
+
+    sinkpad = gst_element_get_static_pad(decoder, "sink");
+    if (!sinkpad) {
+        g_printerr("Decoder %s has no sink pad.\n", GST_ELEMENT_NAME (decoder));
+        return FALSE;
+    }
+    stats = g_new0(DecoderStats, 1);
+    stats->name = g_strdup(GST_ELEMENT_NAME (decoder));
+    g_weak_ref_init(&stats->decoder, decoder);
+    g_mutex_lock(&policy->lock);
+    apply_threads(stats, decoder, decoder_threads(policy));
+    g_ptr_array_add(policy->decoders, stats);
+    g_mutex_unlock(&policy->lock);
+    gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_BUFFER,
+                      policy->keyframe_only ? keyframe_filter_probe : count_probe,
+                      stats, NULL);
+    gst_object_unref(sinkpad);
+    return TRUE;
+}
+
+void decode_policy_set_num_sources(DecodePolicy *policy, guint num_sources) {
+    gint threads;
+
+    g_mutex_lock(&policy->lock);
+    policy->num_sources = num_sources;
+    threads = decoder_threads(policy);
+    for (guint i = 0; i < policy->decoders->len && policy->cpu_budget > 0 && policy->threads_per_stream == 0; i++) {
+        DecoderStats *stats = g_ptr_array_index(policy->decoders, i);
+        GstElement *decoder = g_weak_ref_get(&stats->decoder);
+        if (!decoder)
+            continue;
+        apply_threads(stats, decoder, threads);
+        gst_object_unref(decoder);
+    }
+    g_mutex_unlock(&policy->lock);
+}
+
+void decode_policy_report(DecodePolicy *policy) {
+    gdouble wall;
+    guint n;
+
+    g_mutex_lock(&policy->lock);
+    n = policy->decoders->len;
+    wall = (g_get_monotonic_time() - policy->start_time) / (gdouble) G_USEC_PER_SEC;
+
+    g_print("Decode policy: threads/stream=%d cpu-budget=%d keyframe-only=%s\n",
+            policy->threads_per_stream, policy->cpu_budget,
+            policy->keyframe_only ? "yes" : "no");
+    for (guint i = 0; i < n; i++) {
+        DecoderStats *stats = g_ptr_array_index(policy->decoders, i);
+        gint passed = g_atomic_int_get(&stats->passed);
+        gint dropped = g_atomic_int_get(&stats->dropped);
+        g_print("  %s: threads=%d decoded=%d (%.1f fps) dropped=%d\n",
+                stats->name, stats->threads, passed,
+                wall > 0 ? passed / wall : 0.0, dropped);
+    }
+    g_mutex_unlock(&policy->lock);
+}
+
+void decode_policy_free(DecodePolicy *policy) {
+    if (!policy)
+        return;
+    g_ptr_array_free(policy->decoders, TRUE);
+    g_mutex_clear(&policy->lock);
+    g_free(policy);
+}
@@ -0,0 +1,41 @@
+#ifndef DECODE_POLICY_H
+#define DECODE_POLICY_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Decode policy for the software (avdec_h264) path.
+ *
+ * threads_per_stream  explicit libav thread count for every decoder
+ * cpu_budget          total cores shared by all decoders; each decoder gets
+ *                     cpu_budget / num_sources threads (at least one),
+ *                     recomputed for all of them as sources come and go;
+ *                     libav applies it when the decoder next opens (a caps
+ *                     change). Ignored when threads_per_stream is set.
+ * keyframe_only       drop non-IDR access units before they reach the
+ *                     decoder, for low rate analytics streams
+ *
+ * With everything left at 0/FALSE the decoder keeps its defaults. */
+typedef struct _DecodePolicy DecodePolicy;
+
+DecodePolicy *decode_policy_new(gint threads_per_stream, gint cpu_budget,
+                                gboolean keyframe_only);
+
+/* Configures `decoder` (the element fed by h264parse) for the current
+ * number of sources and installs the keyframe filter if requested. */
+gboolean decode_policy_attach(DecodePolicy *policy, GstElement *decoder);
+
+/* The number of sources sharing cpu_budget; updates the decoders. */
+void decode_policy_set_num_sources(DecodePolicy *policy, guint num_sources);
+
+/* Prints frames decoded/dropped per stream. The process also runs
+ * inference, OSD and muxing, so decode cost per stream is measured with
+ * decode_bench_ instead. */
+void decode_policy_report(DecodePolicy *policy);
+
+void decode_policy_free(DecodePolicy *policy);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,549 @@
+/* Runs K instances of deepstream_test1_app_ as worker processes and
+ * assigns the sources to them by measured load, e.g.
+ *
+ *   ./deepstream_supervisor_ --workers 3 --budget 800 --metrics-file ds.prom \
+ *       --worker-args "--encode-output /tmp/out.mkv" rtsp://cam1 rtsp://cam2 ...
+ *
+ * Workers run with --control and get their sources as "add ID URI" /
+ * "remove ID" lines on stdin. Every interval the supervisor reads each
+ * worker's metrics file and estimates the cost of every source in ms of
+ * pipeline time per second:
+ *
+ *   cost = inference ms/s attributed to the source
+ *        + decoded Mpixel/s * --decode-ms-per-mpixel
+ *
+ * Sources are placed on the worker with the lowest (--policy spread) or
+ * highest (--policy pack) load they still fit in. A worker whose load
+ * exceeds --budget hands one source per interval to another worker it
+ * fits in, chosen by the same policy, adding it there before removing it
+ * from the old one. Workers
+ * that exit are restarted with their sources. The metrics of all workers
+ * are merged into one report with a worker="N" label, together with the
+ * supervisor's own load and placement metrics. */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#define MAX_WORKER_SOURCES 64
+/* intervals a migrated source stays put, so it is measured on the new
+ * worker before it can move again */
+#define MIGRATION_COOLDOWN 3
+#define COST_SMOOTHING 0.5
+
+static gint opt_workers = 2;
+static gdouble opt_budget = 800;
+static gint opt_worker_sources = 8;
+static gint opt_interval = 5;
+static gdouble opt_decode_ms_per_mpixel = 0.5;
+static gchar *opt_policy = NULL;
+static gchar *opt_app = NULL;
+static gchar *opt_worker_args = NULL;
+static gchar *opt_metrics_dir = NULL;
+static gchar *opt_metrics_file = NULL;
+
+static GOptionEntry entries[] = {
+        {"workers", 'w', 0, G_OPTION_ARG_INT, &opt_workers, "Worker processes (default 2)", "K"},
+        {"budget", 'b', 0, G_OPTION_ARG_DOUBLE, &opt_budget,
+                "Load per worker in ms of pipeline time per second (default 800)", "MS"},
+        {"worker-sources", 0, 0, G_OPTION_ARG_INT, &opt_worker_sources,
+                "Sources per worker, its muxer batch size (default 8)", "N"},
+        {"interval", 'i', 0, G_OPTION_ARG_INT, &opt_interval, "Measurement interval (default 5)", "SEC"},
+        {"decode-ms-per-mpixel", 0, 0, G_OPTION_ARG_DOUBLE, &opt_decode_ms_per_mpixel,
+                "Decode cost per decoded megapixel (default 0.5)", "MS"},
+        {"policy", 0, 0, G_OPTION_ARG_STRING, &opt_policy, "spread (default) or pack", "POLICY"},
+        {"app", 0, 0, G_OPTION_ARG_FILENAME, &opt_app, "Worker binary (default deepstream_test1_app_)", "PATH"},
+        {"worker-args", 0, 0, G_OPTION_ARG_STRING, &opt_worker_args, "Extra worker arguments", "ARGS"},
+        {"metrics-dir", 0, 0, G_OPTION_ARG_FILENAME, &opt_metrics_dir,
+                "Directory for the worker metrics files (default .)", "DIR"},
+        {"metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &opt_metrics_file,
+                "Write the merged report to FILE instead of stdout", "FILE"},
+        {NULL}
+};
+
+typedef struct {
+    gchar *uri;
+    gint worker;
+    guint slot;
+    /* ms of pipeline time per second, < 0 until measured */
+    gdouble cost;
+    /* worker counters at the last reading, valid if last_time */
+    gdouble last_frames;
+    gdouble last_pixels;
+    gdouble last_infer_ms;
+    gint64 last_time;
+    guint cooldown;
+} Source;
+
+typedef struct {
+    guint index;
+    gchar **argv;
+    gboolean started;
+    GPid pid;
+    gint stdin_fd;
+    gchar *metrics_path;
+    gint64 metrics_mtime;
+    gchar *report;
+    /* source index per worker slot, -1 if free */
+    gint slots[MAX_WORKER_SOURCES];
+    guint restarts;
+} Worker;
+
+typedef struct {
+    GMainLoop *loop;
+    Worker *workers;
+    guint num_workers;
+    Source *sources;
+    guint num_sources;
+    gboolean pack;
+    guint64 migrations;
+} Supervisor;
+
+static void spawn_worker(Supervisor *sup, Worker *worker);
+
+static void send_command(Worker *worker, const gchar *fmt, ...) G_GNUC_PRINTF (2, 3);
+
+static void send_command(Worker *worker, const gchar *fmt, ...) {
+    gchar *line;
+    va_list args;
+
+    if (worker->stdin_fd < 0)
+        return;
+    va_start(args, fmt);
+    line = g_strdup_vprintf(fmt, args);
+    va_end(args);
+    /* a dead worker is restarted with its sources anyway */
+    if (write(worker->stdin_fd, line, strlen(line)) < 0)
+        g_printerr("worker %u: %s\n", worker->index, g_strerror(errno));
+    g_free(line);
+}
+
+/* Sources not measured yet count as the average measured one. */
+static gdouble source_cost(Supervisor *sup, const Source *source) {
+    gdouble sum = 0;
+    guint n = 0;
+
+    if (source->cost >= 0)
+        return source->cost;
+    for (guint i = 0; i < sup->num_sources; i++)
+        if (sup->sources[i].cost >= 0) {
+            sum += sup->sources[i].cost;
+            n++;
+        }
+    return n ? sum / n : 1.0;
+}
+
+static gdouble worker_load(Supervisor *sup, const Worker *worker) {
+    gdouble load = 0;
+
+    for (guint s = 0; s < (guint) opt_worker_sources; s++)
+        if (worker->slots[s] >= 0)
+            load += source_cost(sup, &sup->sources[worker->slots[s]]);
+    return load;
+}
+
+static gint free_slot(const Worker *worker) {
+    for (guint s = 0; s < (guint) opt_worker_sources; s++)
+        if (worker->slots[s] < 0)
+            return (gint) s;
+    return -1;
+}
+
+/* Worker for a source of `cost`: lowest (spread) or highest (pack) load
+ * among those it fits in. Without `must_fit` the least loaded worker with
+ * a free slot is the fallback. */
+static Worker *choose_worker(Supervisor *sup, gdouble cost, const Worker *exclude, gboolean must_fit) {
+    Worker *best = NULL, *fallback = NULL;
+    gdouble best_load = 0, fallback_load = 0;
+
+    for (guint w = 0; w < sup->num_workers; w++) {
+        Worker *worker = &sup->workers[w];
+        gdouble load;
+        if (worker == exclude || free_slot(worker) < 0)
+            continue;
+        load = worker_load(sup, worker);
+        if (!fallback || load < fallback_load) {
+            fallback = worker;
+            fallback_load = load;
+        }
+        if (load + cost > opt_budget)
+            continue;
+        if (!best || (sup->pack ? load > best_load : load < best_load)) {
+            best = worker;
+            best_load = load;
+        }
+    }
+    return best ? best : must_fit ? NULL : fallback;
+}
+
+static void assign(Supervisor *sup, guint index, Worker *worker) {
+    Source *source = &sup->sources[index];
+    gint slot = free_slot(worker);
+
+    worker->slots[slot] = (gint) index;
+    source->worker = (gint) worker->index;
+    source->slot = (guint) slot;
+    source->last_time = 0;
+    send_command(worker, "add %d %s\n", slot, source->uri);
+}
+
+static void migrate(Supervisor *sup, guint index, Worker *to) {
+    Source *source = &sup->sources[index];
+    Worker *from = &sup->workers[source->worker];
+    guint old_slot = source->slot;
+
+    /* make before break: the stream is up on the new worker first */
+    assign(sup, index, to);
+    from->slots[old_slot] = -1;
+    send_command(from, "remove %u\n", old_slot);
+    source->cooldown = MIGRATION_COOLDOWN;
+    sup->migrations++;
+    g_print("source %u (%.1f ms/s): worker %u -> worker %u\n", index, source_cost(sup, source),
+            from->index, to->index);
+}
+
+static void place_unassigned(Supervisor *sup) {
+    for (guint i = 0; i < sup->num_sources; i++) {
+        Worker *worker;
+        if (sup->sources[i].worker >= 0)
+            continue;
+        worker = choose_worker(sup, source_cost(sup, &sup->sources[i]), NULL, FALSE);
+        if (worker)
+            assign(sup, i, worker);
+    }
+}
+
+/* Moves one source off every worker over budget. */
+static void rebalance(Supervisor *sup) {
+    for (guint w = 0; w < sup->num_workers; w++) {
+        Worker *worker = &sup->workers[w];
+        gdouble excess = worker_load(sup, worker) - opt_budget;
+        gint pick = -1;
+        Worker *to;
+
+        if (excess <= 0 || !worker->pid)
+            continue;
+        /* the cheapest source that removes the excess, else the largest */
+        for (guint s = 0; s < (guint) opt_worker_sources; s++) {
+            gint index = worker->slots[s];
+            gdouble cost, pick_cost;
+            if (index < 0 || sup->sources[index].cost < 0 || sup->sources[index].cooldown)
+                continue;
+            cost = sup->sources[index].cost;
+            pick_cost = pick >= 0 ? sup->sources[pick].cost : 0;
+            if (pick < 0 || (cost >= excess && (pick_cost < excess || cost < pick_cost))
+                || (cost < excess && pick_cost < excess && cost > pick_cost))
+                pick = index;
+        }
+        if (pick < 0)
+            continue;
+        to = choose_worker(sup, sup->sources[pick].cost, worker, TRUE);
+        if (to)
+            migrate(sup, (guint) pick, to);
+    }
+}
+
+/* First-fit decreasing over the measured costs: how many workers of
+ * --budget the sources need. */
+static guint workers_needed(Supervisor *sup) {
+    gdouble *costs = g_new(gdouble, sup->num_sources), *loads = g_new0(gdouble, sup->num_sources);
+    guint *counts = g_new0(guint, sup->num_sources), bins = 0;
+
+    for (guint i = 0; i < sup->num_sources; i++)
+        costs[i] = source_cost(sup, &sup->sources[i]);
+    for (guint i = 1; i < sup->num_sources; i++)
+        for (guint j = i; j > 0 && costs[j] > costs[j - 1]; j--) {
+            gdouble t = costs[j];
+            costs[j] = costs[j - 1];
+            costs[j - 1] = t;
+        }
+    for (guint i = 0; i < sup->num_sources; i++) {
+        guint b;
+        for (b = 0; b < bins; b++)
+            if (loads[b] + costs[i] <= opt_budget && counts[b] < (guint) opt_worker_sources)
+                break;
+        if (b == bins)
+            bins++;
+        loads[b] += costs[i];
+        counts[b]++;
+    }
+    g_free(costs);
+    g_free(loads);
+    g_free(counts);
+    return bins;
+}
+
+/* Reads the worker's metrics file if it was rewritten and updates the
+ * cost of its sources from the counter deltas. */
+static void read_worker_metrics(Supervisor *sup, Worker *worker) {
+    struct stat st;
+    gchar *text = NULL, **lines;
+    gint64 mtime;
+    gdouble frames[MAX_WORKER_SOURCES] = {0}, pixels[MAX_WORKER_SOURCES] = {0}, infer_ms[MAX_WORKER_SOURCES] = {0};
+    gboolean seen[MAX_WORKER_SOURCES] = {0};
+
+    if (stat(worker->metrics_path, &st) != 0)
+        return;
+    mtime = (gint64) st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+    if (mtime == worker->metrics_mtime || !g_file_get_contents(worker->metrics_path, &text, NULL, NULL))
+        return;
+    worker->metrics_mtime = mtime;
+    g_free(worker->report);
+    worker->report = text;
+
+    lines = g_strsplit(text, "\n", -1);
+    for (guint i = 0; lines[i]; i++) {
+        guint slot;
+        gdouble value;
+        if (sscanf(lines[i], "ds_source_frames_total{source=\"%u\"} %lf", &slot, &value) == 2
+            && slot < MAX_WORKER_SOURCES) {
+            frames[slot] = value;
+            seen[slot] = TRUE;
+        } else if (sscanf(lines[i], "ds_source_pixels_total{source=\"%u\"} %lf", &slot, &value) == 2
+                   && slot < MAX_WORKER_SOURCES) {
+            pixels[slot] = value;
+        } else if (sscanf(lines[i], "ds_source_infer_ms_total{source=\"%u\"} %lf", &slot, &value) == 2
+                   && slot < MAX_WORKER_SOURCES) {
+            infer_ms[slot] = value;
+        }
+    }
+    g_strfreev(lines);
+
+    for (guint s = 0; s < (guint) opt_worker_sources; s++) {
+        Source *source;
+        gdouble seconds, cost;
+        if (worker->slots[s] < 0 || !seen[s])
+            continue;
+        source = &sup->sources[worker->slots[s]];
+        seconds = (mtime - source->last_time) / (gdouble) G_USEC_PER_SEC;
+        /* counters restart with the slot, the first reading is a baseline */
+        if (source->last_time && seconds > 0 && frames[s] >= source->last_frames) {
+            cost = (infer_ms[s] - source->last_infer_ms) / seconds
+                   + (pixels[s] - source->last_pixels) / 1e6 / seconds * opt_decode_ms_per_mpixel;
+            source->cost = source->cost < 0 ? cost : COST_SMOOTHING * cost + (1 - COST_SMOOTHING) * source->cost;
+        }
+        source->last_frames = frames[s];
+        source->last_pixels = pixels[s];
+        source->last_infer_ms = infer_ms[s];
+        source->last_time = mtime;
+    }
+}
+
+/* Appends a worker's report with worker="N" added to every sample. */
+static void append_relabeled(GString *out, const gchar *text, guint worker) {
+    gchar **lines = g_strsplit(text, "\n", -1);
+
+    for (guint i = 0; lines[i]; i++) {
+        const gchar *line = lines[i], *brace = strchr(line, '{'), *space = strchr(line, ' ');
+        if (!line[0] || line[0] == '#')
+            continue;
+        if (brace && (!space || brace < space))
+            g_string_append_printf(out, "%.*s{worker=\"%u\",%s\n", (int) (brace - line), line, worker, brace + 1);
+        else if (space)
+            g_string_append_printf(out, "%.*s{worker=\"%u\"}%s\n", (int) (space - line), line, worker, space);
+    }
+    g_strfreev(lines);
+}
+
+static void write_report(Supervisor *sup) {
+    GString *out = g_string_new(NULL);
+    GError *error = NULL;
+    guint unplaced = 0;
+
+    for (guint w = 0; w < sup->num_workers; w++) {
+        Worker *worker = &sup->workers[w];
+        guint count = 0;
+        for (guint s = 0; s < (guint) opt_worker_sources; s++)
+            count += worker->slots[s] >= 0;
+        if (worker->report)
+            append_relabeled(out, worker->report, w);
+        g_string_append_printf(out, "ds_supervisor_worker_up{worker=\"%u\"} %d\n", w, worker->pid != 0);
+        g_string_append_printf(out, "ds_supervisor_worker_sources{worker=\"%u\"} %u\n", w, count);
+        g_string_append_printf(out, "ds_supervisor_worker_load_ms{worker=\"%u\"} %.1f\n", w,
+                               worker_load(sup, worker));
+        g_string_append_printf(out, "ds_supervisor_worker_restarts_total{worker=\"%u\"} %u\n", w,
+                               worker->restarts);
+    }
+    for (guint i = 0; i < sup->num_sources; i++) {
+        Source *source = &sup->sources[i];
+        if (source->worker < 0) {
+            unplaced++;
+            continue;
+        }
+        g_string_append_printf(out, "ds_supervisor_source_cost_ms{source=\"%u\",worker=\"%d\",slot=\"%u\"} %.1f\n",
+                               i, source->worker, source->slot, source->cost < 0 ? 0.0 : source->cost);
+    }
+    g_string_append_printf(out, "ds_supervisor_unplaced_sources %u\n", unplaced);
+    g_string_append_printf(out, "ds_supervisor_migrations_total %" G_GUINT64_FORMAT "\n", sup->migrations);
+    g_string_append_printf(out, "ds_supervisor_workers_needed %u\n", workers_needed(sup));
+
+    if (opt_metrics_file) {
+        if (!g_file_set_contents(opt_metrics_file, out->str, (gssize) out->len, &error)) {
+            g_printerr("metrics: %s\n", error->message);
+            g_error_free(error);
+        }
+    } else {
+        g_print("%s", out->str);
+    }
+    g_string_free(out, TRUE);
+}
+
+static gboolean on_interval(gpointer data) {
+    Supervisor *sup = data;
+
+    for (guint w = 0; w < sup->num_workers; w++) {
+        if (!sup->workers[w].pid)
+            spawn_worker(sup, &sup->workers[w]);
+        read_worker_metrics(sup, &sup->workers[w]);
+    }
+    for (guint i = 0; i < sup->num_sources; i++)
+        if (sup->sources[i].cooldown)
+            sup->sources[i].cooldown--;
+    place_unassigned(sup);
+    rebalance(sup);
+    write_report(sup);
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_worker_exit(GPid pid, gint status, gpointer data) {
+    Worker *worker = data;
+
+    g_printerr("worker %u (pid %d) exited with status %d, restarting\n", worker->index, pid, status);
+    g_spawn_close_pid(pid);
+    close(worker->stdin_fd);
+    worker->stdin_fd = -1;
+    worker->pid = 0;
+}
+
+/* Starts the worker and re-adds the sources assigned to it. */
+static void spawn_worker(Supervisor *sup, Worker *worker) {
+    GError *error = NULL;
+
+    /* counters of an earlier instance must not become a baseline */
+    unlink(worker->metrics_path);
+    worker->metrics_mtime = 0;
+    if (!g_spawn_async_with_pipes(NULL, worker->argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+                                  NULL, NULL, &worker->pid, &worker->stdin_fd, NULL, NULL, &error)) {
+        g_printerr("worker %u: %s\n", worker->index, error->message);
+        g_error_free(error);
+        worker->pid = 0;
+        return;
+    }
+    if (worker->started)
+        worker->restarts++;
+    worker->started = TRUE;
+    g_child_watch_add(worker->pid, on_worker_exit, worker);
+    for (guint s = 0; s < (guint) opt_worker_sources; s++) {
+        gint index = worker->slots[s];
+        if (index < 0)
+            continue;
+        sup->sources[index].last_time = 0;
+        send_command(worker, "add %u %s\n", s, sup->sources[index].uri);
+    }
+}
+
+static gboolean on_signal(gpointer data) {
+    g_main_loop_quit(((Supervisor *) data)->loop);
+    return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("<uri> [...] - run pipeline workers");
+    GError *error = NULL;
+    Supervisor sup = {0};
+    gchar **extra = NULL;
+    gchar *app_dir;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return -1;
+    }
+    g_option_context_free(ctx);
+    if (argc < 2 || opt_workers < 1 || opt_worker_sources < 1 || opt_worker_sources > MAX_WORKER_SOURCES) {
+        g_printerr("Usage: %s [--workers K] [--worker-sources N <= %d] <uri> [...]\n", argv[0],
+                   MAX_WORKER_SOURCES);
+        return -1;
+    }
+    if (opt_worker_args && !g_shell_parse_argv(opt_worker_args, NULL, &extra, &error)) {
+        g_printerr("--worker-args: %s\n", error->message);
+        g_error_free(error);
+        return -1;
+    }
+    if (opt_interval <= 0)
+        opt_interval = 5;
+    sup.pack = g_strcmp0(opt_policy, "pack") == 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    sup.num_sources = (guint) argc - 1;
+    sup.sources = g_new0(Source, sup.num_sources);
+    for (guint i = 0; i < sup.num_sources; i++) {
+        sup.sources[i].uri = argv[i + 1];
+        sup.sources[i].worker = -1;
+        sup.sources[i].cost = -1;
+    }
+
+    app_dir = g_path_get_dirname(argv[0]);
+    sup.num_workers = (guint) opt_workers;
+    sup.workers = g_new0(Worker, sup.num_workers);
+    for (guint w = 0; w < sup.num_workers; w++) {
+        Worker *worker = &sup.workers[w];
+        gchar *name = g_strdup_printf("worker-%u.prom", w);
+        worker->index = w;
+        worker->stdin_fd = -1;
+        worker->metrics_path = g_build_filename(opt_metrics_dir ? opt_metrics_dir : ".", name, NULL);
+        g_free(name);
+        for (guint s = 0; s < MAX_WORKER_SOURCES; s++)
+            worker->slots[s] = -1;
+    }
+
+    sup.loop = g_main_loop_new(NULL, FALSE);
+    for (guint w = 0; w < sup.num_workers; w++) {
+        Worker *worker = &sup.workers[w];
+        GPtrArray *worker_argv = g_ptr_array_new();
+        g_ptr_array_add(worker_argv, opt_app ? g_strdup(opt_app) : g_build_filename(app_dir, "deepstream_test1_app_", NULL));
+        g_ptr_array_add(worker_argv, g_strdup("--control"));
+        g_ptr_array_add(worker_argv, g_strdup_printf("--max-sources=%d", opt_worker_sources));
+        g_ptr_array_add(worker_argv, g_strdup_printf("--metrics-file=%s", worker->metrics_path));
+        g_ptr_array_add(worker_argv, g_strdup_printf("--metrics-interval=%d", opt_interval));
+        for (guint i = 0; extra && extra[i]; i++)
+            g_ptr_array_add(worker_argv, g_strdup(extra[i]));
+        g_ptr_array_add(worker_argv, NULL);
+        worker->argv = (gchar **) g_ptr_array_free(worker_argv, FALSE);
+        spawn_worker(&sup, worker);
+    }
+    g_free(app_dir);
+    g_strfreev(extra);
+
+    place_unassigned(&sup);
+    g_timeout_add_seconds((guint) opt_interval, on_interval, &sup);
+    g_unix_signal_add(SIGINT, on_signal, &sup);
+    g_unix_signal_add(SIGTERM, on_signal, &sup);
+    g_main_loop_run(sup.loop);
+
+    for (guint w = 0; w < sup.num_workers; w++) {
+        Worker *worker = &sup.workers[w];
+        if (worker->pid) {
+            kill(worker->pid, SIGTERM);
+            waitpid(worker->pid, NULL, 0);
+        }
+        if (worker->stdin_fd >= 0)
+            close(worker->stdin_fd);
+        g_strfreev(worker->argv);
+        g_free(worker->metrics_path);
+        g_free(worker->report);
+    }
+    g_free(sup.workers);
+    g_free(sup.sources);
+    g_main_loop_unref(sup.loop);
+    return 0;
+}
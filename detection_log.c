@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include "detection_log.h"
+
+#define DETECTION_LOG_STOP ((gpointer) 1)
+
+typedef struct {
+    guint8 *data;
+    DetectionLogSegmentHeader *header;
+} DetectionLogSegment;
+
+struct _DetectionLog {
+    gchar *dir;
+    guint capacity;
+    guint next_segment_id;
+    DetectionLogSegment *current;
+    /* full segments waiting for the writer, and written ones for reuse */
+    GAsyncQueue *pending;
+    GAsyncQueue *recycled;
+    GThread *writer;
+    guint64 rows;
+    guint segments_written;
+    gint64 open_time;
+};
+
+static const gsize column_width[DETECTION_LOG_NUM_COLUMNS] = {
+        sizeof(guint64), sizeof(guint64), sizeof(guint64), sizeof(guint64),
+        sizeof(guint32), sizeof(gint32),
+        sizeof(gfloat), sizeof(gfloat), sizeof(gfloat), sizeof(gfloat), sizeof(gfloat)
+};
+
+static void layout_columns(DetectionLogSegmentHeader *header, guint capacity) {
+    guint64 offset = sizeof(DetectionLogSegmentHeader);
+    for (guint c = 0; c < DETECTION_LOG_NUM_COLUMNS; c++) {
+        header->column_offset[c] = offset;
+        offset += column_width[c] * capacity;
+    }
+}
+
+gsize detection_log_segment_size(guint capacity) {
+    gsize size = sizeof(DetectionLogSegmentHeader);
+    for (guint c = 0; c < DETECTION_LOG_NUM_COLUMNS; c++)
+        size += column_width[c] * capacity;
+    return size;
+}
+
+gboolean detection_log_segment_valid(const DetectionLogSegmentHeader *h, gsize size) {
+    if (size < sizeof(*h) || h->magic != DETECTION_LOG_MAGIC || h->version != DETECTION_LOG_VERSION
+        || h->num_rows > h->capacity)
+        return FALSE;
+    for (guint c = 0; c < DETECTION_LOG_NUM_COLUMNS; c++) {
+        guint64 offset = h->column_offset[c];
+        if (offset < sizeof(*h) || offset % column_width[c] != 0 || offset > size
+            || column_width[c] * h->capacity > size - offset)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void segment_reset(DetectionLogSegment *seg, guint capacity) {
+    DetectionLogSegmentHeader *h = seg->header;
+    memset(h, 0, sizeof(*h));
+    h->magic = DETECTION_LOG_MAGIC;
+    h->version = DETECTION_LOG_VERSION;
+    h->capacity = capacity;
+    h->min_ts = G_MAXUINT64;
+    layout_columns(h, capacity);
+}
+
+static DetectionLogSegment *segment_acquire(DetectionLog *log) {
+    DetectionLogSegment *seg = g_async_queue_try_pop(log->recycled);
+    if (!seg) {
+        seg = g_new0(DetectionLogSegment, 1);
+        seg->data = g_malloc(detection_log_segment_size(log->capacity));
+        seg->header = (DetectionLogSegmentHeader *) seg->data;
+    }
+    segment_reset(seg, log->capacity);
+    return seg;
+}
+
+static void segment_free(gpointer data) {
+    DetectionLogSegment *seg = data;
+    g_free(seg->data);
+    g_free(seg);
+}
+
+/* A partially filled segment is shrunk so its capacity equals its row
+ * count. Columns only ever move towards the header, so memmove in column
+ * order is safe. */
+static void segment_compact(DetectionLogSegment *seg) {
+    DetectionLogSegmentHeader *h = seg->header;
+    guint64 old_offset[DETECTION_LOG_NUM_COLUMNS];
+
+    if (h->num_rows == h->capacity)
+        return;
+    memcpy(old_offset, h->column_offset, sizeof(old_offset));
+    h->capacity = h->num_rows;
+    layout_columns(h, h->capacity);
+    for (guint c = 0; c < DETECTION_LOG_NUM_COLUMNS; c++)
+        memmove(seg->data + h->column_offset[c], seg->data + old_offset[c],
+                column_width[c] * h->num_rows);
+}
+
+static gpointer writer_thread(gpointer data) {
+    DetectionLog *log = data;
+
+    for (;;) {
+        DetectionLogSegment *seg = g_async_queue_pop(log->pending);
+        GError *error = NULL;
+        gchar name[32];
+        gchar *path;
+
+        if (seg == DETECTION_LOG_STOP)
+            break;
+        segment_compact(seg);
+        g_snprintf(name, sizeof(name), "seg-%08u.dlog", log->next_segment_id++);
+        path = g_build_filename(log->dir, name, NULL);
+        /* g_file_set_contents writes a temporary file and renames it, so the
+         * query tool never maps a half written segment. */
+        if (!g_file_set_contents(path, (const gchar *) seg->data,
+                                 detection_log_segment_size(seg->header->capacity), &error)) {
+            g_printerr("detection log: %s\n", error->message);
+            g_error_free(error);
+        } else {
+            log->segments_written++;
+        }
+        g_free(path);
+        g_async_queue_push(log->recycled, seg);
+    }
+    return NULL;
+}
+
+/* Continue numbering after any segments left by a previous run. */
+static guint first_free_segment_id(const gchar *dir) {
+    GDir *d = g_dir_open(dir, 0, NULL);
+    const gchar *name;
+    guint next = 0;
+
+    if (!d)
+        return 0;
+    while ((name = g_dir_read_name(d)) != NULL) {
+        guint id;
+        if (sscanf(name, "seg-%08u.dlog", &id) == 1 && id >= next)
+            next = id + 1;
+    }
+    g_dir_close(d);
+    return next;
+}
+
+DetectionLog *detection_log_open(const gchar *dir, guint rows_per_segment) {
+    DetectionLog *log;
+
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        g_printerr("detection log: cannot create directory %s\n", dir);
+        return NULL;
+    }
+    log = g_new0(DetectionLog, 1);
+    log->dir = g_strdup(dir);
+    log->capacity = rows_per_segment ? rows_per_segment : DETECTION_LOG_DEFAULT_ROWS_PER_SEGMENT;
+    log->next_segment_id = first_free_segment_id(dir);
+    log->pending = g_async_queue_new();
+    log->recycled = g_async_queue_new_full(segment_free);
+    log->current = segment_acquire(log);
+    log->open_time = g_get_monotonic_time();
+    log->writer = g_thread_new("detection-log", writer_thread, log);
+    return log;
+}
+
+static void submit_current(DetectionLog *log) {
+    g_async_queue_push(log->pending, log->current);
+    log->current = segment_acquire(log);
+}
+
+void detection_log_append(DetectionLog *log, const DetectionRecord *rec) {
+    DetectionLogSegment *seg = log->current;
+    DetectionLogSegmentHeader *h = seg->header;
+    guint row = h->num_rows;
+    guint source_bit = detection_log_source_bit(rec->source_id);
+
+#define COLUMN(c, type) ((type *) (seg->data + h->column_offset[c]))
+    COLUMN(DETECTION_LOG_COL_TS, guint64)[row] = rec->ts;
+    COLUMN(DETECTION_LOG_COL_PTS, guint64)[row] = rec->pts;
+    COLUMN(DETECTION_LOG_COL_NTP, guint64)[row] = rec->ntp_timestamp;
+    COLUMN(DETECTION_LOG_COL_OBJECT_ID, guint64)[row] = rec->object_id;
+    COLUMN(DETECTION_LOG_COL_SOURCE_ID, guint32)[row] = rec->source_id;
+    COLUMN(DETECTION_LOG_COL_CLASS_ID, gint32)[row] = rec->class_id;
+    COLUMN(DETECTION_LOG_COL_LEFT, gfloat)[row] = rec->left;
+    COLUMN(DETECTION_LOG_COL_TOP, gfloat)[row] = rec->top;
+    COLUMN(DETECTION_LOG_COL_WIDTH, gfloat)[row] = rec->width;
+    COLUMN(DETECTION_LOG_COL_HEIGHT, gfloat)[row] = rec->height;
+    COLUMN(DETECTION_LOG_COL_CONFIDENCE, gfloat)[row] = rec->confidence;
+#undef COLUMN
+
+    h->min_ts = MIN(h->min_ts, rec->ts);
+    h->max_ts = MAX(h->max_ts, rec->ts);
+    h->class_mask |= G_GUINT64_CONSTANT(1) << detection_log_class_bit(rec->class_id);
+    h->source_mask[source_bit / 64] |= G_GUINT64_CONSTANT(1) << (source_bit % 64);
+    h->num_rows++;
+    log->rows++;
+
+    if (h->num_rows == h->capacity)
+        submit_current(log);
+}
+
+void detection_log_append_batch(DetectionLog *log, NvDsBatchMeta *batch_meta,
+                                const MuxScaling *scaling) {
+    guint64 wall_clock_ns = (guint64) g_get_real_time() * 1000;
+    NvDsMetaList *l_frame, *l_obj;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        DetectionRecord rec;
+
+        rec.pts = frame_meta->buf_pts;
+        rec.ntp_timestamp = frame_meta->ntp_timestamp;
+        rec.ts = frame_meta->ntp_timestamp ? frame_meta->ntp_timestamp : wall_clock_ns;
+        rec.source_id = frame_meta->source_id;
+        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+            NvOSD_RectParams rect = obj_meta->rect_params;
+
+            if (scaling)
+                mux_scaling_rect_to_source(scaling, frame_meta, &obj_meta->rect_params, &rect);
+            rec.class_id = obj_meta->class_id;
+            rec.object_id = obj_meta->object_id;
+            rec.confidence = obj_meta->confidence;
+            rec.left = rect.left;
+            rec.top = rect.top;
+            rec.width = rect.width;
+            rec.height = rect.height;
+            detection_log_append(log, &rec);
+        }
+    }
+}
+
+void detection_log_close(DetectionLog *log) {
+    gdouble seconds;
+
+    if (!log)
+        return;
+    if (log->current->header->num_rows > 0)
+        submit_current(log);
+    g_async_queue_push(log->pending, DETECTION_LOG_STOP);
+    g_thread_join(log->writer);
+
+    seconds = (g_get_monotonic_time() - log->open_time) / (gdouble) G_USEC_PER_SEC;
+    g_print("Detection log: %" G_GUINT64_FORMAT " rows in %u segments, %.0f rows/s\n",
+            log->rows, log->segments_written, seconds > 0 ? log->rows / seconds : 0.0);
+
+    segment_free(log->current);
+    g_async_queue_unref(log->pending);
+    g_async_queue_unref(log->recycled);
+    g_free(log->dir);
+    g_free(log);
+}
@@ -0,0 +1,115 @@
+#ifndef DETECTION_LOG_H
+#define DETECTION_LOG_H
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+#include "mux_scaling.h"
+
+G_BEGIN_DECLS
+
+/* Columnar detection log.
+ *
+ * Every detected object is appended as one row. Rows are buffered column by
+ * column and written out as fixed capacity segment files (seg-XXXXXXXX.dlog)
+ * by a background writer thread, so the streaming thread never touches the
+ * disk. Each segment starts with a DetectionLogSegmentHeader carrying the
+ * min/max timestamp and a class/source bitmap, which lets a reader decide
+ * from the first page alone whether the segment can be skipped. */
+
+#define DETECTION_LOG_MAGIC 0x474f4c44u /* "DLOG" */
+#define DETECTION_LOG_VERSION 1
+#define DETECTION_LOG_DEFAULT_ROWS_PER_SEGMENT (64 * 1024)
+
+/* Bitmaps cover class ids 0..63 and source ids 0..255. Larger ids set the
+ * last bit, which readers treat as "may contain anything above". */
+#define DETECTION_LOG_CLASS_BITS 64
+#define DETECTION_LOG_SOURCE_WORDS 4
+#define DETECTION_LOG_SOURCE_BITS (DETECTION_LOG_SOURCE_WORDS * 64)
+
+typedef struct {
+    /** effective time in ns since epoch: ntp_timestamp, or wall clock when
+     * the source carries no ntp time (file sources) */
+    guint64 ts;
+    guint64 pts;
+    guint64 ntp_timestamp;
+    guint64 object_id;
+    guint32 source_id;
+    gint32 class_id;
+    gfloat left;
+    gfloat top;
+    gfloat width;
+    gfloat height;
+    gfloat confidence;
+} DetectionRecord;
+
+/* On-disk segment header, followed by the columns in this order, each one
+ * `capacity` entries long: ts, pts, ntp_timestamp, object_id (guint64),
+ * source_id (guint32), class_id (gint32), left, top, width, height,
+ * confidence (gfloat). Only the first `num_rows` entries of each column are
+ * valid. Column offsets are stored explicitly so readers never compute them. */
+typedef enum {
+    DETECTION_LOG_COL_TS = 0,
+    DETECTION_LOG_COL_PTS,
+    DETECTION_LOG_COL_NTP,
+    DETECTION_LOG_COL_OBJECT_ID,
+    DETECTION_LOG_COL_SOURCE_ID,
+    DETECTION_LOG_COL_CLASS_ID,
+    DETECTION_LOG_COL_LEFT,
+    DETECTION_LOG_COL_TOP,
+    DETECTION_LOG_COL_WIDTH,
+    DETECTION_LOG_COL_HEIGHT,
+    DETECTION_LOG_COL_CONFIDENCE,
+    DETECTION_LOG_NUM_COLUMNS
+} DetectionLogColumn;
+
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    guint32 capacity;
+    guint32 num_rows;
+    guint64 min_ts;
+    guint64 max_ts;
+    guint64 class_mask;
+    guint64 source_mask[DETECTION_LOG_SOURCE_WORDS];
+    guint64 column_offset[DETECTION_LOG_NUM_COLUMNS];
+} DetectionLogSegmentHeader;
+
+typedef struct _DetectionLog DetectionLog;
+
+/* Creates `dir` if needed and starts the writer thread. `rows_per_segment`
+ * of 0 selects DETECTION_LOG_DEFAULT_ROWS_PER_SEGMENT. Returns NULL if the
+ * directory cannot be created. */
+DetectionLog *detection_log_open(const gchar *dir, guint rows_per_segment);
+
+void detection_log_append(DetectionLog *log, const DetectionRecord *rec);
+
+/* Appends every NvDsObjectMeta of every frame in the batch. Boxes are
+ * mapped to source pixels through `scaling`; NULL logs muxer coordinates. */
+void detection_log_append_batch(DetectionLog *log, NvDsBatchMeta *batch_meta,
+                                const MuxScaling *scaling);
+
+/* Flushes the partially filled segment, joins the writer thread and prints
+ * the ingest rate. */
+void detection_log_close(DetectionLog *log);
+
+/* Returns the size in bytes of a segment file holding `capacity` rows. */
+gsize detection_log_segment_size(guint capacity);
+
+/* Whether a mapped segment of `size` bytes is one this version wrote and
+ * every column of it lies inside the file; check before reading columns. */
+gboolean detection_log_segment_valid(const DetectionLogSegmentHeader *h, gsize size);
+
+/* Bitmap helpers shared by the writer and the query tool. */
+static inline guint detection_log_class_bit(gint class_id) {
+    return (class_id < 0 || class_id >= DETECTION_LOG_CLASS_BITS) ?
+           DETECTION_LOG_CLASS_BITS - 1 : (guint) class_id;
+}
+
+static inline guint detection_log_source_bit(guint source_id) {
+    return source_id >= DETECTION_LOG_SOURCE_BITS ?
+           DETECTION_LOG_SOURCE_BITS - 1 : source_id;
+}
+
+G_END_DECLS
+
+#endif
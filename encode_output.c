@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include "encode_output.h"
+
+static gboolean have_factory(const gchar *name) {
+    GstElementFactory *factory = gst_element_factory_find(name);
+
+    if (!factory)
+        return FALSE;
+    gst_object_unref(factory);
+    return TRUE;
+}
+
+/* Adds the elements to the bin and links them in order. */
+static gboolean add_and_link(GstBin *bin, GstElement **elements, guint n) {
+    for (guint i = 0; i < n; i++) {
+        if (!elements[i])
+            return FALSE;
+        gst_bin_add(bin, elements[i]);
+    }
+    for (guint i = 1; i < n; i++)
+        if (!gst_element_link(elements[i - 1], elements[i]))
+            return FALSE;
+    return TRUE;
+}
+
+GstElement *create_encode_output_bin(const gchar *location, guint bitrate_kbps) {
+    GstElement *bin = gst_bin_new("encode-output");
+    GstElement *chain[8];
+    gboolean hardware = have_factory("nvv4l2h264enc");
+    GstCaps *caps;
+    GstPad *sinkpad;
+    guint n = 0;
+
+    if (bitrate_kbps == 0)
+        bitrate_kbps = 4000;
+
+    chain[n++] = gst_element_factory_make("nvvideoconvert", "encode-convert");
+    chain[n] = gst_element_factory_make("capsfilter", "encode-caps");
+    caps = gst_caps_from_string(hardware ? "video/x-raw(memory:NVMM), format=I420"
+                                         : "video/x-raw, format=I420");
+    if (chain[n])
+        g_object_set(G_OBJECT (chain[n]), "caps", caps, NULL);
+    gst_caps_unref(caps);
+    n++;
+    if (hardware) {
+        chain[n] = gst_element_factory_make("nvv4l2h264enc", "encoder");
+        if (chain[n])
+            g_object_set(G_OBJECT (chain[n]), "bitrate", bitrate_kbps * 1000, NULL);
+    } else {
+        chain[n] = gst_element_factory_make("x264enc", "encoder");
+        if (chain[n])
+            g_object_set(G_OBJECT (chain[n]), "bitrate", bitrate_kbps,
+                         "tune", 0x4 /* zerolatency */, "speed-preset", 1 /* ultrafast */, NULL);
+    }
+    n++;
+    chain[n++] = gst_element_factory_make("h264parse", "encode-parser");
+
+    if (g_str_has_prefix(location, "udp://")) {
+        gchar **host_port = g_strsplit(location + strlen("udp://"), ":", 2);
+        chain[n] = gst_element_factory_make("rtph264pay", "encode-pay");
+        if (chain[n])
+            g_object_set(G_OBJECT (chain[n]), "config-interval", 1, NULL);
+        n++;
+        chain[n] = gst_element_factory_make("udpsink", "encode-sink");
+        if (chain[n] && host_port[0] && host_port[1])
+            g_object_set(G_OBJECT (chain[n]), "host", host_port[0],
+                         "port", atoi(host_port[1]), "sync", FALSE, "async", FALSE, NULL);
+        else if (chain[n])
+            g_printerr("Encode output %s: expected udp://host:port\n", location);
+        n++;
+        g_strfreev(host_port);
+    } else {
+        if (!g_str_has_suffix(location, ".h264"))
+            chain[n++] = gst_element_factory_make("matroskamux", "encode-mux");
+        chain[n] = gst_element_factory_make("filesink", "encode-sink");
+        if (chain[n])
+            g_object_set(G_OBJECT (chain[n]), "location", location, "sync", FALSE, "async", FALSE, NULL);
+        n++;
+    }
+
+    if (!add_and_link(GST_BIN (bin), chain, n)) {
+        g_printerr("Encode output could not be created.\n");
+        gst_object_unref(bin);
+        return NULL;
+    }
+    sinkpad = gst_element_get_static_pad(chain[0], "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", sinkpad));
+    gst_object_unref(sinkpad);
+    g_print("Encoding to %s, %s H.264 at %u kbps\n", location,
+            hardware ? "hardware" : "software", bitrate_kbps);
+    return bin;
+}
@@ -0,0 +1,22 @@
+#ifndef ENCODE_OUTPUT_H
+#define ENCODE_OUTPUT_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Headless output: encodes the rendered frames to H.264 instead of showing
+ * them with nveglglessink.
+ *
+ *   udp://host:port   RTP/H.264 to host:port, e.g. view with
+ *                     gst-launch-1.0 udpsrc port=5000 caps=application/x-rtp ! rtph264depay ! avdec_h264 ! autovideosink
+ *   x.h264            elementary stream
+ *   anything else     Matroska file, playable while still being written
+ *
+ * nvv4l2h264enc is used when available, x264enc otherwise. The bin exposes
+ * a single "sink" ghost pad accepting NVMM frames. */
+GstElement *create_encode_output_bin(const gchar *location, guint bitrate_kbps);
+
+G_END_DECLS
+
+#endif
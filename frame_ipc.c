@@ -0,0 +1,561 @@
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <gst/app/gstappsrc.h>
+#include "frame_ipc.h"
+#include "async_log.h"
+#include "gstnvdsmeta.h"
+#include "nvbufsurface.h"
+#include "pipeline_metrics.h"
+
+#define SLOT_ALIGN 64
+/* frames a source may have queued in its appsrc before new ones are
+ * dropped */
+#define MAX_QUEUED_FRAMES 2
+/* pooled frames per source: the queued ones plus those being uploaded */
+#define POOL_FRAMES_PER_SOURCE (MAX_QUEUED_FRAMES + 2)
+/* serialized meta waiting for its frame to leave the analytics muxer */
+#define MAX_PENDING_META 16
+
+#define ALIGN_UP(x) (((x) + SLOT_ALIGN - 1) & ~(guint) (SLOT_ALIGN - 1))
+
+struct _FrameIpcWriter {
+    ShmRing *ring;
+    guint max_sources;
+    guint width;
+    guint height;
+    guint frame_size;
+
+    GMutex stats_lock;
+    guint64 batches;
+    guint64 frames;
+    guint64 unsupported;
+    gint64 publish_us;
+};
+
+/* Serialized meta of a pushed frame, found again by its PTS. */
+typedef struct {
+    GstClockTime pts;
+    FrameIpcFrame frame;
+} PendingMeta;
+
+struct _FrameIpcReader {
+    gchar *name;
+    ShmRing *ring;              /* a restarted ingest process creates a new one */
+    GstBufferPool *pool;
+    guint num_sources;
+    guint width;
+    guint height;
+    guint frame_size;
+    GstElement *sources[FRAME_IPC_MAX_SOURCES];
+
+    GThread *thread;
+    gint running;
+
+    GMutex lock;
+    GQueue pending[FRAME_IPC_MAX_SOURCES];
+
+    GMutex stats_lock;
+    guint64 batches;
+    guint64 frames;
+    guint64 lost;
+    guint64 torn;
+    guint64 dropped;
+    guint64 restarts;
+    guint64 latency_ns;
+    guint64 latency_max_ns;
+    guint64 latency_count;
+};
+
+static guint batch_header_size(void) {
+    return ALIGN_UP((guint) sizeof(FrameIpcBatch));
+}
+
+static gboolean is_nv12(NvBufSurfaceColorFormat format) {
+    return format == NVBUF_COLOR_FORMAT_NV12 || format == NVBUF_COLOR_FORMAT_NV12_ER
+           || format == NVBUF_COLOR_FORMAT_NV12_709 || format == NVBUF_COLOR_FORMAT_NV12_709_ER;
+}
+
+/* ---- ingest side ---- */
+
+static void collect_writer_metrics(GString *out, gpointer user_data) {
+    FrameIpcWriter *writer = user_data;
+
+    g_mutex_lock(&writer->stats_lock);
+    g_string_append_printf(out, "ds_ipc_published_batches_total %" G_GUINT64_FORMAT "\n", writer->batches);
+    g_string_append_printf(out, "ds_ipc_published_frames_total %" G_GUINT64_FORMAT "\n", writer->frames);
+    g_string_append_printf(out, "ds_ipc_unsupported_frames_total %" G_GUINT64_FORMAT "\n", writer->unsupported);
+    g_string_append_printf(out, "ds_ipc_publish_us %.1f\n",
+                           writer->batches ? (gdouble) writer->publish_us / writer->batches : 0.0);
+    g_mutex_unlock(&writer->stats_lock);
+}
+
+FrameIpcWriter *frame_ipc_writer_new(const gchar *name, guint max_sources, guint width, guint height,
+                                     guint num_slots, GError **error) {
+    FrameIpcWriter *writer;
+    guint frame_size = frame_ipc_frame_size(width, height);
+    guint32 *user;
+    ShmRing *ring;
+
+    if (max_sources == 0 || max_sources > FRAME_IPC_MAX_SOURCES) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: %u sources, at most %d supported",
+                    name, max_sources, FRAME_IPC_MAX_SOURCES);
+        return NULL;
+    }
+    ring = shm_ring_create(name, num_slots, batch_header_size() + max_sources * ALIGN_UP(frame_size), error);
+    if (!ring)
+        return NULL;
+    user = shm_ring_user(ring);
+    user[1] = max_sources;
+    user[2] = width;
+    user[3] = height;
+    __atomic_store_n(&user[0], FRAME_IPC_MAGIC, __ATOMIC_RELEASE);
+
+    writer = g_new0(FrameIpcWriter, 1);
+    writer->ring = ring;
+    writer->max_sources = max_sources;
+    writer->width = width;
+    writer->height = height;
+    writer->frame_size = frame_size;
+    g_mutex_init(&writer->stats_lock);
+    metrics_register("ipc-writer", collect_writer_metrics, writer);
+    g_print("Publishing batches to /dev/shm/%s, %u slots of %u bytes\n", name, num_slots,
+            shm_ring_header(ring)->payload_size);
+    return writer;
+}
+
+/* Copies a mapped NV12 surface into the slot with default strides. */
+static void copy_nv12(const NvBufSurfaceParams *params, guint8 *dst, guint width, guint height) {
+    guint stride = GST_ROUND_UP_4(width), rows = GST_ROUND_UP_2(height);
+    const guint8 *luma = params->mappedAddr.addr[0], *chroma = params->mappedAddr.addr[1];
+    guint8 *dst_chroma = dst + stride * rows;
+
+    for (guint y = 0; y < height; y++)
+        memcpy(dst + y * stride, luma + y * params->planeParams.pitch[0], width);
+    for (guint y = 0; y < rows / 2; y++)
+        memcpy(dst_chroma + y * stride, chroma + y * params->planeParams.pitch[1], GST_ROUND_UP_2(width));
+}
+
+static GstPadProbeReturn
+writer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    FrameIpcWriter *writer = (FrameIpcWriter *) u_data;
+    GstBuffer *buf = (GstBuffer *) info->data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+    gint64 start = g_get_monotonic_time();
+    guint64 unsupported = 0;
+    NvBufSurface *surface;
+    FrameIpcBatch *batch;
+    guint8 *payload;
+    guint offset = batch_header_size(), n = 0;
+    GstMapInfo map;
+    NvDsMetaList *l_frame;
+
+    if (!batch_meta || !gst_buffer_map(buf, &map, GST_MAP_READ))
+        return GST_PAD_PROBE_OK;
+    surface = (NvBufSurface *) map.data;
+    payload = shm_ring_begin_write(writer->ring);
+    batch = (FrameIpcBatch *) payload;
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL && n < writer->max_sources;
+         l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        NvBufSurfaceParams *params;
+        FrameIpcFrame *frame = &batch->frames[n];
+
+        if (frame_meta->batch_id >= surface->numFilled) {
+            unsupported++;
+            continue;
+        }
+        params = &surface->surfaceList[frame_meta->batch_id];
+        if (!is_nv12(params->colorFormat) || params->width != writer->width || params->height != writer->height
+            || NvBufSurfaceMap(surface, (int) frame_meta->batch_id, -1, NVBUF_MAP_READ) != 0) {
+            unsupported++;
+            continue;
+        }
+        NvBufSurfaceSyncForCpu(surface, (int) frame_meta->batch_id, -1);
+        copy_nv12(params, payload + offset, writer->width, writer->height);
+        NvBufSurfaceUnMap(surface, (int) frame_meta->batch_id, -1);
+
+        frame->source_id = frame_meta->source_id;
+        frame->frame_num = frame_meta->frame_num;
+        frame->buf_pts = frame_meta->buf_pts;
+        frame->ntp_timestamp = frame_meta->ntp_timestamp;
+        frame->source_frame_width = frame_meta->source_frame_width;
+        frame->source_frame_height = frame_meta->source_frame_height;
+        frame->offset = offset;
+        frame->size = writer->frame_size;
+        offset += ALIGN_UP(writer->frame_size);
+        n++;
+    }
+    batch->num_frames = n;
+    gst_buffer_unmap(buf, &map);
+    shm_ring_commit(writer->ring, offset);
+
+    g_mutex_lock(&writer->stats_lock);
+    writer->batches++;
+    writer->frames += n;
+    writer->unsupported += unsupported;
+    writer->publish_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&writer->stats_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+void frame_ipc_writer_attach(FrameIpcWriter *writer, GstElement *sink) {
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, writer_probe, writer, NULL);
+    gst_object_unref(pad);
+}
+
+void frame_ipc_writer_free(FrameIpcWriter *writer) {
+    if (!writer)
+        return;
+    metrics_unregister("ipc-writer");
+    shm_ring_close(writer->ring);
+    g_mutex_clear(&writer->stats_lock);
+    g_free(writer);
+}
+
+/* ---- analytics side ---- */
+
+/* Maps the ring if the writer finished setting it up. */
+static ShmRing *open_ring(const gchar *name, guint *num_sources, guint *width, guint *height, GError **error) {
+    ShmRing *ring = shm_ring_open(name, error);
+    const ShmRingHeader *header;
+
+    if (!ring)
+        return NULL;
+    header = shm_ring_header(ring);
+    if (__atomic_load_n(&header->user[0], __ATOMIC_ACQUIRE) != FRAME_IPC_MAGIC
+        || header->user[1] == 0 || header->user[1] > FRAME_IPC_MAX_SOURCES
+        || header->payload_size < batch_header_size()
+                                  + header->user[1] * ALIGN_UP(frame_ipc_frame_size(header->user[2], header->user[3]))) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: not a frame ring", name);
+        shm_ring_close(ring);
+        return NULL;
+    }
+    *num_sources = header->user[1];
+    *width = header->user[2];
+    *height = header->user[3];
+    return ring;
+}
+
+static gboolean producer_alive(ShmRing *ring) {
+    pid_t pid = shm_ring_header(ring)->producer_pid;
+
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+static void collect_reader_metrics(GString *out, gpointer user_data) {
+    FrameIpcReader *reader = user_data;
+
+    g_mutex_lock(&reader->stats_lock);
+    g_string_append_printf(out, "ds_ipc_batches_total %" G_GUINT64_FORMAT "\n", reader->batches);
+    g_string_append_printf(out, "ds_ipc_frames_total %" G_GUINT64_FORMAT "\n", reader->frames);
+    g_string_append_printf(out, "ds_ipc_lost_batches_total %" G_GUINT64_FORMAT "\n", reader->lost);
+    g_string_append_printf(out, "ds_ipc_torn_frames_total %" G_GUINT64_FORMAT "\n", reader->torn);
+    g_string_append_printf(out, "ds_ipc_dropped_frames_total %" G_GUINT64_FORMAT "\n", reader->dropped);
+    g_string_append_printf(out, "ds_ipc_producer_restarts_total %" G_GUINT64_FORMAT "\n", reader->restarts);
+    g_string_append_printf(out, "ds_ipc_latency_us %.1f\n",
+                           reader->latency_count ? reader->latency_ns / 1000.0 / reader->latency_count : 0.0);
+    g_string_append_printf(out, "ds_ipc_latency_max_us %.1f\n", reader->latency_max_ns / 1000.0);
+    reader->latency_max_ns = 0;
+    g_mutex_unlock(&reader->stats_lock);
+}
+
+FrameIpcReader *frame_ipc_reader_new(const gchar *name, GError **error) {
+    FrameIpcReader *reader;
+    GError *local_error = NULL;
+    ShmRing *ring = NULL;
+    GstStructure *config;
+    guint num_sources = 0, width = 0, height = 0;
+    gboolean waiting = FALSE;
+
+    /* the ring is missing until ingest starts, and briefly not set up */
+    for (guint not_ready = 0; !ring; ) {
+        g_clear_error(&local_error);
+        ring = open_ring(name, &num_sources, &width, &height, &local_error);
+        if (ring)
+            break;
+        if (!g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT) && ++not_ready > 50) {
+            g_propagate_error(error, local_error);
+            return NULL;
+        }
+        if (!waiting)
+            g_print("Waiting for the ingest process on /dev/shm/%s\n", name);
+        waiting = TRUE;
+        g_usleep(200000);
+    }
+    reader = g_new0(FrameIpcReader, 1);
+    reader->name = g_strdup(name);
+    reader->ring = ring;
+    reader->num_sources = num_sources;
+    reader->width = width;
+    reader->height = height;
+    reader->frame_size = frame_ipc_frame_size(width, height);
+    /* frames are copied out of the slots, which the writer reuses without
+     * waiting for us */
+    reader->pool = gst_buffer_pool_new();
+    config = gst_buffer_pool_get_config(reader->pool);
+    gst_buffer_pool_config_set_params(config, NULL, reader->frame_size, 0, num_sources * POOL_FRAMES_PER_SOURCE);
+    gst_buffer_pool_set_config(reader->pool, config);
+    gst_buffer_pool_set_active(reader->pool, TRUE);
+    g_mutex_init(&reader->lock);
+    g_mutex_init(&reader->stats_lock);
+    for (guint i = 0; i < FRAME_IPC_MAX_SOURCES; i++)
+        g_queue_init(&reader->pending[i]);
+    metrics_register("ipc-reader", collect_reader_metrics, reader);
+    g_print("Reading batches of %u x %ux%u from /dev/shm/%s\n", num_sources, width, height, name);
+    return reader;
+}
+
+guint frame_ipc_reader_num_sources(FrameIpcReader *reader) {
+    return reader->num_sources;
+}
+
+guint frame_ipc_reader_width(FrameIpcReader *reader) {
+    return reader->width;
+}
+
+guint frame_ipc_reader_height(FrameIpcReader *reader) {
+    return reader->height;
+}
+
+GstElement *frame_ipc_reader_make_source(FrameIpcReader *reader, guint source_id) {
+    gchar name[32], *caps_str;
+    GstElement *bin, *appsrc, *convert, *filter;
+    GstCaps *caps;
+    GstPad *srcpad;
+
+    if (source_id >= reader->num_sources)
+        return NULL;
+    g_snprintf(name, sizeof(name), "ipc-source-%u", source_id);
+    bin = gst_bin_new(name);
+    appsrc = gst_element_factory_make("appsrc", "ipc-src");
+    convert = gst_element_factory_make("nvvideoconvert", "ipc-upload");
+    filter = gst_element_factory_make("capsfilter", "ipc-caps");
+    if (!bin || !appsrc || !convert || !filter) {
+        g_printerr("IPC source elements could not be created.\n");
+        return NULL;
+    }
+    caps_str = g_strdup_printf("video/x-raw, format=NV12, width=%u, height=%u, framerate=0/1",
+                               reader->width, reader->height);
+    caps = gst_caps_from_string(caps_str);
+    /* push_batch() timestamps, the PTS finds the frame's meta again */
+    g_object_set(G_OBJECT (appsrc), "caps", caps, "is-live", TRUE, "format", GST_FORMAT_TIME,
+                 "do-timestamp", FALSE, "block", FALSE, NULL);
+    gst_caps_unref(caps);
+    g_free(caps_str);
+    caps = gst_caps_from_string("video/x-raw(memory:NVMM), format=NV12");
+    g_object_set(G_OBJECT (filter), "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_bin_add_many(GST_BIN (bin), appsrc, convert, filter, NULL);
+    if (!gst_element_link_many(appsrc, convert, filter, NULL)) {
+        g_printerr("IPC source elements could not be linked.\n");
+        gst_object_unref(bin);
+        return NULL;
+    }
+    srcpad = gst_element_get_static_pad(filter, "src");
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", srcpad));
+    gst_object_unref(srcpad);
+    reader->sources[source_id] = appsrc;
+    return bin;
+}
+
+/* Running time of the source, as do-timestamp would set it. */
+static GstClockTime running_time(GstElement *element) {
+    GstClock *clock = gst_element_get_clock(element);
+    GstClockTime now;
+
+    if (!clock)
+        return GST_CLOCK_TIME_NONE;
+    now = gst_clock_get_time(clock) - gst_element_get_base_time(element);
+    gst_object_unref(clock);
+    return now;
+}
+
+/* Copies the frames of one batch into pooled buffers for their appsrc.
+ * The writer may reuse the slot meanwhile; a frame is only pushed if the
+ * slot still holds `seq` once it is copied. */
+static void push_batch(FrameIpcReader *reader, const ShmRingSlot *slot, guint64 seq) {
+    const FrameIpcBatch *batch = (const FrameIpcBatch *) slot->payload;
+    guint payload_size = shm_ring_header(reader->ring)->payload_size;
+    guint num_frames = MIN(batch->num_frames, FRAME_IPC_MAX_SOURCES);
+    guint64 frames = 0, dropped = 0, torn = 0, latency_ns = 0, latency_max_ns = 0;
+    /* all pooled frames still queued or uploading: drop, never wait */
+    GstBufferPoolAcquireParams params = {0};
+
+    params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+    for (guint i = 0; i < num_frames; i++) {
+        FrameIpcFrame frame = batch->frames[i];
+        GstBuffer *buffer = NULL;
+        GstElement *appsrc;
+        PendingMeta *meta;
+        GstClockTime pts;
+        guint64 latency;
+
+        if (!shm_ring_slot_valid(slot, seq)) {
+            torn += num_frames - i;
+            break;
+        }
+        if (frame.source_id >= reader->num_sources || frame.size != reader->frame_size
+            || (guint64) frame.offset + frame.size > payload_size || !reader->sources[frame.source_id]) {
+            torn++;
+            continue;
+        }
+        appsrc = reader->sources[frame.source_id];
+        pts = running_time(appsrc);
+        if (gst_app_src_get_current_level_bytes(GST_APP_SRC (appsrc)) >= MAX_QUEUED_FRAMES * frame.size
+            || !GST_CLOCK_TIME_IS_VALID (pts)
+            || gst_buffer_pool_acquire_buffer(reader->pool, &buffer, &params) != GST_FLOW_OK) {
+            dropped++;
+            continue;
+        }
+        gst_buffer_fill(buffer, 0, slot->payload + frame.offset, frame.size);
+        if (!shm_ring_slot_valid(slot, seq)) {
+            gst_buffer_unref(buffer);
+            torn += num_frames - i;
+            break;
+        }
+        latency = shm_ring_now_ns() - slot->publish_ns;
+        latency_ns += latency;
+        latency_max_ns = MAX(latency_max_ns, latency);
+        GST_BUFFER_PTS (buffer) = pts;
+
+        meta = g_new(PendingMeta, 1);
+        meta->pts = pts;
+        meta->frame = frame;
+        g_mutex_lock(&reader->lock);
+        g_queue_push_tail(&reader->pending[frame.source_id], meta);
+        while (g_queue_get_length(&reader->pending[frame.source_id]) > MAX_PENDING_META)
+            g_free(g_queue_pop_head(&reader->pending[frame.source_id]));
+        g_mutex_unlock(&reader->lock);
+
+        gst_app_src_push_buffer(GST_APP_SRC (appsrc), buffer);
+        frames++;
+    }
+    g_mutex_lock(&reader->stats_lock);
+    reader->batches++;
+    reader->frames += frames;
+    reader->dropped += dropped;
+    reader->torn += torn;
+    reader->latency_ns += latency_ns;
+    reader->latency_max_ns = MAX(reader->latency_max_ns, latency_max_ns);
+    reader->latency_count += frames;
+    g_mutex_unlock(&reader->stats_lock);
+}
+
+/* After the writer died, maps the ring of its successor once it has the
+ * same geometry. */
+static gboolean reopen_ring(FrameIpcReader *reader) {
+    guint num_sources, width, height;
+    ShmRing *ring = open_ring(reader->name, &num_sources, &width, &height, NULL);
+
+    if (!ring)
+        return FALSE;
+    if (!producer_alive(ring)) {
+        shm_ring_close(ring);
+        return FALSE;
+    }
+    if (num_sources != reader->num_sources || width != reader->width || height != reader->height) {
+        nvds_log(DSLOG_CAT_APP, LOG_WARNING, "/dev/shm/%s: ingest restarted with %u x %ux%u, expected %u x %ux%u",
+                 reader->name, num_sources, width, height, reader->num_sources, reader->width, reader->height);
+        shm_ring_close(ring);
+        return FALSE;
+    }
+    shm_ring_close(reader->ring);
+    reader->ring = ring;
+    g_mutex_lock(&reader->stats_lock);
+    reader->restarts++;
+    g_mutex_unlock(&reader->stats_lock);
+    nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "Ingest process restarted, reading /dev/shm/%s again", reader->name);
+    return TRUE;
+}
+
+static gpointer reader_thread(gpointer data) {
+    FrameIpcReader *reader = data;
+    /* start with the next batch rather than replaying the ring */
+    guint64 seq = shm_ring_header(reader->ring)->write_seq + 1;
+
+    while (g_atomic_int_get(&reader->running)) {
+        guint64 wanted = seq;
+        const ShmRingSlot *slot = shm_ring_wait(reader->ring, &seq, 200);
+
+        if (!slot) {
+            if (!producer_alive(reader->ring) && reopen_ring(reader))
+                seq = shm_ring_header(reader->ring)->write_seq + 1;
+            continue;
+        }
+        if (seq != wanted) {
+            g_mutex_lock(&reader->stats_lock);
+            reader->lost += seq - wanted;
+            g_mutex_unlock(&reader->stats_lock);
+        }
+        push_batch(reader, slot, seq);
+        seq++;
+    }
+    return NULL;
+}
+
+static GstPadProbeReturn
+restore_meta_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    FrameIpcReader *reader = (FrameIpcReader *) u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *) info->data);
+    NvDsMetaList *l_frame;
+
+    if (!batch_meta)
+        return GST_PAD_PROBE_OK;
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        GQueue *pending;
+        PendingMeta *meta;
+
+        if (frame_meta->source_id >= FRAME_IPC_MAX_SOURCES)
+            continue;
+        pending = &reader->pending[frame_meta->source_id];
+        g_mutex_lock(&reader->lock);
+        /* PTS grow per source; older entries are frames dropped after
+         * their push */
+        while ((meta = g_queue_peek_head(pending)) && meta->pts < frame_meta->buf_pts)
+            g_free(g_queue_pop_head(pending));
+        meta = meta && meta->pts == frame_meta->buf_pts ? g_queue_pop_head(pending) : NULL;
+        g_mutex_unlock(&reader->lock);
+        if (!meta)
+            continue;
+        frame_meta->frame_num = meta->frame.frame_num;
+        frame_meta->ntp_timestamp = meta->frame.ntp_timestamp;
+        frame_meta->source_frame_width = meta->frame.source_frame_width;
+        frame_meta->source_frame_height = meta->frame.source_frame_height;
+        g_free(meta);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void frame_ipc_reader_start(FrameIpcReader *reader, GstElement *streammux) {
+    GstPad *pad = gst_element_get_static_pad(streammux, "src");
+
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, restore_meta_probe, reader, NULL);
+    gst_object_unref(pad);
+    g_atomic_int_set(&reader->running, TRUE);
+    reader->thread = g_thread_new("ipc-reader", reader_thread, reader);
+}
+
+void frame_ipc_reader_free(FrameIpcReader *reader) {
+    if (!reader)
+        return;
+    if (reader->thread) {
+        g_atomic_int_set(&reader->running, FALSE);
+        g_thread_join(reader->thread);
+    }
+    metrics_unregister("ipc-reader");
+    for (guint i = 0; i < FRAME_IPC_MAX_SOURCES; i++)
+        while (!g_queue_is_empty(&reader->pending[i]))
+            g_free(g_queue_pop_head(&reader->pending[i]));
+    gst_buffer_pool_set_active(reader->pool, FALSE);
+    gst_object_unref(reader->pool);
+    shm_ring_close(reader->ring);
+    g_mutex_clear(&reader->lock);
+    g_mutex_clear(&reader->stats_lock);
+    g_free(reader->name);
+    g_free(reader);
+}
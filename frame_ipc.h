@@ -0,0 +1,93 @@
+#ifndef FRAME_IPC_H
+#define FRAME_IPC_H
+
+#include <gst/gst.h>
+#include "shm_ring.h"
+
+G_BEGIN_DECLS
+
+/* Frame and metadata IPC between an ingest and an analytics process.
+ *
+ *   ingest:     source bins -> nvstreammux -> fakesink (FrameIpcWriter)
+ *   analytics:  appsrc x N (FrameIpcReader) -> nvvideoconvert ->
+ *               nvstreammux -> nvinfer -> ...
+ *
+ * The writer publishes every batch into a shm_ring slot: a FrameIpcBatch
+ * header carrying the NvDsFrameMeta fields set before inference, followed
+ * by the NV12 planes of every frame with GStreamer's default strides. The
+ * reader copies each frame into a pooled buffer of the appsrc for its
+ * source and pushes it only if the slot was not reused meanwhile
+ * (shm_ring_slot_valid() after the copy), so a frame the writer overwrote
+ * is dropped, never inferred on. The buffers are stamped with their
+ * running time, and after the analytics muxer the serialized fields are
+ * restored onto the frame meta with the same buf_pts.
+ *
+ * Either side can be restarted on its own: the writer never waits for
+ * readers, and a reader whose producer died waits for the ring to be
+ * created again. */
+
+#define FRAME_IPC_MAGIC 0x43504946u /* "FIPC" in ring user[0] */
+#define FRAME_IPC_MAX_SOURCES 64
+
+typedef struct {
+    guint32 source_id;
+    gint32 frame_num;
+    guint64 buf_pts;
+    guint64 ntp_timestamp;
+    guint32 source_frame_width;
+    guint32 source_frame_height;
+    /* NV12 planes, from the start of the payload */
+    guint32 offset;
+    guint32 size;
+} FrameIpcFrame;
+
+typedef struct {
+    guint32 num_frames;
+    guint32 reserved;
+    FrameIpcFrame frames[FRAME_IPC_MAX_SOURCES];
+} FrameIpcBatch;
+
+typedef struct _FrameIpcWriter FrameIpcWriter;
+typedef struct _FrameIpcReader FrameIpcReader;
+
+/* Bytes of one NV12 frame of the given size as laid out in a slot. */
+static inline guint frame_ipc_frame_size(guint width, guint height) {
+    guint stride = GST_ROUND_UP_4(width), rows = GST_ROUND_UP_2(height);
+
+    /* luma plus interleaved chroma at half height */
+    return stride * rows + stride * rows / 2;
+}
+
+/* Creates the ring /dev/shm/<name> for batches of up to `max_sources`
+ * frames of width x height (the muxer output size). */
+FrameIpcWriter *frame_ipc_writer_new(const gchar *name, guint max_sources, guint width, guint height,
+                                     guint num_slots, GError **error);
+
+/* Publishes every batch reaching the sink pad of `sink`. The muxer must
+ * output CPU-mappable memory (NVBUF_MEM_CUDA_UNIFIED on dGPU). */
+void frame_ipc_writer_attach(FrameIpcWriter *writer, GstElement *sink);
+
+void frame_ipc_writer_free(FrameIpcWriter *writer);
+
+/* Maps the ring /dev/shm/<name>, waiting for the ingest process to
+ * create it. */
+FrameIpcReader *frame_ipc_reader_new(const gchar *name, GError **error);
+
+/* Geometry published by the writer. */
+guint frame_ipc_reader_num_sources(FrameIpcReader *reader);
+guint frame_ipc_reader_width(FrameIpcReader *reader);
+guint frame_ipc_reader_height(FrameIpcReader *reader);
+
+/* Bin for source `source_id` exposing a "src" pad of NVMM NV12 frames,
+ * ready to be linked to an nvstreammux request pad. */
+GstElement *frame_ipc_reader_make_source(FrameIpcReader *reader, guint source_id);
+
+/* Restores the serialized frame meta on batches leaving `streammux` and
+ * starts the thread feeding the sources. */
+void frame_ipc_reader_start(FrameIpcReader *reader, GstElement *streammux);
+
+void frame_ipc_reader_free(FrameIpcReader *reader);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,309 @@
+/* Transport cost of splitting ingest and analytics (frame_ipc.h): moves
+ * synthetic NV12 batches from a producer to a consumer, once within one
+ * process and once through the shared-memory ring between two, e.g.
+ *
+ *   ./frame_ipc_bench_ --sources 4 --size 1920x1080 --fps 30 --duration 10
+ *
+ * In one process the muxer hands its batch downstream by reference, so
+ * the single-process run passes a pointer through a bounded queue of
+ * --slots batches. The split run forks an ingest-like producer copying
+ * every frame into a ring slot as FrameIpcWriter does, while the consumer
+ * copies every frame out and checks the slot afterwards as FrameIpcReader
+ * does. Both report batches and frames per second, batches lost to
+ * overwrites, frames torn while being copied and the publish-to-consumed
+ * latency (p50/p99/max) per frame. --fps 0 produces as fast as possible,
+ * the throughput ceiling of each transport. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "frame_ipc.h"
+
+/* the slot layout of frame_ipc.c */
+#define SLOT_ALIGN 64
+#define ALIGN_UP(x) (((x) + SLOT_ALIGN - 1) & ~(guint) (SLOT_ALIGN - 1))
+#define BENCH_SHM "frame-ipc-bench"
+
+static gint opt_sources = 4;
+static gchar *opt_size = NULL;
+static gint opt_fps = 30;
+static gint opt_duration = 10;
+static gint opt_slots = 4;
+
+static GOptionEntry entries[] = {
+        {"sources", 'n', 0, G_OPTION_ARG_INT, &opt_sources, "Frames per batch (default 4)", "N"},
+        {"size", 's', 0, G_OPTION_ARG_STRING, &opt_size, "Frame size (default 1920x1080)", "WIDTHxHEIGHT"},
+        {"fps", 'f', 0, G_OPTION_ARG_INT, &opt_fps, "Batches per second, 0 as fast as possible (default 30)", "N"},
+        {"duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration, "Seconds per transport (default 10)", "SEC"},
+        {"slots", 0, 0, G_OPTION_ARG_INT, &opt_slots, "Ring slots, or batches queued in one process (default 4)",
+                "N"},
+        {NULL}
+};
+
+typedef struct {
+    GArray *latencies;          /* ns per consumed frame */
+    guint64 batches;
+    guint64 frames;
+    guint64 lost;
+    guint64 torn;
+    gdouble seconds;
+} BenchResult;
+
+/* A batch passed by reference within one process. */
+typedef struct {
+    guint64 publish_ns;
+    guint num_frames;
+} LocalBatch;
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int sig) {
+    quit = 1;
+}
+
+static gint compare_u64(gconstpointer a, gconstpointer b) {
+    guint64 x = *(const guint64 *) a, y = *(const guint64 *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const gchar *name, BenchResult *result) {
+    guint64 p50 = 0, p99 = 0, max = 0;
+    GArray *latencies = result->latencies;
+
+    if (latencies->len) {
+        g_array_sort(latencies, compare_u64);
+        p50 = g_array_index(latencies, guint64, latencies->len / 2);
+        p99 = g_array_index(latencies, guint64, (guint) (latencies->len * 0.99));
+        max = g_array_index(latencies, guint64, latencies->len - 1);
+    }
+    g_print("%-14s %8.1f batches/s %9.1f frames/s %8" G_GUINT64_FORMAT " lost %8" G_GUINT64_FORMAT
+            " torn   latency p50 %8.1f us p99 %8.1f us max %8.1f us\n", name,
+            result->seconds > 0 ? result->batches / result->seconds : 0.0,
+            result->seconds > 0 ? result->frames / result->seconds : 0.0, result->lost, result->torn,
+            p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+}
+
+/* Sleeps until the next batch is due; --fps 0 does not pace. */
+static void pace(gint64 *next) {
+    gint64 now;
+
+    if (opt_fps <= 0)
+        return;
+    *next += G_USEC_PER_SEC / opt_fps;
+    now = g_get_monotonic_time();
+    if (*next > now)
+        g_usleep((gulong) (*next - now));
+}
+
+/* ---- one process ---- */
+
+typedef struct {
+    GAsyncQueue *free;
+    GAsyncQueue *ready;
+    gint running;
+} LocalQueues;
+
+static gpointer local_producer(gpointer data) {
+    LocalQueues *queues = data;
+    gint64 next = g_get_monotonic_time();
+
+    while (g_atomic_int_get(&queues->running)) {
+        LocalBatch *batch = g_async_queue_timeout_pop(queues->free, 200000);
+        if (!batch)
+            continue;
+        batch->num_frames = (guint) opt_sources;
+        batch->publish_ns = shm_ring_now_ns();
+        g_async_queue_push(queues->ready, batch);
+        pace(&next);
+    }
+    return NULL;
+}
+
+static void run_single(BenchResult *result) {
+    LocalQueues queues;
+    LocalBatch *batches = g_new0(LocalBatch, opt_slots);
+    GThread *producer;
+    gint64 start, end;
+
+    queues.free = g_async_queue_new();
+    queues.ready = g_async_queue_new();
+    queues.running = TRUE;
+    for (gint i = 0; i < opt_slots; i++)
+        g_async_queue_push(queues.free, &batches[i]);
+    producer = g_thread_new("bench-producer", local_producer, &queues);
+    start = g_get_monotonic_time();
+    end = start + (gint64) opt_duration * G_USEC_PER_SEC;
+    while (!quit && g_get_monotonic_time() < end) {
+        LocalBatch *batch = g_async_queue_timeout_pop(queues.ready, 200000);
+        guint64 latency;
+        if (!batch)
+            continue;
+        latency = shm_ring_now_ns() - batch->publish_ns;
+        for (guint i = 0; i < batch->num_frames; i++)
+            g_array_append_val(result->latencies, latency);
+        result->frames += batch->num_frames;
+        result->batches++;
+        g_async_queue_push(queues.free, batch);
+    }
+    result->seconds = (g_get_monotonic_time() - start) / (gdouble) G_USEC_PER_SEC;
+    g_atomic_int_set(&queues.running, FALSE);
+    g_thread_join(producer);
+    g_async_queue_unref(queues.free);
+    g_async_queue_unref(queues.ready);
+    g_free(batches);
+}
+
+/* ---- two processes ---- */
+
+/* Ingest side: every frame copied into the slot, as writer_probe() does
+ * after mapping the muxer output. */
+static void split_producer(guint width, guint height) {
+    guint frame_size = frame_ipc_frame_size(width, height);
+    guint header_size = ALIGN_UP((guint) sizeof(FrameIpcBatch));
+    guint8 *frames = g_malloc((gsize) frame_size * opt_sources);
+    ShmRing *ring = shm_ring_create(BENCH_SHM, (guint) opt_slots,
+                                    header_size + (guint) opt_sources * ALIGN_UP(frame_size), NULL);
+    gint64 next = g_get_monotonic_time();
+
+    if (!ring)
+        _exit(1);
+    for (gint i = 0; i < opt_sources; i++)
+        memset(frames + (gsize) i * frame_size, 16 + i, frame_size);
+    for (gint32 n = 0; !quit; n++) {
+        guint8 *payload = shm_ring_begin_write(ring);
+        FrameIpcBatch *batch = (FrameIpcBatch *) payload;
+        guint offset = header_size;
+        for (gint i = 0; i < opt_sources; i++) {
+            FrameIpcFrame *frame = &batch->frames[i];
+            memset(frame, 0, sizeof(*frame));
+            frame->source_id = (guint32) i;
+            frame->frame_num = n;
+            frame->source_frame_width = width;
+            frame->source_frame_height = height;
+            frame->offset = offset;
+            frame->size = frame_size;
+            memcpy(payload + offset, frames + (gsize) i * frame_size, frame_size);
+            offset += ALIGN_UP(frame_size);
+        }
+        batch->num_frames = (guint32) opt_sources;
+        shm_ring_commit(ring, offset);
+        pace(&next);
+    }
+    shm_ring_close(ring);
+    g_free(frames);
+    _exit(0);
+}
+
+/* Analytics side: every frame copied out and kept only if the slot was
+ * not reused meanwhile, as push_batch() does. */
+static int split_consumer(guint width, guint height, BenchResult *result) {
+    guint frame_size = frame_ipc_frame_size(width, height);
+    GError *error = NULL;
+    ShmRing *ring = NULL;
+    guint8 *copy = g_malloc(frame_size);
+    guint64 seq;
+    gint64 start, end;
+
+    for (gint tries = 0; !ring && tries < 50 && !quit; tries++) {
+        g_clear_error(&error);
+        if (!(ring = shm_ring_open(BENCH_SHM, &error)))
+            g_usleep(100000);
+    }
+    if (!ring) {
+        g_printerr("%s\n", error ? error->message : "interrupted");
+        g_clear_error(&error);
+        g_free(copy);
+        return -1;
+    }
+    seq = shm_ring_header(ring)->write_seq + 1;
+    start = g_get_monotonic_time();
+    end = start + (gint64) opt_duration * G_USEC_PER_SEC;
+    while (!quit && g_get_monotonic_time() < end) {
+        guint64 wanted = seq;
+        const ShmRingSlot *slot = shm_ring_wait(ring, &seq, 200);
+        const FrameIpcBatch *batch;
+        guint payload_size = shm_ring_header(ring)->payload_size, num_frames;
+
+        if (!slot)
+            continue;
+        result->lost += seq - wanted;
+        batch = (const FrameIpcBatch *) slot->payload;
+        num_frames = MIN(batch->num_frames, FRAME_IPC_MAX_SOURCES);
+        for (guint i = 0; i < num_frames; i++) {
+            FrameIpcFrame frame = batch->frames[i];
+            guint64 latency;
+            if (frame.size != frame_size || (guint64) frame.offset + frame.size > payload_size) {
+                result->torn++;
+                continue;
+            }
+            memcpy(copy, slot->payload + frame.offset, frame_size);
+            if (!shm_ring_slot_valid(slot, seq)) {
+                result->torn += num_frames - i;
+                break;
+            }
+            latency = shm_ring_now_ns() - slot->publish_ns;
+            g_array_append_val(result->latencies, latency);
+            result->frames++;
+        }
+        result->batches++;
+        seq++;
+    }
+    result->seconds = (g_get_monotonic_time() - start) / (gdouble) G_USEC_PER_SEC;
+    g_free(copy);
+    shm_ring_close(ring);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("- compare single-process and split frame transport");
+    GError *error = NULL;
+    BenchResult single = {0}, split = {0};
+    gint width = 1920, height = 1080;
+    pid_t producer;
+    int ret;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return -1;
+    }
+    g_option_context_free(ctx);
+    if (opt_size && (sscanf(opt_size, "%dx%d", &width, &height) != 2 || width < 2 || height < 2)) {
+        g_printerr("--size expects WIDTHxHEIGHT\n");
+        return -1;
+    }
+    if (opt_sources < 1 || opt_sources > FRAME_IPC_MAX_SOURCES || opt_slots < 1 || opt_duration < 1) {
+        g_printerr("--sources takes 1..%d, --slots and --duration at least 1\n", FRAME_IPC_MAX_SOURCES);
+        return -1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    g_print("%d x %dx%d NV12 per batch, %d slots, %s\n", opt_sources, width, height, opt_slots,
+            opt_fps > 0 ? "paced" : "unpaced");
+
+    single.latencies = g_array_new(FALSE, FALSE, sizeof(guint64));
+    run_single(&single);
+    report("single-process", &single);
+
+    producer = fork();
+    if (producer == 0)
+        split_producer((guint) width, (guint) height);
+    if (producer < 0) {
+        g_printerr("fork failed\n");
+        g_array_free(single.latencies, TRUE);
+        return -1;
+    }
+    split.latencies = g_array_new(FALSE, FALSE, sizeof(guint64));
+    ret = split_consumer((guint) width, (guint) height, &split);
+    kill(producer, SIGTERM);
+    waitpid(producer, NULL, 0);
+    if (ret == 0)
+        report("split", &split);
+    g_array_free(single.latencies, TRUE);
+    g_array_free(split.latencies, TRUE);
+    return ret;
+}
@@ -0,0 +1,406 @@
+#include <math.h>
+#include <string.h>
+#include "heatmap.h"
+#include "pipeline_metrics.h"
+
+typedef gfloat v4f __attribute__((vector_size(16)));
+
+/* the exporter waits this long for streaming threads to switch deltas */
+#define SWITCH_TIMEOUT_US 500000
+/* a float holds exp() up to about 88; decay exponents are clamped to this */
+#define MAX_EXPONENT 80.0
+/* the streaming thread rescales its delta once the growth exponent reaches
+ * this, so sums of exp(REBASE_EXPONENT) weights stay far from overflow */
+#define REBASE_EXPONENT 20.0
+
+typedef struct {
+    guint width, height;     /* cells */
+    guint stride;            /* width rounded up to whole vectors */
+
+    /* streaming thread */
+    gfloat *delta[2];
+    gint active;
+    gint64 epoch;            /* monotonic time the active delta started */
+    gint64 last_time;
+    gint objects;
+    gint frames;
+
+    /* handshake: the exporter sets switch_requested, the streaming thread
+     * retires the active delta and sets retired */
+    gint switch_requested;
+    gint retired;
+    gint64 retired_start, retired_end;
+
+    /* export thread */
+    gfloat *total;
+    gint64 total_time;       /* monotonic time total is decayed to */
+    gint exported_frames;    /* frames when the last export finished */
+} HeatmapSource;
+
+struct _Heatmap {
+    gchar *dir;
+    guint cell;
+    gdouble tau;             /* seconds, half_life / ln 2 */
+    guint interval;
+    HeatmapSource *sources[HEATMAP_MAX_SOURCES];
+
+    GMutex lock;
+    GCond cond;
+    gboolean stopping;
+    GThread *thread;
+    gint exports;
+    gint export_us;
+};
+
+static guint32 crc_table[256];
+
+static void crc_init(void) {
+    for (guint32 n = 0; n < 256; n++) {
+        guint32 c = n;
+        for (gint k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static guint32 crc32_update(guint32 crc, const guint8 *data, gsize len) {
+    for (gsize i = 0; i < len; i++)
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void append_be32(GByteArray *out, guint32 v) {
+    guint8 b[4] = {(guint8) (v >> 24), (guint8) (v >> 16), (guint8) (v >> 8), (guint8) v};
+    g_byte_array_append(out, b, 4);
+}
+
+static void png_chunk(GByteArray *out, const gchar *type, const guint8 *data, guint32 len) {
+    guint32 crc = 0xffffffffu;
+
+    append_be32(out, len);
+    g_byte_array_append(out, (const guint8 *) type, 4);
+    if (len)
+        g_byte_array_append(out, data, len);
+    crc = crc32_update(crc, (const guint8 *) type, 4);
+    crc = crc32_update(crc, data, len);
+    append_be32(out, crc ^ 0xffffffffu);
+}
+
+/* RGB PNG with an uncompressed (stored) deflate stream; heatmaps are small
+ * and this avoids a zlib dependency. */
+static GByteArray *encode_png(const guint8 *rgb, guint width, guint height) {
+    static const guint8 signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    GByteArray *out = g_byte_array_new();
+    GByteArray *raw = g_byte_array_new();
+    GByteArray *zlib = g_byte_array_new();
+    guint8 ihdr[13] = {0};
+    guint32 a = 1, b = 0;
+    static const guint8 zlib_header[2] = {0x78, 0x01};
+
+    g_byte_array_append(out, signature, 8);
+    ihdr[0] = (guint8) (width >> 24);
+    ihdr[1] = (guint8) (width >> 16);
+    ihdr[2] = (guint8) (width >> 8);
+    ihdr[3] = (guint8) width;
+    ihdr[4] = (guint8) (height >> 24);
+    ihdr[5] = (guint8) (height >> 16);
+    ihdr[6] = (guint8) (height >> 8);
+    ihdr[7] = (guint8) height;
+    ihdr[8] = 8;   /* bit depth */
+    ihdr[9] = 2;   /* truecolor */
+    png_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+    for (guint y = 0; y < height; y++) {
+        static const guint8 filter_none = 0;
+        g_byte_array_append(raw, &filter_none, 1);
+        g_byte_array_append(raw, rgb + (gsize) y * width * 3, width * 3);
+    }
+    g_byte_array_append(zlib, zlib_header, 2);
+    for (guint off = 0, len; off < raw->len; off += len) {
+        len = MIN(raw->len - off, 65535u);
+        guint8 head[5] = {off + len == raw->len, (guint8) len, (guint8) (len >> 8),
+                          (guint8) ~len, (guint8) (~len >> 8)};
+        g_byte_array_append(zlib, head, 5);
+        g_byte_array_append(zlib, raw->data + off, len);
+    }
+    for (guint i = 0; i < raw->len; i++) {
+        a = (a + raw->data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_be32(zlib, (b << 16) | a);
+    png_chunk(out, "IDAT", zlib->data, zlib->len);
+    png_chunk(out, "IEND", NULL, 0);
+
+    g_byte_array_free(raw, TRUE);
+    g_byte_array_free(zlib, TRUE);
+    return out;
+}
+
+static HeatmapSource *get_source(Heatmap *heatmap, const NvDsFrameMeta *frame_meta, const MuxScaling *scaling) {
+    guint id = frame_meta->source_id;
+    HeatmapSource *src;
+    gint extent_x, extent_y;
+
+    if (id >= HEATMAP_MAX_SOURCES)
+        return NULL;
+    src = heatmap->sources[id];
+    if (src || !frame_meta->source_frame_width || !frame_meta->source_frame_height)
+        return src;
+    /* the grid covers the full frame, crops included */
+    extent_x = (gint) frame_meta->source_frame_width + (id < MUX_SCALING_MAX_SOURCES ? scaling->origin_x[id] : 0);
+    extent_y = (gint) frame_meta->source_frame_height + (id < MUX_SCALING_MAX_SOURCES ? scaling->origin_y[id] : 0);
+    src = g_new0(HeatmapSource, 1);
+    src->width = ((guint) extent_x + heatmap->cell - 1) / heatmap->cell;
+    src->height = ((guint) extent_y + heatmap->cell - 1) / heatmap->cell;
+    src->stride = GST_ROUND_UP_4(src->width);
+    src->delta[0] = g_new0(gfloat, (gsize) src->stride * src->height);
+    src->delta[1] = g_new0(gfloat, (gsize) src->stride * src->height);
+    src->total = g_new0(gfloat, (gsize) src->stride * src->height);
+    src->epoch = g_get_monotonic_time();
+    src->total_time = src->epoch;
+    g_atomic_pointer_set(&heatmap->sources[id], src);
+    return src;
+}
+
+/* Moves the delta's epoch forward by `exponent` time constants. */
+static void rebase_delta(HeatmapSource *src, gfloat *delta, gdouble exponent) {
+    gfloat scale_1 = (gfloat) exp(-MIN(exponent, MAX_EXPONENT));
+    v4f scale = {scale_1, scale_1, scale_1, scale_1}, *d = (v4f *) delta;
+    gsize vectors = (gsize) src->stride * src->height / 4;
+
+    for (gsize i = 0; i < vectors; i++)
+        d[i] = d[i] * scale;
+}
+
+void heatmap_add_batch(Heatmap *heatmap, NvDsBatchMeta *batch_meta, const MuxScaling *scaling) {
+    gint64 now = g_get_monotonic_time();
+    NvDsMetaList *l_frame, *l_obj;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        HeatmapSource *src = get_source(heatmap, frame_meta, scaling);
+        gfloat weight, *delta;
+        gdouble exponent;
+        gint n = 0;
+
+        if (!src)
+            continue;
+        if (g_atomic_int_get(&src->switch_requested)) {
+            src->retired_start = src->epoch;
+            src->retired_end = now;
+            src->active ^= 1;
+            src->epoch = now;
+            g_atomic_int_set(&src->switch_requested, 0);
+            g_atomic_int_set(&src->retired, 1);
+        }
+        delta = src->delta[src->active];
+        exponent = (now - src->epoch) / (heatmap->tau * G_USEC_PER_SEC);
+        if (exponent >= REBASE_EXPONENT) {
+            rebase_delta(src, delta, exponent);
+            src->epoch = now;
+            exponent = 0;
+        }
+        /* older detections decay relative to this one */
+        weight = (gfloat) exp(exponent);
+        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+            NvOSD_RectParams rect;
+            gint cx, cy;
+            mux_scaling_rect_to_source(scaling, frame_meta, &obj_meta->rect_params, &rect);
+            cx = (gint) ((rect.left + rect.width * 0.5f) / heatmap->cell);
+            cy = (gint) ((rect.top + rect.height) / heatmap->cell);
+            /* boxes touching the bottom edge land just outside */
+            cy = MIN(cy, (gint) src->height - 1);
+            if (cx < 0 || cy < 0 || cx >= (gint) src->width)
+                continue;
+            delta[cy * src->stride + cx] += weight;
+            n++;
+        }
+        src->last_time = now;
+        g_atomic_int_inc(&src->frames);
+        if (n)
+            g_atomic_int_add(&src->objects, n);
+    }
+}
+
+/* total = total * decay + delta * scale, then clears delta. */
+static void fold_delta(Heatmap *heatmap, HeatmapSource *src, gfloat *delta, gint64 start, gint64 end) {
+    gdouble tau_us = heatmap->tau * G_USEC_PER_SEC;
+    v4f decay, scale, *t = (v4f *) src->total, *d = (v4f *) delta;
+    gfloat decay_1 = (gfloat) exp(-MIN((end - src->total_time) / tau_us, MAX_EXPONENT));
+    gfloat scale_1 = (gfloat) exp(-MIN((end - start) / tau_us, MAX_EXPONENT));
+    gsize vectors = (gsize) src->stride * src->height / 4;
+
+    if (end < src->total_time)
+        return;
+    decay = (v4f) {decay_1, decay_1, decay_1, decay_1};
+    scale = (v4f) {scale_1, scale_1, scale_1, scale_1};
+    for (gsize i = 0; i < vectors; i++) {
+        t[i] = t[i] * decay + d[i] * scale;
+        d[i] = (v4f) {0, 0, 0, 0};
+    }
+    src->total_time = end;
+}
+
+static void write_file(const gchar *path, const gchar *data, gsize len) {
+    GError *error = NULL;
+
+    if (!g_file_set_contents(path, data, (gssize) len, &error)) {
+        g_printerr("heatmap: %s\n", error->message);
+        g_error_free(error);
+    }
+}
+
+static void export_source(Heatmap *heatmap, guint id, HeatmapSource *src) {
+    HeatmapRawHeader header = {HEATMAP_RAW_MAGIC, src->width, src->height, heatmap->cell, 0};
+    GByteArray *raw = g_byte_array_new();
+    GByteArray *png;
+    guint8 *rgb = g_new(guint8, (gsize) src->width * src->height * 3);
+    gfloat max = 0;
+    gchar *path;
+
+    header.time = g_get_real_time() - (g_get_monotonic_time() - src->total_time);
+    g_byte_array_append(raw, (const guint8 *) &header, sizeof(header));
+    for (guint y = 0; y < src->height; y++) {
+        const gfloat *row = src->total + (gsize) y * src->stride;
+        g_byte_array_append(raw, (const guint8 *) row, src->width * sizeof(gfloat));
+        for (guint x = 0; x < src->width; x++)
+            max = MAX(max, row[x]);
+    }
+    /* black -> red -> yellow -> white */
+    for (guint y = 0; y < src->height; y++)
+        for (guint x = 0; x < src->width; x++) {
+            gfloat v = max > 0 ? src->total[(gsize) y * src->stride + x] / max * 3.0f : 0.0f;
+            guint8 *p = rgb + ((gsize) y * src->width + x) * 3;
+            p[0] = (guint8) (CLAMP(v, 0.0f, 1.0f) * 255);
+            p[1] = (guint8) (CLAMP(v - 1.0f, 0.0f, 1.0f) * 255);
+            p[2] = (guint8) (CLAMP(v - 2.0f, 0.0f, 1.0f) * 255);
+        }
+    png = encode_png(rgb, src->width, src->height);
+
+    path = g_strdup_printf("%s/source%u.raw", heatmap->dir, id);
+    write_file(path, (const gchar *) raw->data, raw->len);
+    g_free(path);
+    path = g_strdup_printf("%s/source%u.png", heatmap->dir, id);
+    write_file(path, (const gchar *) png->data, png->len);
+    g_free(path);
+
+    g_byte_array_free(raw, TRUE);
+    g_byte_array_free(png, TRUE);
+    g_free(rgb);
+}
+
+/* Called with heatmap->lock held. When `final` is set the pipeline has
+ * stopped and the active deltas are folded directly. Sources without a
+ * frame since the last export are not asked to switch: nothing would
+ * answer, and their active delta waits for their next frame or the final
+ * export. */
+static void export_all(Heatmap *heatmap, gboolean final) {
+    gint64 start = g_get_monotonic_time(), deadline = start + SWITCH_TIMEOUT_US;
+    HeatmapSource *sources[HEATMAP_MAX_SOURCES];
+    gboolean requested[HEATMAP_MAX_SOURCES] = {FALSE};
+
+    for (guint i = 0; i < HEATMAP_MAX_SOURCES; i++) {
+        sources[i] = g_atomic_pointer_get(&heatmap->sources[i]);
+        if (!sources[i] || final || g_atomic_int_get(&sources[i]->frames) == sources[i]->exported_frames)
+            continue;
+        /* a delta retired after the last timeout is folded first */
+        if (!g_atomic_int_get(&sources[i]->retired)) {
+            g_atomic_int_set(&sources[i]->switch_requested, 1);
+            requested[i] = TRUE;
+        }
+    }
+    /* streaming threads switch on their next frame of the source */
+    for (guint i = 0; i < HEATMAP_MAX_SOURCES; i++) {
+        while (requested[i] && !g_atomic_int_get(&sources[i]->retired) && g_get_monotonic_time() < deadline) {
+            g_mutex_unlock(&heatmap->lock);
+            g_usleep(10000);
+            g_mutex_lock(&heatmap->lock);
+        }
+    }
+    for (guint i = 0; i < HEATMAP_MAX_SOURCES; i++) {
+        HeatmapSource *src = sources[i];
+        if (!src)
+            continue;
+        if (g_atomic_int_get(&src->retired)) {
+            fold_delta(heatmap, src, src->delta[src->active ^ 1], src->retired_start, src->retired_end);
+            g_atomic_int_set(&src->retired, 0);
+        }
+        if (final)
+            fold_delta(heatmap, src, src->delta[src->active], src->epoch, MAX(src->last_time, src->epoch));
+        src->exported_frames = g_atomic_int_get(&src->frames);
+        export_source(heatmap, i, src);
+    }
+    g_atomic_int_inc(&heatmap->exports);
+    g_atomic_int_set(&heatmap->export_us, (gint) (g_get_monotonic_time() - start));
+}
+
+static gpointer export_thread(gpointer data) {
+    Heatmap *heatmap = data;
+
+    g_mutex_lock(&heatmap->lock);
+    while (!heatmap->stopping) {
+        gint64 deadline = g_get_monotonic_time() + (gint64) heatmap->interval * G_USEC_PER_SEC;
+        while (!heatmap->stopping && g_cond_wait_until(&heatmap->cond, &heatmap->lock, deadline));
+        export_all(heatmap, heatmap->stopping);
+    }
+    g_mutex_unlock(&heatmap->lock);
+    return NULL;
+}
+
+static void collect_heatmap_metrics(GString *out, gpointer user_data) {
+    Heatmap *heatmap = user_data;
+
+    for (guint i = 0; i < HEATMAP_MAX_SOURCES; i++) {
+        HeatmapSource *src = g_atomic_pointer_get(&heatmap->sources[i]);
+        if (src)
+            g_string_append_printf(out, "ds_heatmap_objects_total{source=\"%u\"} %d\n",
+                                   i, g_atomic_int_get(&src->objects));
+    }
+    g_string_append_printf(out, "ds_heatmap_exports_total %d\n", g_atomic_int_get(&heatmap->exports));
+    g_string_append_printf(out, "ds_heatmap_export_ms %.3f\n", g_atomic_int_get(&heatmap->export_us) / 1000.0);
+}
+
+Heatmap *heatmap_new(const gchar *dir, guint cell, gdouble half_life, guint interval) {
+    Heatmap *heatmap;
+
+    if (g_mkdir_with_parents(dir, 0755) != 0) {
+        g_printerr("heatmap: cannot create %s\n", dir);
+        return NULL;
+    }
+    crc_init();
+    heatmap = g_new0(Heatmap, 1);
+    heatmap->dir = g_strdup(dir);
+    heatmap->cell = MAX(cell, 1);
+    heatmap->tau = MAX(half_life, 0.001) / G_LN2;
+    heatmap->interval = MAX(interval, 1);
+    g_mutex_init(&heatmap->lock);
+    g_cond_init(&heatmap->cond);
+    heatmap->thread = g_thread_new("heatmap", export_thread, heatmap);
+    metrics_register("heatmap", collect_heatmap_metrics, heatmap);
+    return heatmap;
+}
+
+void heatmap_free(Heatmap *heatmap) {
+    if (!heatmap)
+        return;
+    metrics_unregister("heatmap");
+    g_mutex_lock(&heatmap->lock);
+    heatmap->stopping = TRUE;
+    g_cond_signal(&heatmap->cond);
+    g_mutex_unlock(&heatmap->lock);
+    g_thread_join(heatmap->thread);
+    for (guint i = 0; i < HEATMAP_MAX_SOURCES; i++) {
+        HeatmapSource *src = heatmap->sources[i];
+        if (!src)
+            continue;
+        g_free(src->delta[0]);
+        g_free(src->delta[1]);
+        g_free(src->total);
+        g_free(src);
+    }
+    g_cond_clear(&heatmap->cond);
+    g_mutex_clear(&heatmap->lock);
+    g_free(heatmap->dir);
+    g_free(heatmap);
+}
@@ -0,0 +1,55 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+#include "mux_scaling.h"
+
+G_BEGIN_DECLS
+
+/* Dwell heatmaps: the bottom-center anchors of all objects, accumulated
+ * per source into a grid of `cell` x `cell` source pixel cells with
+ * exponential decay (a detection's weight halves every `half_life`
+ * seconds).
+ *
+ * The streaming thread does not decay the grid per frame. It adds to a
+ * delta grid with a weight growing as exp(t / tau) since the delta was
+ * started, which is the same as decaying everything else, so a frame costs
+ * one add per object; only every few tens of tau does it rescale the delta
+ * to keep the weights finite. Every source has two delta grids; the export
+ * thread asks the streaming thread to switch to the other one, folds the
+ * retired delta into the decayed total with vector arithmetic and writes
+ * per source
+ *
+ *   DIR/source<N>.png   8-bit heat colored image, scaled to the maximum
+ *   DIR/source<N>.raw   HeatmapRawHeader followed by the float cells
+ *
+ * both atomically replaced, every `interval` seconds. A source without a
+ * frame since the last export is not asked to switch, so a stopped source
+ * never delays the export. */
+
+#define HEATMAP_MAX_SOURCES 64
+#define HEATMAP_RAW_MAGIC 0x4d485344u /* "DSHM" */
+
+typedef struct {
+    guint32 magic;
+    guint32 width;       /* cells */
+    guint32 height;
+    guint32 cell;        /* source pixels per cell */
+    gint64 time;         /* unix microseconds the values were decayed to */
+} HeatmapRawHeader;
+
+typedef struct _Heatmap Heatmap;
+
+/* Starts the export thread writing into `dir`. */
+Heatmap *heatmap_new(const gchar *dir, guint cell, gdouble half_life, guint interval);
+
+/* Accumulates the objects of a batch; call on the pgie src pad. */
+void heatmap_add_batch(Heatmap *heatmap, NvDsBatchMeta *batch_meta, const MuxScaling *scaling);
+
+/* Folds what was accumulated, writes the last snapshots and stops. */
+void heatmap_free(Heatmap *heatmap);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "infer_standby.h"
+#include "async_log.h"
+#include "pipeline_metrics.h"
+
+struct _InferStandby {
+    PipelineGraph *graph;
+    const PipelineDesc *desc;
+    InferStandbyBranchFunc prepare;
+    gpointer user_data;
+    GstPad *merge_pad;          /* input-selector src, sees the first buffer after a switch */
+    gulong probe_id;
+    gint switching;             /* atomic, the probe's fast path */
+
+    GMutex lock;                /* everything below */
+    PipelineBranch active;
+    PipelineBranch standby;     /* bin NULL while none is ready */
+    PipelineBranch failed;      /* until the rebuild thread has taken it down */
+    GstElement *building;       /* bin of the branch loading in the rebuild thread */
+    GThread *rebuild_thread;
+    guint next_branch;          /* names the branches built later */
+    gint64 failed_at;
+    guint64 failovers;
+    guint64 rebuild_failures;
+    gint64 failover_us;         /* of the last failover */
+    gint64 rebuild_us;
+};
+
+static void collect_standby_metrics(GString *out, gpointer user_data) {
+    InferStandby *sb = user_data;
+
+    g_mutex_lock(&sb->lock);
+    g_string_append_printf(out, "ds_standby_ready %d\n", sb->standby.bin != NULL);
+    g_string_append_printf(out, "ds_standby_failovers_total %" G_GUINT64_FORMAT "\n", sb->failovers);
+    g_string_append_printf(out, "ds_standby_rebuild_failures_total %" G_GUINT64_FORMAT "\n", sb->rebuild_failures);
+    if (sb->failovers) {
+        g_string_append_printf(out, "ds_standby_failover_ms %.1f\n", sb->failover_us / 1000.0);
+        g_string_append_printf(out, "ds_standby_rebuild_ms %.1f\n", sb->rebuild_us / 1000.0);
+    }
+    g_mutex_unlock(&sb->lock);
+}
+
+static GstPadProbeReturn first_buffer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    InferStandby *sb = user_data;
+
+    if (!g_atomic_int_get(&sb->switching))
+        return GST_PAD_PROBE_OK;
+    g_mutex_lock(&sb->lock);
+    if (sb->failed_at) {
+        sb->failover_us = g_get_monotonic_time() - sb->failed_at;
+        sb->failed_at = 0;
+        nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "Failed over to %s, first batch after %.1f ms",
+                 GST_OBJECT_NAME (sb->active.bin), sb->failover_us / 1000.0);
+    }
+    g_atomic_int_set(&sb->switching, 0);
+    g_mutex_unlock(&sb->lock);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Takes the failed branch down, then builds and loads its replacement. */
+static gpointer rebuild(gpointer data) {
+    InferStandby *sb = data;
+    PipelineBranch failed, fresh;
+    GError *error = NULL;
+    gchar name[32];
+    gint64 start = g_get_monotonic_time();
+    guint batch_size;
+    gboolean ok;
+
+    g_mutex_lock(&sb->lock);
+    failed = sb->failed;
+    batch_size = failed.batch_size;
+    g_snprintf(name, sizeof(name), "infer-branch-%u", sb->next_branch++);
+    g_mutex_unlock(&sb->lock);
+
+    /* frees its engine before the new one allocates */
+    pipeline_branch_detach(sb->graph, &failed);
+    g_mutex_lock(&sb->lock);
+    memset(&sb->failed, 0, sizeof(sb->failed));
+    g_mutex_unlock(&sb->lock);
+
+    ok = pipeline_branch_build(&fresh, sb->desc, name, batch_size, NULL, &error);
+    if (ok) {
+        if (sb->prepare)
+            sb->prepare(&fresh, sb->user_data);
+        ok = pipeline_branch_attach(sb->graph, &fresh);
+        if (!ok) {
+            g_set_error(&error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION, "%s could not be linked", name);
+            pipeline_branch_detach(sb->graph, &fresh);
+        }
+    }
+    /* loads the engine; the branch idles in PLAYING */
+    if (ok) {
+        g_mutex_lock(&sb->lock);
+        sb->building = fresh.bin;
+        g_mutex_unlock(&sb->lock);
+        if (gst_element_sync_state_with_parent(fresh.bin) == FALSE) {
+            g_set_error(&error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE, "%s could not be started", name);
+            pipeline_branch_detach(sb->graph, &fresh);
+            ok = FALSE;
+        }
+    }
+
+    g_mutex_lock(&sb->lock);
+    sb->building = NULL;
+    sb->rebuild_us = g_get_monotonic_time() - start;
+    if (ok)
+        sb->standby = fresh;
+    else
+        sb->rebuild_failures++;
+    g_mutex_unlock(&sb->lock);
+    if (ok)
+        nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "%s on standby after %.0f ms", name, sb->rebuild_us / 1000.0);
+    else
+        nvds_log(DSLOG_CAT_APP, LOG_ERR, "No standby, rebuild failed: %s", error->message);
+    g_clear_error(&error);
+    return NULL;
+}
+
+/* With the lock held; `failed` is the active or the standby branch. */
+static void start_rebuild(InferStandby *sb, PipelineBranch *failed) {
+    sb->failed = *failed;
+    memset(failed, 0, sizeof(*failed));
+    /* the previous rebuild is done, joining only reaps it */
+    if (sb->rebuild_thread)
+        g_thread_join(sb->rebuild_thread);
+    sb->rebuild_thread = g_thread_new("standby-rebuild", rebuild, sb);
+}
+
+InferStandby *infer_standby_new(PipelineGraph *graph, const PipelineDesc *desc,
+                                InferStandbyBranchFunc prepare, gpointer user_data) {
+    InferStandby *sb = g_new0(InferStandby, 1);
+
+    sb->graph = graph;
+    sb->desc = desc;
+    sb->prepare = prepare;
+    sb->user_data = user_data;
+    g_mutex_init(&sb->lock);
+    sb->active = graph->branches[0];
+    sb->standby = graph->branches[1];
+    sb->next_branch = graph->num_branches;
+    sb->merge_pad = gst_element_get_static_pad(graph->branch_merge, "src");
+    sb->probe_id = gst_pad_add_probe(sb->merge_pad, GST_PAD_PROBE_TYPE_BUFFER, first_buffer_probe, sb, NULL);
+    metrics_register("standby", collect_standby_metrics, sb);
+    return sb;
+}
+
+GstBusSyncReply infer_standby_handle_sync_message(InferStandby *sb, GstMessage *msg) {
+    GstObject *src = GST_MESSAGE_SRC (msg);
+    GstBusSyncReply reply = GST_BUS_DROP;
+    GError *error;
+    gchar *debug;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ERROR)
+        return GST_BUS_PASS;
+
+    g_mutex_lock(&sb->lock);
+    if ((sb->failed.bin && gst_object_has_as_ancestor(src, GST_OBJECT (sb->failed.bin)))
+        || (sb->building && gst_object_has_as_ancestor(src, GST_OBJECT (sb->building)))) {
+        /* the rest of a failure already handled (the queue's flow error),
+         * or a rebuild that is going to fail */
+    } else if (sb->active.bin && gst_object_has_as_ancestor(src, GST_OBJECT (sb->active.bin))) {
+        if (sb->standby.bin) {
+            PipelineBranch failed = sb->active;
+            sb->active = sb->standby;
+            memset(&sb->standby, 0, sizeof(sb->standby));
+            sb->failed_at = g_get_monotonic_time();
+            sb->failovers++;
+            g_atomic_int_set(&sb->switching, 1);
+            pipeline_branch_select(sb->graph, &sb->active);
+            gst_message_parse_error(msg, &error, &debug);
+            nvds_log(DSLOG_CAT_APP, LOG_ERR, "ERROR from element %s: %s, failing over from %s to %s",
+                     GST_OBJECT_NAME (src), error->message, GST_OBJECT_NAME (failed.bin),
+                     GST_OBJECT_NAME (sb->active.bin));
+            g_free(debug);
+            g_error_free(error);
+            start_rebuild(sb, &failed);
+        } else {
+            reply = GST_BUS_PASS;
+        }
+    } else if (sb->standby.bin && gst_object_has_as_ancestor(src, GST_OBJECT (sb->standby.bin))) {
+        nvds_log(DSLOG_CAT_APP, LOG_WARNING, "Standby %s failed, rebuilding it", GST_OBJECT_NAME (sb->standby.bin));
+        start_rebuild(sb, &sb->standby);
+    } else {
+        reply = GST_BUS_PASS;
+    }
+    g_mutex_unlock(&sb->lock);
+    return reply;
+}
+
+/* Fails the next batch reaching the pgie the way a broken engine would:
+ * the element posts an error and GST_FLOW_ERROR goes back to the branch
+ * queue, from there to the output-selector and the muxer unless the switch
+ * wins. One-shot. */
+static GstPadProbeReturn inject_error_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstElement *pgie = gst_pad_get_parent_element(pad);
+
+    gst_pad_remove_probe(pad, info->id);
+    GST_ELEMENT_ERROR (pgie, STREAM, FAILED, ("Injected failure"), ("--inject-error"));
+    gst_object_unref(pgie);
+    gst_buffer_unref(GST_PAD_PROBE_INFO_BUFFER (info));
+    GST_PAD_PROBE_INFO_FLOW_RETURN (info) = GST_FLOW_ERROR;
+    return GST_PAD_PROBE_HANDLED;
+}
+
+gboolean infer_standby_inject_error(InferStandby *sb) {
+    GstPad *pad = NULL;
+
+    g_mutex_lock(&sb->lock);
+    if (sb->standby.bin)
+        pad = gst_element_get_static_pad(sb->active.pgie, "sink");
+    g_mutex_unlock(&sb->lock);
+    if (!pad)
+        return FALSE;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, inject_error_probe, NULL, NULL);
+    gst_object_unref(pad);
+    return TRUE;
+}
+
+void infer_standby_free(InferStandby *sb) {
+    GThread *thread;
+
+    if (!sb)
+        return;
+    metrics_unregister("standby");
+    g_mutex_lock(&sb->lock);
+    thread = sb->rebuild_thread;
+    sb->rebuild_thread = NULL;
+    g_mutex_unlock(&sb->lock);
+    if (thread)
+        g_thread_join(thread);
+    gst_pad_remove_probe(sb->merge_pad, sb->probe_id);
+    gst_object_unref(sb->merge_pad);
+    g_mutex_clear(&sb->lock);
+    g_free(sb);
+}
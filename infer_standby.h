@@ -0,0 +1,53 @@
+#ifndef INFER_STANDBY_H
+#define INFER_STANDBY_H
+
+#include <gst/gst.h>
+#include "pipeline_builder.h"
+
+G_BEGIN_DECLS
+
+/* Warm standby for the inference chain.
+ *
+ * A pipeline built with desc->standby carries two inference branches, both
+ * with their engine loaded; the muxer feeds only the active one. When an
+ * element of the active branch posts an error, the sync handler switches
+ * both selectors to the standby in the thread that posted it, before the
+ * flow error gets back to the muxer, and drops the message so the app keeps
+ * running. A thread then takes the failed branch down and builds and loads
+ * a fresh one, which becomes the next standby. While it loads a second
+ * failure cannot be caught and ends the app as before.
+ *
+ * Failover time is from the error to the first buffer out of the new
+ * branch; it and the rebuild time are published via pipeline_metrics:
+ *
+ *   ds_standby_ready
+ *   ds_standby_failovers_total
+ *   ds_standby_failover_ms
+ *   ds_standby_rebuild_ms
+ *   ds_standby_rebuild_failures_total */
+
+typedef struct _InferStandby InferStandby;
+
+/* Called for every branch built after startup, before it is added to the
+ * pipeline, to attach probes like those on the initial branches. */
+typedef void (*InferStandbyBranchFunc)(PipelineBranch *branch, gpointer user_data);
+
+/* `graph` and `desc` must outlive the standby. */
+InferStandby *infer_standby_new(PipelineGraph *graph, const PipelineDesc *desc,
+                                InferStandbyBranchFunc prepare, gpointer user_data);
+
+/* Call from the bus sync handler; returns GST_BUS_DROP for errors it
+ * recovered from. */
+GstBusSyncReply infer_standby_handle_sync_message(InferStandby *sb, GstMessage *msg);
+
+/* Makes the active pgie fail its next batch, posting an error and
+ * returning GST_FLOW_ERROR upstream, to exercise a failover. Returns
+ * FALSE, injecting nothing, while there is no standby to take over. */
+gboolean infer_standby_inject_error(InferStandby *sb);
+
+/* Waits for a rebuild in progress; call before the pipeline goes to NULL. */
+void infer_standby_free(InferStandby *sb);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <string.h>
+#include "line_zone.h"
+#include "pipeline_metrics.h"
+
+#define DEFAULT_TRACK_TIMEOUT 30
+/* side of the square cells of the zone index, in source pixels */
+#define GRID_CELL 32
+
+typedef struct {
+    gchar *name;
+    gfloat ax, ay, bx, by;
+    guint64 crossings[2]; /* entry, exit */
+} Line;
+
+typedef struct {
+    gchar *name;
+    guint num_vertices;
+    gfloat *vx;
+    gfloat *vy;
+    gint occupancy;
+    guint64 events[2]; /* entry, exit */
+} Zone;
+
+typedef struct {
+    guint num_lines;
+    guint num_zones;
+    Line lines[LINE_ZONE_MAX_SHAPES];
+    Zone zones[LINE_ZONE_MAX_SHAPES];
+    /* per GRID_CELL cell, the zones whose bounding box overlaps it; an
+     * anchor only needs the polygon tests of its cell's zones */
+    guint grid_width, grid_height;
+    guint64 *grid;
+    gint frame_num;
+} LineZoneSource;
+
+/* 32 bytes, two tracks per cache line */
+typedef struct {
+    guint64 object_id;
+    guint32 source;      /* source_id + 1, 0 for a free slot */
+    gint32 last_frame;
+    gfloat x, y;         /* anchor in source pixels */
+    guint64 zones;       /* bit z set while inside zone z */
+} Track;
+
+struct _LineZones {
+    LineZoneSource *sources[LINE_ZONE_MAX_SOURCES];
+    gint track_timeout;
+
+    /* open addressing with linear probing, keyed by (source, object id) */
+    Track *tracks;
+    guint capacity;
+    guint num_tracks;
+    guint sweep;
+
+    /* scratch space reused per frame (single streaming thread) */
+    guint scratch_size;
+    gfloat *xs, *ys;
+    guint64 *ids;
+    NvDsObjectMeta **objs;
+
+    /* counters, shared with the metrics thread */
+    GMutex lock;
+    guint64 batches;
+    gint64 total_us;
+};
+
+static void line_zone_source_free(LineZoneSource *src) {
+    if (!src)
+        return;
+    for (guint i = 0; i < src->num_lines; i++)
+        g_free(src->lines[i].name);
+    for (guint i = 0; i < src->num_zones; i++) {
+        g_free(src->zones[i].name);
+        g_free(src->zones[i].vx);
+        g_free(src->zones[i].vy);
+    }
+    g_free(src->grid);
+    g_free(src);
+}
+
+/* Parses "x,y;x,y;..." into newly allocated vertex arrays; coordinates
+ * are source pixels, so never negative. */
+static guint parse_points(const gchar *text, gfloat **vx, gfloat **vy) {
+    gchar **points = g_strsplit(text, ";", -1);
+    guint n = g_strv_length(points), valid = 0;
+
+    *vx = g_new0(gfloat, MAX(n, 1));
+    *vy = g_new0(gfloat, MAX(n, 1));
+    for (guint i = 0; i < n; i++) {
+        gchar **xy = g_strsplit(points[i], ",", 2);
+        gchar *end_x = NULL, *end_y = NULL;
+        if (g_strv_length(xy) == 2) {
+            gfloat x = (gfloat) g_ascii_strtod(g_strstrip(xy[0]), &end_x);
+            gfloat y = (gfloat) g_ascii_strtod(g_strstrip(xy[1]), &end_y);
+            if (*end_x == '\0' && *end_y == '\0' && x >= 0 && y >= 0) {
+                (*vx)[valid] = x;
+                (*vy)[valid] = y;
+                valid++;
+            }
+        }
+        g_strfreev(xy);
+    }
+    g_strfreev(points);
+    return valid == n ? n : 0;
+}
+
+static gboolean parse_source(GKeyFile *key_file, const gchar *group, LineZoneSource *src, GError **error) {
+    gchar **keys = g_key_file_get_keys(key_file, group, NULL, NULL);
+    gboolean ok = TRUE;
+
+    for (guint i = 0; keys && keys[i] && ok; i++) {
+        gboolean is_line = g_str_has_prefix(keys[i], "line-");
+        gboolean is_zone = g_str_has_prefix(keys[i], "zone-");
+        gchar *text;
+        gfloat *vx = NULL, *vy = NULL;
+        guint n;
+
+        if (!is_line && !is_zone)
+            continue;
+        if ((is_line ? src->num_lines : src->num_zones) == LINE_ZONE_MAX_SHAPES) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "%s: at most %d %s", group, LINE_ZONE_MAX_SHAPES, is_line ? "lines" : "zones");
+            ok = FALSE;
+            break;
+        }
+        text = g_key_file_get_string(key_file, group, keys[i], NULL);
+        n = text ? parse_points(text, &vx, &vy) : 0;
+        g_free(text);
+        if (is_line && n == 2 && (vx[0] != vx[1] || vy[0] != vy[1])) {
+            Line *line = &src->lines[src->num_lines++];
+            line->name = g_strdup(keys[i] + 5);
+            line->ax = vx[0];
+            line->ay = vy[0];
+            line->bx = vx[1];
+            line->by = vy[1];
+            g_free(vx);
+            g_free(vy);
+        } else if (is_zone && n >= 3) {
+            Zone *zone = &src->zones[src->num_zones++];
+            zone->name = g_strdup(keys[i] + 5);
+            zone->num_vertices = n;
+            zone->vx = vx;
+            zone->vy = vy;
+        } else {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "%s: %s needs %s", group, keys[i],
+                        is_line ? "two distinct \"x,y\" points" : "at least 3 \"x,y\" vertices");
+            g_free(vx);
+            g_free(vy);
+            ok = FALSE;
+        }
+    }
+    g_strfreev(keys);
+    return ok;
+}
+
+static void build_grid(LineZoneSource *src) {
+    gfloat max_x = 0, max_y = 0;
+
+    for (guint z = 0; z < src->num_zones; z++)
+        for (guint v = 0; v < src->zones[z].num_vertices; v++) {
+            max_x = MAX(max_x, src->zones[z].vx[v]);
+            max_y = MAX(max_y, src->zones[z].vy[v]);
+        }
+    src->grid_width = (guint) (max_x / GRID_CELL) + 1;
+    src->grid_height = (guint) (max_y / GRID_CELL) + 1;
+    src->grid = g_new0(guint64, src->grid_width * src->grid_height);
+    for (guint z = 0; z < src->num_zones; z++) {
+        Zone *zone = &src->zones[z];
+        gfloat x0 = zone->vx[0], y0 = zone->vy[0], x1 = x0, y1 = y0;
+        for (guint v = 1; v < zone->num_vertices; v++) {
+            x0 = MIN(x0, zone->vx[v]);
+            y0 = MIN(y0, zone->vy[v]);
+            x1 = MAX(x1, zone->vx[v]);
+            y1 = MAX(y1, zone->vy[v]);
+        }
+        for (guint cy = (guint) (y0 / GRID_CELL); cy <= (guint) (y1 / GRID_CELL); cy++)
+            for (guint cx = (guint) (x0 / GRID_CELL); cx <= (guint) (x1 / GRID_CELL); cx++)
+                src->grid[cy * src->grid_width + cx] |= G_GUINT64_CONSTANT(1) << z;
+    }
+}
+
+static void collect_line_zone_metrics(GString *out, gpointer user_data) {
+    LineZones *lz = user_data;
+    static const gchar *types[2] = {"entry", "exit"};
+
+    g_mutex_lock(&lz->lock);
+    for (guint s = 0; s < LINE_ZONE_MAX_SOURCES; s++) {
+        LineZoneSource *src = lz->sources[s];
+        if (!src)
+            continue;
+        for (guint i = 0; i < src->num_lines; i++)
+            for (guint t = 0; t < 2; t++)
+                g_string_append_printf(out, "ds_line_crossings_total{source=\"%u\",line=\"%s\",type=\"%s\"} %"
+                                       G_GUINT64_FORMAT "\n", s, src->lines[i].name, types[t],
+                                       src->lines[i].crossings[t]);
+        for (guint i = 0; i < src->num_zones; i++) {
+            g_string_append_printf(out, "ds_zone_occupancy{source=\"%u\",zone=\"%s\"} %d\n",
+                                   s, src->zones[i].name, src->zones[i].occupancy);
+            for (guint t = 0; t < 2; t++)
+                g_string_append_printf(out, "ds_zone_events_total{source=\"%u\",zone=\"%s\",type=\"%s\"} %"
+                                       G_GUINT64_FORMAT "\n", s, src->zones[i].name, types[t],
+                                       src->zones[i].events[t]);
+        }
+    }
+    g_string_append_printf(out, "ds_analytics_tracks %u\n", lz->num_tracks);
+    g_string_append_printf(out, "ds_analytics_batches_total %" G_GUINT64_FORMAT "\n", lz->batches);
+    g_string_append_printf(out, "ds_analytics_ms_total %.3f\n", lz->total_us / 1000.0);
+    g_mutex_unlock(&lz->lock);
+}
+
+LineZones *line_zones_load(const gchar *path, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    LineZones *lz;
+    gchar **groups;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(key_file);
+        return NULL;
+    }
+    lz = g_new0(LineZones, 1);
+    g_mutex_init(&lz->lock);
+    lz->track_timeout = DEFAULT_TRACK_TIMEOUT;
+    if (g_key_file_has_key(key_file, "property", "track-timeout", NULL))
+        lz->track_timeout = MAX(g_key_file_get_integer(key_file, "property", "track-timeout", NULL), 1);
+    groups = g_key_file_get_groups(key_file, NULL);
+    for (guint i = 0; groups[i]; i++) {
+        guint source_id;
+        LineZoneSource *src;
+        if (sscanf(groups[i], "source%u", &source_id) != 1)
+            continue;
+        if (source_id >= LINE_ZONE_MAX_SOURCES) {
+            g_printerr("Analytics config: ignoring [%s], at most %d sources\n", groups[i], LINE_ZONE_MAX_SOURCES);
+            continue;
+        }
+        src = g_new0(LineZoneSource, 1);
+        if (!parse_source(key_file, groups[i], src, error)) {
+            line_zone_source_free(src);
+            g_strfreev(groups);
+            g_key_file_free(key_file);
+            line_zones_free(lz);
+            return NULL;
+        }
+        build_grid(src);
+        line_zone_source_free(lz->sources[source_id]);
+        lz->sources[source_id] = src;
+    }
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+
+    lz->capacity = 1024;
+    lz->tracks = g_new0(Track, lz->capacity);
+    metrics_register("line-zone", collect_line_zone_metrics, lz);
+    return lz;
+}
+
+void line_zones_free(LineZones *lz) {
+    if (!lz)
+        return;
+    if (lz->tracks) /* registered once loaded */
+        metrics_unregister("line-zone");
+    for (guint i = 0; i < LINE_ZONE_MAX_SOURCES; i++)
+        line_zone_source_free(lz->sources[i]);
+    g_free(lz->tracks);
+    g_free(lz->xs);
+    g_free(lz->ys);
+    g_free(lz->ids);
+    g_free(lz->objs);
+    g_mutex_clear(&lz->lock);
+    g_free(lz);
+}
+
+static inline guint track_hash(guint32 source, guint64 object_id) {
+    guint64 h = object_id ^ ((guint64) source << 56);
+    h ^= h >> 33;
+    h *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (guint) h;
+}
+
+static Track *track_lookup(LineZones *lz, guint32 source, guint64 object_id, gboolean *created) {
+    guint mask = lz->capacity - 1;
+    guint i = track_hash(source, object_id) & mask;
+
+    while (lz->tracks[i].source) {
+        if (lz->tracks[i].source == source && lz->tracks[i].object_id == object_id) {
+            *created = FALSE;
+            return &lz->tracks[i];
+        }
+        i = (i + 1) & mask;
+    }
+    lz->tracks[i].source = source;
+    lz->tracks[i].object_id = object_id;
+    lz->num_tracks++;
+    *created = TRUE;
+    return &lz->tracks[i];
+}
+
+/* Keeps the load factor at or below 1/2, so probe runs stay short. */
+static void tracks_reserve(LineZones *lz, guint more) {
+    Track *old = lz->tracks;
+    guint old_capacity = lz->capacity;
+
+    if ((lz->num_tracks + more) * 2 <= lz->capacity)
+        return;
+    while ((lz->num_tracks + more) * 2 > lz->capacity)
+        lz->capacity *= 2;
+    lz->tracks = g_new0(Track, lz->capacity);
+    lz->num_tracks = 0;
+    for (guint i = 0; i < old_capacity; i++) {
+        gboolean created;
+        if (old[i].source)
+            *track_lookup(lz, old[i].source, old[i].object_id, &created) = old[i];
+    }
+    g_free(old);
+}
+
+/* Backward shift deletion: later entries of the probe run move up, so
+ * lookups never need tombstones. */
+static void track_remove(LineZones *lz, guint i) {
+    guint mask = lz->capacity - 1;
+
+    for (guint j = (i + 1) & mask; lz->tracks[j].source; j = (j + 1) & mask) {
+        guint home = track_hash(lz->tracks[j].source, lz->tracks[j].object_id) & mask;
+        /* j may move to i unless its home lies cyclically in (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            lz->tracks[i] = lz->tracks[j];
+            i = j;
+        }
+    }
+    lz->tracks[i].source = 0;
+    lz->num_tracks--;
+}
+
+/* Forgets tracks not seen for track_timeout frames of their source,
+ * checking `count` slots per call so the cost follows the object count. */
+static void tracks_sweep(LineZones *lz, guint count) {
+    guint mask = lz->capacity - 1;
+
+    for (guint k = 0; k < count && lz->num_tracks; k++) {
+        Track *track = &lz->tracks[lz->sweep];
+        LineZoneSource *src;
+        gint age;
+        if (!track->source) {
+            lz->sweep = (lz->sweep + 1) & mask;
+            continue;
+        }
+        src = lz->sources[track->source - 1];
+        age = src->frame_num - track->last_frame;
+        /* frame numbers restart when the source id is reused */
+        if (age > lz->track_timeout || age < 0) {
+            for (guint z = 0; z < src->num_zones; z++)
+                if (track->zones & (G_GUINT64_CONSTANT(1) << z))
+                    src->zones[z].occupancy--;
+            /* the slot is refilled by the shift, check it again */
+            track_remove(lz, lz->sweep);
+        } else {
+            lz->sweep = (lz->sweep + 1) & mask;
+        }
+    }
+}
+
+/* Side of (px, py) relative to the directed line a->b: positive on its
+ * right in image coordinates (y down). */
+static inline gfloat side(gfloat ax, gfloat ay, gfloat bx, gfloat by, gfloat px, gfloat py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+/* Crossing number, the scalar form of roi_points_in_polygon(). */
+static gboolean point_in_zone(const Zone *zone, gfloat x, gfloat y) {
+    gboolean in = FALSE;
+
+    for (guint i = 0, j = zone->num_vertices - 1; i < zone->num_vertices; j = i++) {
+        if ((y < zone->vy[i]) != (y < zone->vy[j])
+            && x < (zone->vx[j] - zone->vx[i]) * (y - zone->vy[i]) / (zone->vy[j] - zone->vy[i]) + zone->vx[i])
+            in = !in;
+    }
+    return in;
+}
+
+/* Bit z set for every zone z containing (x, y). */
+static inline guint64 zones_of(const LineZoneSource *src, gfloat x, gfloat y) {
+    guint64 candidates, zones = 0;
+    guint cx, cy;
+
+    if (x < 0 || y < 0)
+        return 0;
+    cx = (guint) (x / GRID_CELL);
+    cy = (guint) (y / GRID_CELL);
+    if (cx >= src->grid_width || cy >= src->grid_height)
+        return 0;
+    for (candidates = src->grid[cy * src->grid_width + cx]; candidates; candidates &= candidates - 1) {
+        guint z = (guint) __builtin_ctzll(candidates);
+        if (point_in_zone(&src->zones[z], x, y))
+            zones |= G_GUINT64_CONSTANT(1) << z;
+    }
+    return zones;
+}
+
+static void ensure_scratch(LineZones *lz, guint n) {
+    if (n <= lz->scratch_size)
+        return;
+    lz->scratch_size = MAX(n, lz->scratch_size * 2);
+    lz->xs = g_renew(gfloat, lz->xs, lz->scratch_size);
+    lz->ys = g_renew(gfloat, lz->ys, lz->scratch_size);
+    lz->ids = g_renew(guint64, lz->ids, lz->scratch_size);
+    lz->objs = g_renew(NvDsObjectMeta *, lz->objs, lz->scratch_size);
+}
+
+void line_zones_update(LineZones *lz, guint source_id, gint frame_num, guint n,
+                       const guint64 *ids, const gfloat *xs, const gfloat *ys,
+                       LineZoneEventFunc func, gpointer user_data) {
+    LineZoneSource *src = source_id < LINE_ZONE_MAX_SOURCES ? lz->sources[source_id] : NULL;
+
+    if (!src)
+        return;
+    g_mutex_lock(&lz->lock);
+    src->frame_num = frame_num;
+    tracks_reserve(lz, n);
+    for (guint i = 0; i < n; i++) {
+        gboolean created;
+        Track *track = track_lookup(lz, source_id + 1, ids[i], &created);
+        guint64 zones = zones_of(src, xs[i], ys[i]), changed;
+
+        if (created) {
+            track->zones = 0;
+        } else {
+            for (guint l = 0; l < src->num_lines; l++) {
+                Line *line = &src->lines[l];
+                gfloat s0 = side(line->ax, line->ay, line->bx, line->by, track->x, track->y);
+                gfloat s1 = side(line->ax, line->ay, line->bx, line->by, xs[i], ys[i]);
+                gfloat t0, t1;
+                if ((s0 > 0) == (s1 > 0))
+                    continue;
+                /* the line's end points must straddle the motion too */
+                t0 = side(track->x, track->y, xs[i], ys[i], line->ax, line->ay);
+                t1 = side(track->x, track->y, xs[i], ys[i], line->bx, line->by);
+                if ((t0 > 0) == (t1 > 0))
+                    continue;
+                line->crossings[s1 > 0 ? 0 : 1]++;
+                if (func)
+                    func(i, s1 > 0 ? NVDS_EVENT_ENTRY : NVDS_EVENT_EXIT, LINE_ZONE_LINE, line->name, user_data);
+            }
+        }
+        changed = track->zones ^ zones;
+        while (changed) {
+            guint z = (guint) __builtin_ctzll(changed);
+            gboolean entered = (zones >> z) & 1;
+            Zone *zone = &src->zones[z];
+            zone->occupancy += entered ? 1 : -1;
+            if (!created) {
+                zone->events[entered ? 0 : 1]++;
+                if (func)
+                    func(i, entered ? NVDS_EVENT_ENTRY : NVDS_EVENT_EXIT, LINE_ZONE_ZONE, zone->name, user_data);
+            }
+            changed &= changed - 1;
+        }
+        track->zones = zones;
+        track->x = xs[i];
+        track->y = ys[i];
+        track->last_frame = frame_num;
+    }
+    tracks_sweep(lz, 2 * n + 16);
+    g_mutex_unlock(&lz->lock);
+}
+
+typedef struct {
+    NvDsBatchMeta *batch_meta;
+    NvDsFrameMeta *frame_meta;
+    NvDsObjectMeta **objs;
+    const MuxScaling *scaling;
+} EventContext;
+
+static gpointer copy_event_meta(gpointer data, gpointer user_data) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    NvDsEventMsgMeta *src = user_meta->user_meta_data;
+    NvDsEventMsgMeta *dst = g_memdup(src, sizeof(NvDsEventMsgMeta));
+
+    dst->ts = g_strdup(src->ts);
+    dst->objectId = g_strdup(src->objectId);
+    dst->sensorStr = g_strdup(src->sensorStr);
+    dst->otherAttrs = g_strdup(src->otherAttrs);
+    dst->videoPath = g_strdup(src->videoPath);
+    return dst;
+}
+
+static void release_event_meta(gpointer data, gpointer user_data) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    NvDsEventMsgMeta *meta = user_meta->user_meta_data;
+
+    g_free(meta->ts);
+    g_free(meta->objectId);
+    g_free(meta->sensorStr);
+    g_free(meta->otherAttrs);
+    g_free(meta->videoPath);
+    g_free(meta);
+    user_meta->user_meta_data = NULL;
+}
+
+/* Classes of the sample's 4-class detector. */
+static NvDsObjectType object_type(gint class_id) {
+    switch (class_id) {
+        case 0:
+            return NVDS_OBJECT_TYPE_VEHICLE;
+        case 1:
+            return NVDS_OBJECT_TYPE_BICYCLE;
+        case 2:
+            return NVDS_OBJECT_TYPE_PERSON;
+        case 3:
+            return NVDS_OBJECT_TYPE_ROADSIGN;
+        default:
+            return NVDS_OBJECT_TYPE_UNKNOWN;
+    }
+}
+
+/* RFC 3339 in UTC with milliseconds, from the frame's NTP time when the
+ * source provides one. */
+static gchar *event_timestamp(const NvDsFrameMeta *frame_meta) {
+    gint64 us = frame_meta->ntp_timestamp ? (gint64) (frame_meta->ntp_timestamp / 1000) : g_get_real_time();
+    GDateTime *time = g_date_time_new_from_unix_utc(us / G_USEC_PER_SEC);
+    gchar *date = g_date_time_format(time, "%Y-%m-%dT%H:%M:%S");
+    gchar *ts = g_strdup_printf("%s.%03dZ", date, (gint) (us % G_USEC_PER_SEC / 1000));
+
+    g_free(date);
+    g_date_time_unref(time);
+    return ts;
+}
+
+static void attach_event(guint index, NvDsEventType type, LineZoneKind kind,
+                         const gchar *name, gpointer user_data) {
+    EventContext *ctx = user_data;
+    NvDsObjectMeta *obj_meta = ctx->objs[index];
+    NvDsEventMsgMeta *msg = g_new0(NvDsEventMsgMeta, 1);
+    NvDsUserMeta *user_meta;
+    NvOSD_RectParams rect;
+
+    mux_scaling_rect_to_source(ctx->scaling, ctx->frame_meta, &obj_meta->rect_params, &rect);
+    msg->type = type;
+    msg->objType = object_type(obj_meta->class_id);
+    msg->objClassId = obj_meta->class_id;
+    msg->bbox.left = (gint) rect.left;
+    msg->bbox.top = (gint) rect.top;
+    msg->bbox.width = (gint) rect.width;
+    msg->bbox.height = (gint) rect.height;
+    msg->sensorId = (gint) ctx->frame_meta->source_id;
+    msg->frameId = ctx->frame_meta->frame_num;
+    msg->confidence = obj_meta->confidence;
+    msg->trackingId = (gint) obj_meta->object_id;
+    msg->ts = event_timestamp(ctx->frame_meta);
+    msg->objectId = g_strdup(obj_meta->obj_label);
+    msg->otherAttrs = g_strdup_printf("%s=%s", kind == LINE_ZONE_LINE ? "line" : "zone", name);
+
+    user_meta = nvds_acquire_user_meta_from_pool(ctx->batch_meta);
+    user_meta->user_meta_data = msg;
+    user_meta->base_meta.meta_type = NVDS_EVENT_MSG_META;
+    user_meta->base_meta.copy_func = copy_event_meta;
+    user_meta->base_meta.release_func = release_event_meta;
+    nvds_add_user_meta_to_frame(ctx->frame_meta, user_meta);
+}
+
+void line_zones_process_batch(LineZones *lz, NvDsBatchMeta *batch_meta, const MuxScaling *scaling) {
+    gint64 start = g_get_monotonic_time();
+    NvDsMetaList *l_frame, *l_obj;
+    EventContext ctx = {batch_meta, NULL, NULL, scaling};
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        guint n = 0;
+
+        if (frame_meta->source_id >= LINE_ZONE_MAX_SOURCES || !lz->sources[frame_meta->source_id])
+            continue;
+        ensure_scratch(lz, frame_meta->num_obj_meta);
+        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL && n < lz->scratch_size; l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+            NvOSD_RectParams anchor;
+            if (obj_meta->object_id == UNTRACKED_OBJECT_ID)
+                continue;
+            mux_scaling_rect_to_source(scaling, frame_meta, &obj_meta->rect_params, &anchor);
+            lz->objs[n] = obj_meta;
+            lz->ids[n] = obj_meta->object_id;
+            lz->xs[n] = anchor.left + anchor.width * 0.5f;
+            lz->ys[n] = anchor.top + anchor.height;
+            n++;
+        }
+        ctx.frame_meta = frame_meta;
+        ctx.objs = lz->objs;
+        line_zones_update(lz, frame_meta->source_id, frame_meta->frame_num, n,
+                          lz->ids, lz->xs, lz->ys, attach_event, &ctx);
+    }
+    g_mutex_lock(&lz->lock);
+    lz->batches++;
+    lz->total_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&lz->lock);
+}
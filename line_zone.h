@@ -0,0 +1,69 @@
+#ifndef LINE_ZONE_H
+#define LINE_ZONE_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+#include "nvdsmeta_schema.h"
+#include "mux_scaling.h"
+
+G_BEGIN_DECLS
+
+/* Line crossing and zone occupancy on tracked objects.
+ *
+ * Lines and zones are configured per source in source pixel coordinates,
+ * in the key file layout of the ROI config:
+ *
+ *   [property]
+ *   track-timeout=30
+ *
+ *   [source0]
+ *   line-entrance=100,600;1800,600
+ *   zone-parking=0,0;960,0;960,540;0,540
+ *
+ * Every track is followed by the bottom-center anchor of its box. A track
+ * whose anchor moved across a line segment between two of its frames
+ * crosses it; moving from the left to the right side of the line, seen
+ * from its first towards its second point, is an NVDS_EVENT_ENTRY and the
+ * other way an NVDS_EVENT_EXIT. An anchor moving into or out of a zone
+ * polygon is an ENTRY or EXIT of that zone. A track is only compared with
+ * its own previous frame, so a track first seen inside a zone counts
+ * towards its occupancy without an event.
+ *
+ * Events are attached to their frame as NVDS_EVENT_MSG_META user meta, the
+ * input of nvmsgconv, with otherAttrs "line=entrance" or "zone=parking".
+ * Objects without a tracker id (UNTRACKED_OBJECT_ID) are ignored, and a
+ * track not seen for track-timeout frames of its source is forgotten. */
+
+#define LINE_ZONE_MAX_SOURCES 64
+/* lines, and zones, per source */
+#define LINE_ZONE_MAX_SHAPES 64
+
+typedef struct _LineZones LineZones;
+
+typedef enum {
+    LINE_ZONE_LINE,
+    LINE_ZONE_ZONE
+} LineZoneKind;
+
+/* Called for every event with the index of the track in the arrays given
+ * to line_zones_update(). */
+typedef void (*LineZoneEventFunc)(guint index, NvDsEventType type, LineZoneKind kind,
+                                  const gchar *name, gpointer user_data);
+
+LineZones *line_zones_load(const gchar *path, GError **error);
+
+void line_zones_free(LineZones *lz);
+
+/* Evaluates frame `frame_num` of `source_id` with `n` tracks, their ids and
+ * anchors in source pixels. */
+void line_zones_update(LineZones *lz, guint source_id, gint frame_num, guint n,
+                       const guint64 *ids, const gfloat *xs, const gfloat *ys,
+                       LineZoneEventFunc func, gpointer user_data);
+
+/* Runs line_zones_update() on every frame and attaches the events; call
+ * on the tracker src pad. */
+void line_zones_process_batch(LineZones *lz, NvDsBatchMeta *batch_meta, const MuxScaling *scaling);
+
+G_END_DECLS
+
+#endif
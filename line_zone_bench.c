@@ -0,0 +1,147 @@
+/* Benchmark for the line and zone analytics (line_zone.h): random-walks
+ * synthetic tracks over one 1920x1080 source with generated zones and
+ * lines and reports the evaluation cost per frame, e.g.
+ *
+ *   ./line_zone_bench_ --tracks 10000 --zones 50 --frames 1000
+ *
+ * Track ids are renewed at --churn per frame, so lookups, inserts and the
+ * eviction of stale tracks are all part of the measurement. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "line_zone.h"
+
+#define FRAME_WIDTH 1920.0f
+#define FRAME_HEIGHT 1080.0f
+
+static gint opt_tracks = 10000;
+static gint opt_zones = 50;
+static gint opt_lines = 8;
+static gint opt_frames = 1000;
+static gdouble opt_churn = 0.01;
+
+static GOptionEntry entries[] = {
+        {"tracks", 't', 0, G_OPTION_ARG_INT, &opt_tracks, "Tracks per frame (default 10000)", "N"},
+        {"zones", 'z', 0, G_OPTION_ARG_INT, &opt_zones, "Zones (default 50)", "N"},
+        {"lines", 'l', 0, G_OPTION_ARG_INT, &opt_lines, "Lines (default 8)", "N"},
+        {"frames", 'f', 0, G_OPTION_ARG_INT, &opt_frames, "Frames to evaluate (default 1000)", "N"},
+        {"churn", 'c', 0, G_OPTION_ARG_DOUBLE, &opt_churn, "Share of tracks replaced per frame (default 0.01)", "F"},
+        {NULL}
+};
+
+static guint64 events;
+
+static void count_event(guint index, NvDsEventType type, LineZoneKind kind, const gchar *name, gpointer user_data) {
+    events++;
+}
+
+/* Zones are random pentagons, lines random segments, all inside the
+ * frame. */
+static gchar *write_config(GRand *rand) {
+    GString *text = g_string_new("[source0]\n");
+    gchar *path = NULL;
+    gint fd;
+
+    for (gint z = 0; z < opt_zones; z++) {
+        gdouble cx = g_rand_double_range(rand, 100, FRAME_WIDTH - 100);
+        gdouble cy = g_rand_double_range(rand, 100, FRAME_HEIGHT - 100);
+        gdouble r = g_rand_double_range(rand, 40, 100);
+        g_string_append_printf(text, "zone-z%d=", z);
+        for (gint v = 0; v < 5; v++)
+            g_string_append_printf(text, "%s%.0f,%.0f", v ? ";" : "",
+                                   cx + r * cos(v * G_PI * 2 / 5), cy + r * sin(v * G_PI * 2 / 5));
+        g_string_append_c(text, '\n');
+    }
+    for (gint l = 0; l < opt_lines; l++)
+        g_string_append_printf(text, "line-l%d=%.0f,%.0f;%.0f,%.0f\n", l,
+                               g_rand_double_range(rand, 0, FRAME_WIDTH), g_rand_double_range(rand, 0, FRAME_HEIGHT),
+                               g_rand_double_range(rand, 0, FRAME_WIDTH), g_rand_double_range(rand, 0, FRAME_HEIGHT));
+    fd = g_file_open_tmp("line-zone-XXXXXX.txt", &path, NULL);
+    if (fd >= 0) {
+        close(fd);
+        g_file_set_contents(path, text->str, -1, NULL);
+    }
+    g_string_free(text, TRUE);
+    return path;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("- benchmark line crossing and zone analytics");
+    GError *error = NULL;
+    GRand *rand = g_rand_new_with_seed(1);
+    LineZones *lz;
+    gchar *path;
+    guint n;
+    guint64 *ids, next_id;
+    gfloat *xs, *ys, *dx, *dy;
+    gint64 start, elapsed;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+    if (opt_tracks < 1 || opt_zones < 0 || opt_zones > LINE_ZONE_MAX_SHAPES
+        || opt_lines < 0 || opt_lines > LINE_ZONE_MAX_SHAPES || opt_frames < 1) {
+        g_printerr("--zones and --lines take at most %d, --tracks and --frames at least 1\n", LINE_ZONE_MAX_SHAPES);
+        return 1;
+    }
+
+    path = write_config(rand);
+    lz = path ? line_zones_load(path, &error) : NULL;
+    if (path)
+        unlink(path);
+    g_free(path);
+    if (!lz) {
+        g_printerr("Failed to set up the analytics: %s\n", error ? error->message : "no temporary file");
+        return 1;
+    }
+
+    n = (guint) opt_tracks;
+    ids = g_new(guint64, n);
+    xs = g_new(gfloat, n);
+    ys = g_new(gfloat, n);
+    dx = g_new(gfloat, n);
+    dy = g_new(gfloat, n);
+    for (guint i = 0; i < n; i++) {
+        ids[i] = i;
+        xs[i] = (gfloat) g_rand_double_range(rand, 0, FRAME_WIDTH);
+        ys[i] = (gfloat) g_rand_double_range(rand, 0, FRAME_HEIGHT);
+        dx[i] = (gfloat) g_rand_double_range(rand, -4, 4);
+        dy[i] = (gfloat) g_rand_double_range(rand, -4, 4);
+    }
+    next_id = n;
+
+    elapsed = 0;
+    for (gint f = 0; f < opt_frames; f++) {
+        for (guint i = 0; i < n; i++) {
+            xs[i] += dx[i];
+            ys[i] += dy[i];
+            if (xs[i] < 0 || xs[i] > FRAME_WIDTH)
+                dx[i] = -dx[i];
+            if (ys[i] < 0 || ys[i] > FRAME_HEIGHT)
+                dy[i] = -dy[i];
+            if (g_rand_double(rand) < opt_churn)
+                ids[i] = next_id++;
+        }
+        start = g_get_monotonic_time();
+        line_zones_update(lz, 0, f, n, ids, xs, ys, count_event, NULL);
+        elapsed += g_get_monotonic_time() - start;
+    }
+
+    g_print("%d tracks, %d zones, %d lines: %.1f us/frame (%.1f ns/track), %.1f events/frame\n",
+            opt_tracks, opt_zones, opt_lines, (gdouble) elapsed / opt_frames,
+            elapsed * 1000.0 / opt_frames / n, (gdouble) events / opt_frames);
+
+    line_zones_free(lz);
+    g_free(ids);
+    g_free(xs);
+    g_free(ys);
+    g_free(dx);
+    g_free(dy);
+    g_rand_free(rand);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "meta_access.h"
+#include "async_log.h"
+
+/* Longest chain followed from the muxer. */
+#define META_ACCESS_MAX_ELEMENTS 256
+
+gboolean meta_access_single_owner = FALSE;
+
+/* The element receiving what `src_pad` pushes, looking through ghost pads
+ * into and out of bins. */
+static GstElement *next_element(GstPad *src_pad) {
+    GstPad *pad = gst_pad_get_peer(src_pad);
+    GstElement *element;
+
+    while (pad && GST_IS_PROXY_PAD (pad)) {
+        GstPad *next;
+        if (GST_IS_GHOST_PAD (pad)) {
+            /* sink ghost pad of a bin: on to the element inside */
+            next = gst_ghost_pad_get_target(GST_GHOST_PAD (pad));
+        } else {
+            /* internal pad of a src ghost pad: on past the bin */
+            GstProxyPad *ghost = gst_proxy_pad_get_internal(GST_PROXY_PAD (pad));
+            next = ghost ? gst_pad_get_peer(GST_PAD (ghost)) : NULL;
+            if (ghost)
+                gst_object_unref(ghost);
+        }
+        gst_object_unref(pad);
+        pad = next;
+    }
+    if (!pad)
+        return NULL;
+    element = gst_pad_get_parent_element(pad);
+    gst_object_unref(pad);
+    return element;
+}
+
+static gboolean has_request_src_pads(GstElement *element) {
+    for (const GList *l = gst_element_class_get_pad_template_list(GST_ELEMENT_GET_CLASS (element));
+         l != NULL; l = l->next) {
+        GstPadTemplate *templ = l->data;
+        if (GST_PAD_TEMPLATE_DIRECTION (templ) == GST_PAD_SRC && GST_PAD_TEMPLATE_PRESENCE (templ) == GST_PAD_REQUEST)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+gboolean meta_access_elide_if_linear(GstElement *muxer) {
+    GstElement *element = gst_object_ref(muxer);
+    gboolean linear = TRUE;
+
+    for (guint n = 0; element && n < META_ACCESS_MAX_ELEMENTS; n++) {
+        GstIterator *it = gst_element_iterate_src_pads(element);
+        GValue item = G_VALUE_INIT;
+        GstPad *src_pad = NULL;
+        guint num_src_pads = 0;
+        GstElement *next = NULL;
+
+        while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+            if (num_src_pads++ == 0)
+                src_pad = gst_object_ref(g_value_get_object(&item));
+            g_value_reset(&item);
+        }
+        g_value_unset(&item);
+        gst_iterator_free(it);
+
+        if (num_src_pads > 1 || has_request_src_pads(element)) {
+            nvds_log(DSLOG_CAT_APP, LOG_INFO, "%s can branch, batch meta stays locked", GST_ELEMENT_NAME (element));
+            linear = FALSE;
+        } else if (src_pad) {
+            next = next_element(src_pad);
+        }
+        if (src_pad)
+            gst_object_unref(src_pad);
+        gst_object_unref(element);
+        element = linear ? next : NULL;
+        if (next && !linear)
+            gst_object_unref(next);
+    }
+    if (element) {
+        /* too long to tell */
+        gst_object_unref(element);
+        linear = FALSE;
+    }
+    meta_access_single_owner = linear;
+    return linear;
+}
+
+#ifdef META_ACCESS_CHECK
+void meta_access_claim(NvDsBatchMeta *batch_meta) {
+    if (!g_rec_mutex_trylock(&batch_meta->meta_mutex))
+        g_error("Batch meta %p accessed by two threads at once", (gpointer) batch_meta);
+}
+
+void meta_access_unclaim(NvDsBatchMeta *batch_meta) {
+    g_rec_mutex_unlock(&batch_meta->meta_mutex);
+}
+#endif
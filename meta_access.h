@@ -0,0 +1,57 @@
+#ifndef META_ACCESS_H
+#define META_ACCESS_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+
+G_BEGIN_DECLS
+
+/* Batch metadata access from probes.
+ *
+ * A probe that reads or changes the metadata of a batch brackets its work
+ * with meta_access_begin() / meta_access_end(), once per batch instead of
+ * once per object. By default that takes the batch meta_mutex
+ * (nvds_acquire_meta_lock). When meta_access_elide_if_linear() has shown
+ * that the graph from the muxer on is a single chain, a batch is only
+ * ever handled by one thread at a time (queues hand it over) and the
+ * bracket costs one predictable branch.
+ *
+ * Builds with META_ACCESS_CHECK (cmake -DMETA_ACCESS_CHECK=ON) check the
+ * claim: the elided path try-locks the mutex instead and aborts if another
+ * thread holds it. */
+
+extern gboolean meta_access_single_owner;
+
+/* Walks the elements downstream of `muxer`; enables the lock-free path
+ * if none of them can branch (tee, output-selector or any element with
+ * more than one src pad). Returns whether it did. */
+gboolean meta_access_elide_if_linear(GstElement *muxer);
+
+#ifdef META_ACCESS_CHECK
+void meta_access_claim(NvDsBatchMeta *batch_meta);
+void meta_access_unclaim(NvDsBatchMeta *batch_meta);
+#endif
+
+static inline void meta_access_begin(NvDsBatchMeta *batch_meta) {
+    if (G_LIKELY (meta_access_single_owner)) {
+#ifdef META_ACCESS_CHECK
+        meta_access_claim(batch_meta);
+#endif
+        return;
+    }
+    nvds_acquire_meta_lock(batch_meta);
+}
+
+static inline void meta_access_end(NvDsBatchMeta *batch_meta) {
+    if (G_LIKELY (meta_access_single_owner)) {
+#ifdef META_ACCESS_CHECK
+        meta_access_unclaim(batch_meta);
+#endif
+        return;
+    }
+    nvds_release_meta_lock(batch_meta);
+}
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,143 @@
+/* Cost of locking the batch meta from probes (meta_access.h): walks the
+ * objects of a batch taking the meta_mutex per object, once per batch, and
+ * through the elided single-owner path, e.g.
+ *
+ *   ./meta_lock_bench_ --objects 10,100,1000,10000 --batches 2000
+ *
+ * With --contend a second thread takes and releases the same mutex in a
+ * loop, as another probe on a branched pipeline would. The elided path is
+ * timed as shipped; a META_ACCESS_CHECK build times its ownership check
+ * (a try-lock) instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "meta_access.h"
+
+static gchar *opt_objects = NULL;
+static gint opt_batches = 2000;
+static gboolean opt_contend = FALSE;
+
+static GOptionEntry entries[] = {
+        {"objects", 'o', 0, G_OPTION_ARG_STRING, &opt_objects,
+                "Objects per batch, comma separated (default 10,100,1000,10000)", "N,..."},
+        {"batches", 'n', 0, G_OPTION_ARG_INT, &opt_batches, "Batches per measurement (default 2000)", "N"},
+        {"contend", 'c', 0, G_OPTION_ARG_NONE, &opt_contend, "Hold the mutex from a second thread too", NULL},
+        {NULL}
+};
+
+typedef enum {
+    LOCK_PER_OBJECT,
+    LOCK_PER_BATCH,
+    LOCK_ELIDED
+} LockMode;
+
+static const gchar *mode_names[] = {"per object", "per batch", "elided"};
+
+static volatile gint stop_contending;
+
+static gpointer contend(gpointer data) {
+    NvDsBatchMeta *batch_meta = data;
+
+    while (!g_atomic_int_get(&stop_contending)) {
+        g_rec_mutex_lock(&batch_meta->meta_mutex);
+        g_rec_mutex_unlock(&batch_meta->meta_mutex);
+    }
+    return NULL;
+}
+
+/* What the analytics probes do per object: read the box, update a field. */
+static inline gfloat touch(NvDsObjectMeta *obj_meta) {
+    obj_meta->rect_params.border_width = obj_meta->class_id == 0 ? 2 : 1;
+    return obj_meta->confidence + obj_meta->rect_params.width;
+}
+
+static gdouble run(NvDsBatchMeta *batch_meta, NvDsObjectMeta *objects, guint num_objects, LockMode mode,
+                   gfloat *sink) {
+    gint64 start = g_get_monotonic_time();
+    gfloat sum = 0;
+
+    meta_access_single_owner = mode == LOCK_ELIDED;
+    for (gint b = 0; b < opt_batches; b++) {
+        switch (mode) {
+            case LOCK_PER_OBJECT:
+                for (guint i = 0; i < num_objects; i++) {
+                    nvds_acquire_meta_lock(batch_meta);
+                    sum += touch(&objects[i]);
+                    nvds_release_meta_lock(batch_meta);
+                }
+                break;
+            default:
+                meta_access_begin(batch_meta);
+                for (guint i = 0; i < num_objects; i++)
+                    sum += touch(&objects[i]);
+                meta_access_end(batch_meta);
+                break;
+        }
+    }
+    *sink += sum;
+    return (gdouble) (g_get_monotonic_time() - start) * 1000.0 / opt_batches;
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("- time batch meta locking");
+    GError *error = NULL;
+    gchar **counts;
+    NvDsBatchMeta *batch_meta;
+    GThread *contender = NULL;
+    gfloat sink = 0;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+    if (opt_batches < 1) {
+        g_printerr("--batches takes at least 1\n");
+        return 1;
+    }
+
+    batch_meta = nvds_create_batch_meta(1);
+    if (opt_contend)
+        contender = g_thread_new("contend", contend, batch_meta);
+
+    counts = g_strsplit(opt_objects ? opt_objects : "10,100,1000,10000", ",", -1);
+    g_print("%8s %14s %14s %14s   ns/batch%s\n", "objects", mode_names[0], mode_names[1], mode_names[2],
+            opt_contend ? ", contended" : "");
+    for (gchar **c = counts; *c != NULL; c++) {
+        guint num_objects = (guint) strtoul(*c, NULL, 10);
+        NvDsObjectMeta *objects = g_new0(NvDsObjectMeta, MAX(num_objects, 1));
+        gdouble ns[3];
+
+        for (guint i = 0; i < num_objects; i++) {
+            objects[i].class_id = (gint) (i % 4);
+            objects[i].confidence = 0.5f;
+            objects[i].rect_params.width = (gfloat) i;
+        }
+        /* warm up caches and the mutex */
+        run(batch_meta, objects, num_objects, LOCK_PER_BATCH, &sink);
+        for (guint m = LOCK_PER_OBJECT; m <= LOCK_ELIDED; m++) {
+            if (m == LOCK_ELIDED && opt_contend) {
+                /* the elided path is only sound without a second owner */
+                ns[m] = 0;
+                continue;
+            }
+            ns[m] = run(batch_meta, objects, num_objects, m, &sink);
+        }
+        g_print("%8u %14.0f %14.0f ", num_objects, ns[LOCK_PER_OBJECT], ns[LOCK_PER_BATCH]);
+        if (opt_contend)
+            g_print("%14s\n", "-");
+        else
+            g_print("%14.0f\n", ns[LOCK_ELIDED]);
+        g_free(objects);
+    }
+    g_strfreev(counts);
+
+    if (contender) {
+        g_atomic_int_set(&stop_contending, 1);
+        g_thread_join(contender);
+    }
+    nvds_destroy_batch_meta(batch_meta);
+    /* keeps the object walk from being optimized out */
+    return sink < 0;
+}
@@ -0,0 +1,122 @@
+#include "meta_pool.h"
+#include "pipeline_metrics.h"
+
+/* Batches between the mark and the observe point whose capacities are
+ * remembered; more means batches were dropped on the way. */
+#define META_POOL_MAX_PENDING 64
+
+typedef struct {
+    NvDsBatchMeta *batch_meta;
+    guint capacity[META_POOL_COUNT];
+} MarkedBatch;
+
+struct _MetaPools {
+    GMutex lock;          /* everything below */
+    MarkedBatch marked[META_POOL_MAX_PENDING];
+    guint next_mark;
+    MetaPoolStats stats[META_POOL_COUNT];
+};
+
+static const gchar *pool_names[META_POOL_COUNT] = {"frame", "obj", "classifier", "display", "user", "label_info"};
+
+const gchar *meta_pool_name(MetaPoolKind kind) {
+    return pool_names[kind];
+}
+
+static NvDsMetaPool *get_pool(NvDsBatchMeta *batch_meta, MetaPoolKind kind) {
+    switch (kind) {
+        case META_POOL_FRAME:
+            return batch_meta->frame_meta_pool;
+        case META_POOL_OBJ:
+            return batch_meta->obj_meta_pool;
+        case META_POOL_CLASSIFIER:
+            return batch_meta->classifier_meta_pool;
+        case META_POOL_DISPLAY:
+            return batch_meta->display_meta_pool;
+        case META_POOL_USER:
+            return batch_meta->user_meta_pool;
+        default:
+            return batch_meta->label_info_meta_pool;
+    }
+}
+
+static guint pool_capacity(NvDsBatchMeta *batch_meta, MetaPoolKind kind) {
+    NvDsMetaPool *pool = get_pool(batch_meta, kind);
+    return pool ? pool->num_full_elements + pool->num_empty_elements : 0;
+}
+
+static void collect_meta_pool_metrics(GString *out, gpointer user_data) {
+    MetaPools *pools = user_data;
+
+    g_mutex_lock(&pools->lock);
+    for (guint k = 0; k < META_POOL_COUNT; k++) {
+        const MetaPoolStats *stats = &pools->stats[k];
+        g_string_append_printf(out, "ds_meta_pool_capacity{pool=\"%s\"} %u\n", pool_names[k], stats->capacity);
+        g_string_append_printf(out, "ds_meta_pool_full_high{pool=\"%s\"} %u\n", pool_names[k], stats->full_high);
+        g_string_append_printf(out, "ds_meta_pool_empty_high{pool=\"%s\"} %u\n", pool_names[k], stats->empty_high);
+        g_string_append_printf(out, "ds_meta_pool_grown_total{pool=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                               pool_names[k], stats->grown);
+    }
+    g_mutex_unlock(&pools->lock);
+}
+
+MetaPools *meta_pools_new(void) {
+    MetaPools *pools = g_new0(MetaPools, 1);
+
+    g_mutex_init(&pools->lock);
+    metrics_register("meta-pools", collect_meta_pool_metrics, pools);
+    return pools;
+}
+
+/* A slot of the ring of marked batches; overwritten once the ring wraps,
+ * which means batches were dropped on the way. */
+void meta_pools_mark_batch(MetaPools *pools, NvDsBatchMeta *batch_meta) {
+    MarkedBatch *marked;
+
+    g_mutex_lock(&pools->lock);
+    marked = &pools->marked[pools->next_mark++ % META_POOL_MAX_PENDING];
+    marked->batch_meta = batch_meta;
+    for (guint k = 0; k < META_POOL_COUNT; k++)
+        marked->capacity[k] = pool_capacity(batch_meta, k);
+    g_mutex_unlock(&pools->lock);
+}
+
+void meta_pools_observe_batch(MetaPools *pools, NvDsBatchMeta *batch_meta) {
+    MarkedBatch *marked = NULL;
+
+    g_mutex_lock(&pools->lock);
+    /* newest first: a freed batch meta's address comes back */
+    for (guint i = 1; i <= META_POOL_MAX_PENDING && !marked; i++) {
+        MarkedBatch *m = &pools->marked[(pools->next_mark - i) % META_POOL_MAX_PENDING];
+        if (m->batch_meta == batch_meta)
+            marked = m;
+    }
+    for (guint k = 0; k < META_POOL_COUNT; k++) {
+        NvDsMetaPool *pool = get_pool(batch_meta, k);
+        MetaPoolStats *stats = &pools->stats[k];
+        if (!pool)
+            continue;
+        stats->capacity = pool->num_full_elements + pool->num_empty_elements;
+        stats->full_high = MAX(stats->full_high, pool->num_full_elements);
+        stats->empty_high = MAX(stats->empty_high, pool->num_empty_elements);
+        if (marked && stats->capacity > marked->capacity[k])
+            stats->grown++;
+    }
+    if (marked)
+        marked->batch_meta = NULL;
+    g_mutex_unlock(&pools->lock);
+}
+
+void meta_pools_get_stats(MetaPools *pools, MetaPoolKind kind, MetaPoolStats *stats) {
+    g_mutex_lock(&pools->lock);
+    *stats = pools->stats[kind];
+    g_mutex_unlock(&pools->lock);
+}
+
+void meta_pools_free(MetaPools *pools) {
+    if (!pools)
+        return;
+    metrics_unregister("meta-pools");
+    g_mutex_clear(&pools->lock);
+    g_free(pools);
+}
@@ -0,0 +1,64 @@
+#ifndef META_POOL_H
+#define META_POOL_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+
+G_BEGIN_DECLS
+
+/* Occupancy of the NvDsBatchMeta element pools.
+ *
+ * A pool that runs out of empty elements allocates on acquire, which in
+ * a crowded scene happens inside nvinfer, the tracker or our own probes.
+ * nvstreammux creates a new batch meta for every batch with its own pool
+ * sizes, so the pools cannot be grown once up front; growing them on every
+ * batch would only move the allocations to the muxer thread. What is kept
+ * is the measurement, to see whether and where a scene outgrows them.
+ *
+ * meta_pools_mark_batch(), called where the batch meta is created (the
+ * muxer src pad), remembers the capacities the batch started with; it
+ * only reads them. meta_pools_observe_batch(), called downstream (the OSD
+ * sink pad), keeps high-water marks of num_full_elements /
+ * num_empty_elements and counts batches whose pools grew on the way.
+ * Published via pipeline_metrics:
+ *
+ *   ds_meta_pool_capacity{pool="obj"}
+ *   ds_meta_pool_full_high{pool="obj"}
+ *   ds_meta_pool_empty_high{pool="obj"}
+ *   ds_meta_pool_grown_total{pool="obj"}  */
+
+typedef enum {
+    META_POOL_FRAME,
+    META_POOL_OBJ,
+    META_POOL_CLASSIFIER,
+    META_POOL_DISPLAY,
+    META_POOL_USER,
+    META_POOL_LABEL_INFO,
+    META_POOL_COUNT
+} MetaPoolKind;
+
+typedef struct {
+    guint capacity;                     /* at the last observed batch */
+    guint full_high;
+    guint empty_high;
+    guint64 grown;                      /* batches the pool grew in between mark and observe */
+} MetaPoolStats;
+
+typedef struct _MetaPools MetaPools;
+
+MetaPools *meta_pools_new(void);
+
+/* Remembers the capacities of a new batch. */
+void meta_pools_mark_batch(MetaPools *pools, NvDsBatchMeta *batch_meta);
+
+void meta_pools_observe_batch(MetaPools *pools, NvDsBatchMeta *batch_meta);
+
+void meta_pools_get_stats(MetaPools *pools, MetaPoolKind kind, MetaPoolStats *stats);
+
+const gchar *meta_pool_name(MetaPoolKind kind);
+
+void meta_pools_free(MetaPools *pools);
+
+G_END_DECLS
+
+#endif
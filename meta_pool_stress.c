@@ -0,0 +1,87 @@
+/* Cost of on-demand pool growth (meta_pool.h): fills batches with
+ * --objects objects and one display meta per frame, as the probes of a
+ * crowded scene would, and reports the fill time per batch and how the
+ * pools grew, e.g.
+ *
+ *   ./meta_pool_stress_ --batch 4 --objects 1000 --batches 1000
+ *
+ * Every batch gets a new NvDsBatchMeta, as the muxer creates one per batch,
+ * so a pool sized below the scene grows again in every batch; "grew in"
+ * counts those batches and the fill time includes the allocations. */
+
+#include <stdio.h>
+#include "meta_pool.h"
+
+static gint opt_batch = 4;
+static gint opt_objects = 1000;
+static gint opt_batches = 1000;
+
+static GOptionEntry entries[] = {
+        {"batch", 'b', 0, G_OPTION_ARG_INT, &opt_batch, "Frames per batch (default 4)", "N"},
+        {"objects", 'o', 0, G_OPTION_ARG_INT, &opt_objects, "Objects per frame (default 1000)", "N"},
+        {"batches", 'n', 0, G_OPTION_ARG_INT, &opt_batches, "Batches to fill (default 1000)", "N"},
+        {NULL}
+};
+
+/* What the muxer, nvinfer and the OSD probe attach to a batch. */
+static void fill_batch(NvDsBatchMeta *batch_meta) {
+    for (gint f = 0; f < opt_batch; f++) {
+        NvDsFrameMeta *frame_meta = nvds_acquire_frame_meta_from_pool(batch_meta);
+        NvDsDisplayMeta *display_meta;
+        frame_meta->source_id = (guint) f;
+        frame_meta->batch_id = (guint) f;
+        nvds_add_frame_meta_to_batch(batch_meta, frame_meta);
+        for (gint o = 0; o < opt_objects; o++) {
+            NvDsObjectMeta *obj_meta = nvds_acquire_obj_meta_from_pool(batch_meta);
+            obj_meta->class_id = o % 4;
+            obj_meta->object_id = UNTRACKED_OBJECT_ID;
+            nvds_add_obj_meta_to_frame(frame_meta, obj_meta, NULL);
+        }
+        display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
+        nvds_add_display_meta_to_frame(frame_meta, display_meta);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("- measure batch meta pool growth");
+    GError *error = NULL;
+    MetaPools *pools;
+    gint64 start, fill_us = 0, worst_us = 0;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+    if (opt_batch < 1 || opt_objects < 0 || opt_batches < 1) {
+        g_printerr("--batch and --batches take at least 1\n");
+        return 1;
+    }
+
+    pools = meta_pools_new();
+    for (gint b = 0; b < opt_batches; b++) {
+        NvDsBatchMeta *batch_meta = nvds_create_batch_meta((guint) opt_batch);
+        gint64 us;
+
+        meta_pools_mark_batch(pools, batch_meta);
+        start = g_get_monotonic_time();
+        fill_batch(batch_meta);
+        us = g_get_monotonic_time() - start;
+        fill_us += us;
+        worst_us = MAX(worst_us, us);
+        meta_pools_observe_batch(pools, batch_meta);
+        nvds_destroy_batch_meta(batch_meta);
+    }
+
+    g_print("%d x %d objects: fill %.1f us/batch, worst %" G_GINT64_FORMAT " us\n", opt_batch, opt_objects,
+            (gdouble) fill_us / opt_batches, worst_us);
+    for (guint k = 0; k < META_POOL_COUNT; k++) {
+        MetaPoolStats stats;
+        meta_pools_get_stats(pools, k, &stats);
+        g_print("  %-10s capacity %6u  full high %6u  empty high %6u  grew in %" G_GUINT64_FORMAT " batches\n",
+                meta_pool_name(k), stats.capacity, stats.full_high, stats.empty_high, stats.grown);
+    }
+    meta_pools_free(pools);
+    return 0;
+}
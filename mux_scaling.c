@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include "mux_scaling.h"
+#include "pipeline_metrics.h"
+
+/* NV12 surfaces between decoder, muxer and nvinfer; nvinfer writes the
+ * network input as planar float RGB. */
+#define NV12_BYTES_PER_PIXEL 1.5
+#define NETWORK_BYTES_PER_PIXEL 12.0
+
+/* Parses "c;h;w[;order]". */
+static gboolean parse_dims(const gchar *text, NvDsInferNetworkInfo *info) {
+    guint c, h, w;
+
+    if (sscanf(text, "%u;%u;%u", &c, &h, &w) != 3 || !c || !h || !w)
+        return FALSE;
+    info->channels = c;
+    info->height = h;
+    info->width = w;
+    return TRUE;
+}
+
+/* Collects the first four "dim:" or "input_dim:" values of the prototxt,
+ * which describe the n, c, h, w input shape. */
+static gboolean parse_prototxt(const gchar *path, NvDsInferNetworkInfo *info) {
+    gchar *contents = NULL;
+    gchar **lines;
+    guint dims[4];
+    guint n = 0;
+
+    if (!g_file_get_contents(path, &contents, NULL, NULL))
+        return FALSE;
+    lines = g_strsplit(contents, "\n", -1);
+    for (guint i = 0; lines[i] && n < 4; i++) {
+        const gchar *line = g_strstrip(lines[i]);
+        if (sscanf(line, "dim: %u", &dims[n]) == 1 || sscanf(line, "input_dim: %u", &dims[n]) == 1)
+            n++;
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    if (n < 4 || !dims[1] || !dims[2] || !dims[3])
+        return FALSE;
+    info->channels = dims[1];
+    info->height = dims[2];
+    info->width = dims[3];
+    return TRUE;
+}
+
+gboolean mux_scaling_read_network_info(const gchar *pgie_config,
+                                       NvDsInferNetworkInfo *info, GError **error) {
+    static const gchar *dims_keys[] = {"infer-dims", "input-dims", "uff-input-dims"};
+    GKeyFile *key_file = g_key_file_new();
+    gboolean found = FALSE;
+    gchar *proto;
+
+    if (!g_key_file_load_from_file(key_file, pgie_config, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(key_file);
+        return FALSE;
+    }
+    for (guint i = 0; i < G_N_ELEMENTS(dims_keys) && !found; i++) {
+        gchar *text = g_key_file_get_string(key_file, "property", dims_keys[i], NULL);
+        if (text)
+            found = parse_dims(text, info);
+        g_free(text);
+    }
+    proto = found ? NULL : g_key_file_get_string(key_file, "property", "proto-file", NULL);
+    if (proto) {
+        gchar *path = proto;
+        if (!g_path_is_absolute(proto)) {
+            gchar *dir = g_path_get_dirname(pgie_config);
+            path = g_build_filename(dir, proto, NULL);
+            g_free(dir);
+        }
+        found = parse_prototxt(path, info);
+        if (path != proto)
+            g_free(path);
+        g_free(proto);
+    }
+    g_key_file_free(key_file);
+    if (!found)
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                    "%s: no network input size, set infer-dims=c;h;w", pgie_config);
+    return found;
+}
+
+/* Bytes read and written per frame of one source: scale the decoded frame
+ * into the muxer surface, then nvinfer reads that surface and writes the
+ * network input. */
+static gdouble bytes_per_frame(guint source_width, guint source_height,
+                               guint muxer_width, guint muxer_height,
+                               const NvDsInferNetworkInfo *network) {
+    gdouble source = (gdouble) source_width * source_height * NV12_BYTES_PER_PIXEL;
+    gdouble muxer = (gdouble) muxer_width * muxer_height * NV12_BYTES_PER_PIXEL;
+    gdouble input = (gdouble) network->width * network->height * NETWORK_BYTES_PER_PIXEL;
+
+    return source + 2 * muxer + input;
+}
+
+static void collect_mux_metrics(GString *out, gpointer user_data) {
+    MuxScaling *scaling = user_data;
+    const NvDsInferNetworkInfo *net = &scaling->network;
+
+    g_string_append_printf(out, "ds_mux_output_pixels %u\n", scaling->muxer_width * scaling->muxer_height);
+    for (guint i = 0; i < MUX_SCALING_MAX_SOURCES; i++) {
+        gint w = g_atomic_int_get(&scaling->source_width[i]);
+        gint h = g_atomic_int_get(&scaling->source_height[i]);
+        if (w <= 0 || h <= 0)
+            continue;
+        g_string_append_printf(out, "ds_mux_source_pixels{source=\"%u\"} %d\n", i, w * h);
+        if (!net->width)
+            continue;
+        g_string_append_printf(out, "ds_mux_bytes_per_frame{source=\"%u\",mode=\"fixed\"} %.0f\n", i,
+                               bytes_per_frame((guint) w, (guint) h, scaling->fixed_width,
+                                               scaling->fixed_height, net));
+        g_string_append_printf(out, "ds_mux_bytes_per_frame{source=\"%u\",mode=\"network\"} %.0f\n", i,
+                               bytes_per_frame((guint) w, (guint) h, net->width, net->height, net));
+    }
+}
+
+MuxScaling *mux_scaling_new(guint fixed_width, guint fixed_height,
+                            const NvDsInferNetworkInfo *network, gboolean network_resolution) {
+    MuxScaling *scaling = g_new0(MuxScaling, 1);
+
+    scaling->muxer_width = scaling->fixed_width = fixed_width;
+    scaling->muxer_height = scaling->fixed_height = fixed_height;
+    if (network)
+        scaling->network = *network;
+    if (network && network_resolution) {
+        scaling->network_resolution = TRUE;
+        scaling->muxer_width = network->width;
+        scaling->muxer_height = network->height;
+    }
+    metrics_register("mux", collect_mux_metrics, scaling);
+    return scaling;
+}
+
+void mux_scaling_free(MuxScaling *scaling) {
+    if (!scaling)
+        return;
+    metrics_unregister("mux");
+    g_free(scaling);
+}
+
+void mux_scaling_set_origin(MuxScaling *scaling, guint source_id, gint x, gint y) {
+    if (source_id >= MUX_SCALING_MAX_SOURCES)
+        return;
+    scaling->origin_x[source_id] = x;
+    scaling->origin_y[source_id] = y;
+}
+
+void mux_scaling_observe_batch(MuxScaling *scaling, NvDsBatchMeta *batch_meta) {
+    NvDsMetaList *l_frame;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        guint id = frame_meta->source_id;
+        if (id >= MUX_SCALING_MAX_SOURCES)
+            continue;
+        g_atomic_int_set(&scaling->source_width[id], (gint) frame_meta->source_frame_width);
+        g_atomic_int_set(&scaling->source_height[id], (gint) frame_meta->source_frame_height);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef MUX_SCALING_H
+#define MUX_SCALING_H
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+#include "nvdsinfer.h"
+
+G_BEGIN_DECLS
+
+/* Muxer output resolution and the mapping from muxer coordinates back to
+ * source pixels.
+ *
+ * By default nvstreammux scales every source to 1920x1080 and nvinfer then
+ * scales that frame again to the network input. In network resolution mode
+ * the muxer is configured with the network input size read from the pgie
+ * config, so every source is scaled exactly once and nvinfer only converts
+ * the color format. Either way nvinfer reports boxes in muxer coordinates;
+ * mux_scaling_rect_to_source() maps them to the frame the source delivered
+ * (source_frame_width/height of the frame meta), plus the offset of a crop
+ * applied before the muxer (ROI). */
+
+#define MUX_SCALING_MAX_SOURCES 256
+
+typedef struct {
+    guint muxer_width;
+    guint muxer_height;
+    guint fixed_width;
+    guint fixed_height;
+    gboolean network_resolution;
+    NvDsInferNetworkInfo network;
+    /* top left corner of a crop applied before the muxer, per source */
+    gint origin_x[MUX_SCALING_MAX_SOURCES];
+    gint origin_y[MUX_SCALING_MAX_SOURCES];
+    /* last source resolution seen, for the bandwidth metrics */
+    gint source_width[MUX_SCALING_MAX_SOURCES];
+    gint source_height[MUX_SCALING_MAX_SOURCES];
+} MuxScaling;
+
+/* Reads the network input size from an nvinfer config: infer-dims,
+ * input-dims or uff-input-dims (c;h;w), otherwise the input shape of the
+ * caffe proto-file. */
+gboolean mux_scaling_read_network_info(const gchar *pgie_config,
+                                       NvDsInferNetworkInfo *info, GError **error);
+
+/* The muxer runs at the network input size if `network_resolution` is set,
+ * at fixed_width x fixed_height otherwise. When `network` is known (may be
+ * NULL) the estimated bytes moved per frame for both modes are published
+ * through pipeline_metrics. */
+MuxScaling *mux_scaling_new(guint fixed_width, guint fixed_height,
+                            const NvDsInferNetworkInfo *network, gboolean network_resolution);
+
+void mux_scaling_free(MuxScaling *scaling);
+
+void mux_scaling_set_origin(MuxScaling *scaling, guint source_id, gint x, gint y);
+
+/* Records the source resolutions of the batch for the bandwidth metrics. */
+void mux_scaling_observe_batch(MuxScaling *scaling, NvDsBatchMeta *batch_meta);
+
+static inline void
+mux_scaling_rect_to_source(const MuxScaling *scaling, const NvDsFrameMeta *frame_meta,
+                           const NvOSD_RectParams *in, NvOSD_RectParams *out) {
+    guint id = frame_meta->source_id;
+    gfloat sx = 1.0f, sy = 1.0f;
+    gfloat ox = 0.0f, oy = 0.0f;
+
+    if (frame_meta->source_frame_width && frame_meta->source_frame_height) {
+        sx = (gfloat) frame_meta->source_frame_width / scaling->muxer_width;
+        sy = (gfloat) frame_meta->source_frame_height / scaling->muxer_height;
+    }
+    if (id < MUX_SCALING_MAX_SOURCES) {
+        ox = (gfloat) scaling->origin_x[id];
+        oy = (gfloat) scaling->origin_y[id];
+    }
+    out->left = in->left * sx + ox;
+    out->top = in->top * sy + oy;
+    out->width = in->width * sx;
+    out->height = in->height * sy;
+}
+
+G_END_DECLS
+
+#endif
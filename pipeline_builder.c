@@ -0,0 +1,344 @@
+#include <string.h>
+#include "pipeline_builder.h"
+#include "nvbufsurface.h"
+#include "batch_tiler.h"
+#include "encode_output.h"
+
+/* Everything that differs between Jetson and dGPU. */
+#ifdef PLATFORM_TEGRA
+/* nveglglessink takes EGLImages; surfaces are CPU mapped anyway */
+#define RENDER_TRANSFORM_FACTORY "nvegltransform"
+#define CPU_ACCESS_MEMORY_TYPE (-1)
+#else
+#define RENDER_TRANSFORM_FACTORY NULL
+#define CPU_ACCESS_MEMORY_TYPE NVBUF_MEM_CUDA_UNIFIED
+#endif
+
+#define PIPELINE_MAX_ELEMENTS 8
+
+typedef struct {
+    const PipelineDesc *desc;
+    GstElement **slot;
+    const gchar *factory;
+    const gchar *name;
+    GstElement *(*make)(const PipelineDesc *desc, const gchar *branch);  /* instead of the factory */
+    const gchar *branch;        /* the inference branch the element belongs to */
+    GThread *thread;
+    gint64 us;
+} ElementJob;
+
+static GstElement *make_tiler(const PipelineDesc *desc, const gchar *branch) {
+    return batch_tiler_new("batch-tiler", branch, desc->tiler_width, desc->tiler_height, 0);
+}
+
+static GstElement *make_encoder(const PipelineDesc *desc, const gchar *branch) {
+    return create_encode_output_bin(desc->sink_location, desc->encode_bitrate);
+}
+
+static void add_job(ElementJob *jobs, guint *num_jobs, const PipelineDesc *desc, GstElement **slot,
+                    const gchar *factory, const gchar *name,
+                    GstElement *(*make)(const PipelineDesc *, const gchar *)) {
+    ElementJob *job = &jobs[(*num_jobs)++];
+
+    memset(job, 0, sizeof(*job));
+    job->desc = desc;
+    job->slot = slot;
+    job->factory = factory;
+    job->name = name;
+    job->make = make;
+}
+
+static gpointer create_element(gpointer data) {
+    ElementJob *job = data;
+    gint64 start = g_get_monotonic_time();
+
+    *job->slot = job->make ? job->make(job->desc, job->branch) : gst_element_factory_make(job->factory, job->name);
+    job->us = g_get_monotonic_time() - start;
+    return NULL;
+}
+
+/* The inference chain `name`, in link order. */
+static guint plan_branch(const PipelineDesc *desc, PipelineBranch *branch, const gchar *name, ElementJob *jobs,
+                         guint n) {
+    guint first = n;
+
+    add_job(jobs, &n, desc, &branch->pgie, "nvinfer", "primary-nvinference-engine", NULL);
+    if (desc->tracker)
+        add_job(jobs, &n, desc, &branch->tracker, "nvtracker", "tracker", NULL);
+    /* an offline replay into a fakesink draws boxes nobody sees */
+    if (!desc->offline || desc->sink != PIPELINE_SINK_FAKE) {
+        add_job(jobs, &n, desc, &branch->nvvidconv, "nvvideoconvert", "nvvideo-converter", NULL);
+        add_job(jobs, &n, desc, &branch->nvosd, "nvdsosd", "nv-onscreendisplay", NULL);
+    }
+    if (desc->use_tiler)
+        add_job(jobs, &n, desc, &branch->tiler, "nvmultistreamtiler", "batch-tiler", make_tiler);
+    for (guint i = first; i < n; i++)
+        jobs[i].branch = name;
+    return n;
+}
+
+/* A standby, or one engine per batch size. */
+static guint num_selected_branches(const PipelineDesc *desc) {
+    return desc->standby ? 2 : desc->num_batch_sizes > 1 ? desc->num_batch_sizes : 0;
+}
+
+/* Elements of the graph, in link order. Selected branches are built
+ * separately and go between the two selectors. */
+static guint plan(const PipelineDesc *desc, PipelineGraph *graph, ElementJob *jobs) {
+    guint n = 0;
+
+    add_job(jobs, &n, desc, &graph->streammux, "nvstreammux", "stream-muxer", NULL);
+    if (num_selected_branches(desc)) {
+        add_job(jobs, &n, desc, &graph->branch_select, "output-selector", "branch-select", NULL);
+        add_job(jobs, &n, desc, &graph->branch_merge, "input-selector", "branch-merge", NULL);
+    } else if (desc->infer) {
+        graph->num_branches = 1;
+        graph->branches[0].batch_size = desc->num_batch_sizes ? desc->batch_sizes[0] : 0;
+        n = plan_branch(desc, &graph->branches[0], "main", jobs, n);
+    }
+    switch (desc->sink) {
+        case PIPELINE_SINK_FAKE:
+            add_job(jobs, &n, desc, &graph->sink, "fakesink", "fake-sink", NULL);
+            break;
+        case PIPELINE_SINK_ENCODE:
+            add_job(jobs, &n, desc, &graph->sink, "encoder", "encode-output", make_encoder);
+            break;
+        default:
+            if (RENDER_TRANSFORM_FACTORY)
+                add_job(jobs, &n, desc, &graph->transform, RENDER_TRANSFORM_FACTORY, "nvegl-transform", NULL);
+            add_job(jobs, &n, desc, &graph->sink, "nveglglessink", "nvvideo-renderer", NULL);
+            break;
+    }
+    return n;
+}
+
+/* Creates every job's element in its own thread. On failure none is
+ * left. */
+static gboolean create_elements(ElementJob *jobs, guint num_jobs, StartupTimes *times, GError **error) {
+    ElementJob *failed = NULL;
+
+    /* Jobs finish in any order; the slots keep link order. */
+    for (guint i = 0; i < num_jobs; i++)
+        jobs[i].thread = g_thread_new("create", create_element, &jobs[i]);
+    for (guint i = 0; i < num_jobs; i++) {
+        g_thread_join(jobs[i].thread);
+        if (times)
+            startup_times_add(times, jobs[i].name, "create", jobs[i].us);
+        if (!*jobs[i].slot && !failed)
+            failed = &jobs[i];
+    }
+    if (!failed)
+        return TRUE;
+    g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN, "%s (%s) could not be created",
+                failed->name, failed->factory);
+    for (guint i = 0; i < num_jobs; i++) {
+        if (*jobs[i].slot)
+            gst_object_unref(*jobs[i].slot);
+        *jobs[i].slot = NULL;
+    }
+    return FALSE;
+}
+
+static void configure_branch(const PipelineDesc *desc, PipelineBranch *branch) {
+    g_object_set(G_OBJECT (branch->pgie), "config-file-path", desc->pgie_config, NULL);
+    /* after the config file, which sets them too */
+    if (branch->batch_size)
+        g_object_set(G_OBJECT (branch->pgie), "batch-size", branch->batch_size, NULL);
+    if (branch->batch_size && desc->engine_pattern) {
+        gchar *engine = g_strdup_printf(desc->engine_pattern, branch->batch_size);
+        g_object_set(G_OBJECT (branch->pgie), "model-engine-file", engine, NULL);
+        g_free(engine);
+    }
+    if (branch->tracker)
+        g_object_set(G_OBJECT (branch->tracker), "ll-lib-file", desc->tracker_lib,
+                     "tracker-width", desc->tracker_width, "tracker-height", desc->tracker_height, NULL);
+}
+
+static void configure(const PipelineDesc *desc, PipelineGraph *graph) {
+    g_object_set(G_OBJECT (graph->streammux), "width", desc->output_width, "height", desc->output_height,
+                 "batch-size", desc->batch_size, "batched-push-timeout", desc->batched_push_timeout, NULL);
+    /* live sources set it as they are added */
+    if (desc->live_source)
+        g_object_set(G_OBJECT (graph->streammux), "live-source", TRUE, NULL);
+    if (desc->cpu_access && CPU_ACCESS_MEMORY_TYPE >= 0)
+        g_object_set(G_OBJECT (graph->streammux), "nvbuf-memory-type", CPU_ACCESS_MEMORY_TYPE, NULL);
+    if (graph->num_branches == 1)
+        configure_branch(desc, &graph->branches[0]);
+    /* the standby never gets a buffer, it must not hold up the active one */
+    if (graph->branch_merge)
+        g_object_set(G_OBJECT (graph->branch_merge), "sync-streams", FALSE, NULL);
+    if (desc->sink == PIPELINE_SINK_FAKE)
+        g_object_set(G_OBJECT (graph->sink), "sync", FALSE, "async", FALSE, NULL);
+}
+
+gboolean pipeline_branch_build(PipelineBranch *branch, const PipelineDesc *desc, const gchar *name,
+                               guint batch_size, StartupTimes *times, GError **error) {
+    ElementJob jobs[PIPELINE_MAX_ELEMENTS];
+    guint num_jobs;
+    GstElement *queue;
+    GstPad *pad;
+    gboolean linked;
+
+    memset(branch, 0, sizeof(*branch));
+    branch->batch_size = batch_size;
+    num_jobs = plan_branch(desc, branch, name, jobs, 0);
+    if (!create_elements(jobs, num_jobs, times, error)) {
+        g_prefix_error(error, "%s: ", name);
+        return FALSE;
+    }
+    configure_branch(desc, branch);
+
+    /* The queue gives the branch its own streaming thread, so an error
+     * in it reaches the bus before the flow return reaches the muxer. */
+    branch->bin = gst_bin_new(name);
+    queue = gst_element_factory_make("queue", "branch-queue");
+    gst_bin_add(GST_BIN (branch->bin), queue);
+    linked = TRUE;
+    for (guint i = 0; i < num_jobs; i++) {
+        gst_bin_add(GST_BIN (branch->bin), *jobs[i].slot);
+        linked = linked && gst_element_link(i ? *jobs[i - 1].slot : queue, *jobs[i].slot);
+    }
+    if (!linked) {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION, "%s could not be linked", name);
+        gst_object_unref(branch->bin);
+        memset(branch, 0, sizeof(*branch));
+        return FALSE;
+    }
+    pad = gst_element_get_static_pad(queue, "sink");
+    gst_element_add_pad(branch->bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(*jobs[num_jobs - 1].slot, "src");
+    gst_element_add_pad(branch->bin, gst_ghost_pad_new("src", pad));
+    gst_object_unref(pad);
+    return TRUE;
+}
+
+/* The selector pad peered with a branch's ghost pad, with a reference. */
+static GstPad *branch_peer(PipelineBranch *branch, const gchar *ghost) {
+    GstPad *pad = gst_element_get_static_pad(branch->bin, ghost);
+    GstPad *peer = gst_pad_get_peer(pad);
+
+    gst_object_unref(pad);
+    return peer;
+}
+
+gboolean pipeline_branch_attach(PipelineGraph *graph, PipelineBranch *branch) {
+    gst_bin_add(GST_BIN (graph->pipeline), branch->bin);
+    return gst_element_link(graph->branch_select, branch->bin) && gst_element_link(branch->bin, graph->branch_merge);
+}
+
+void pipeline_branch_route(PipelineGraph *graph, PipelineBranch *branch) {
+    GstPad *select_pad = branch_peer(branch, "sink");
+
+    g_object_set(G_OBJECT (graph->branch_select), "active-pad", select_pad, NULL);
+    gst_object_unref(select_pad);
+}
+
+void pipeline_branch_merge(PipelineGraph *graph, PipelineBranch *branch) {
+    GstPad *merge_pad = branch_peer(branch, "src");
+
+    g_object_set(G_OBJECT (graph->branch_merge), "active-pad", merge_pad, NULL);
+    gst_object_unref(merge_pad);
+}
+
+void pipeline_branch_select(PipelineGraph *graph, PipelineBranch *branch) {
+    pipeline_branch_route(graph, branch);
+    pipeline_branch_merge(graph, branch);
+}
+
+void pipeline_branch_detach(PipelineGraph *graph, PipelineBranch *branch) {
+    GstPad *select_pad = branch_peer(branch, "sink"), *merge_pad = branch_peer(branch, "src");
+
+    gst_element_set_state(branch->bin, GST_STATE_NULL);
+    if (select_pad) {
+        gst_element_release_request_pad(graph->branch_select, select_pad);
+        gst_object_unref(select_pad);
+    }
+    if (merge_pad) {
+        gst_element_release_request_pad(graph->branch_merge, merge_pad);
+        gst_object_unref(merge_pad);
+    }
+    if (GST_OBJECT_PARENT (branch->bin))
+        gst_bin_remove(GST_BIN (graph->pipeline), branch->bin);
+    else
+        gst_object_unref(branch->bin);
+    memset(branch, 0, sizeof(*branch));
+}
+
+gboolean pipeline_graph_build(PipelineGraph *graph, const PipelineDesc *desc, StageQueues *stage_queues,
+                              StartupTimes *times, GError **error) {
+    ElementJob jobs[PIPELINE_MAX_ELEMENTS];
+    guint num_jobs, selected;
+    gboolean linked = TRUE;
+
+    memset(graph, 0, sizeof(*graph));
+    num_jobs = plan(desc, graph, jobs);
+    if (!create_elements(jobs, num_jobs, times, error)) {
+        memset(graph, 0, sizeof(*graph));
+        return FALSE;
+    }
+    selected = num_selected_branches(desc);
+    for (guint i = 0; i < selected; i++) {
+        gchar name[32];
+        guint batch_size = desc->standby ? (desc->num_batch_sizes ? desc->batch_sizes[0] : 0) : desc->batch_sizes[i];
+        if (desc->standby)
+            g_snprintf(name, sizeof(name), "infer-branch-%u", i);
+        else
+            g_snprintf(name, sizeof(name), "infer-b%u", batch_size);
+        if (!pipeline_branch_build(&graph->branches[i], desc, name, batch_size, times, error))
+            break;
+        graph->num_branches++;
+    }
+    graph->pipeline = gst_pipeline_new("dstest1-pipeline");
+    startup_times_phase(times, "create");
+    if (!graph->pipeline || graph->num_branches < selected) {
+        if (!graph->pipeline)
+            g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN, "pipeline could not be created");
+        for (guint i = 0; i < num_jobs; i++)
+            gst_object_unref(*jobs[i].slot);
+        for (guint i = 0; selected && i < graph->num_branches; i++)
+            gst_object_unref(graph->branches[i].bin);
+        if (graph->pipeline)
+            gst_object_unref(graph->pipeline);
+        memset(graph, 0, sizeof(*graph));
+        return FALSE;
+    }
+
+    configure(desc, graph);
+    startup_times_phase(times, "configure");
+
+    /* With stage queues every element after the muxer runs in its own
+     * streaming thread instead of serializing behind the muxer's. */
+    for (guint i = 0; i < num_jobs; i++)
+        gst_bin_add(GST_BIN (graph->pipeline), *jobs[i].slot);
+    for (guint i = 1; i < num_jobs && linked; i++) {
+        GstElement *prev = *jobs[i - 1].slot, *next = *jobs[i].slot;
+        /* the branches go in between */
+        if (prev == graph->branch_select)
+            continue;
+        linked = stage_queues ? stage_queues_link_many(stage_queues, GST_BIN (graph->pipeline), prev, next, NULL)
+                              : gst_element_link(prev, next);
+        if (!linked)
+            g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION, "%s could not be linked to %s",
+                        jobs[i - 1].name, jobs[i].name);
+    }
+    for (guint i = 0; i < graph->num_branches && linked && selected; i++) {
+        linked = pipeline_branch_attach(graph, &graph->branches[i]);
+        if (!linked)
+            g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION, "%s could not be linked",
+                        GST_OBJECT_NAME (graph->branches[i].bin));
+    }
+    if (linked && selected)
+        pipeline_branch_select(graph, &graph->branches[0]);
+    startup_times_phase(times, "link");
+    if (!linked) {
+        /* the pipeline only owns the branches already attached */
+        for (guint i = 0; i < graph->num_branches && selected; i++) {
+            if (!GST_OBJECT_PARENT (graph->branches[i].bin))
+                gst_object_unref(graph->branches[i].bin);
+        }
+        gst_object_unref(graph->pipeline);
+        memset(graph, 0, sizeof(*graph));
+    }
+    return linked;
+}
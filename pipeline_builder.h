@@ -0,0 +1,82 @@
+#ifndef PIPELINE_BUILDER_H
+#define PIPELINE_BUILDER_H
+
+#include <gst/gst.h>
+#include "pipeline_desc.h"
+#include "stage_queue.h"
+#include "startup_times.h"
+
+G_BEGIN_DECLS
+
+/* Builds the graph of a validated PipelineDesc in one pass:
+ *
+ *   nvstreammux -> [nvinfer -> [nvtracker] -> nvvideoconvert -> nvdsosd -> [tiler]]
+ *               -> [nvegltransform] -> nveglglessink | encoder bin | fakesink
+ *
+ * Every element is created in its own thread (loading a plugin and the
+ * class init of the CUDA elements dominate), then configured, added and
+ * linked, through stage queues when given. The time of every creation and
+ * of each phase goes to `times`. Sources are added to the muxer later,
+ * see source_set.h.
+ *
+ * With a standby (see infer_standby.h) the inference chain is built twice,
+ * and with several batch sizes once per size (see batch_controller.h),
+ * each copy in a bin behind its own queue. The muxer feeds them through
+ * an output-selector while an input-selector picks the one that reaches the
+ * sink:
+ *
+ *   nvstreammux -> output-selector -> infer-branch-0 -> input-selector -> sink
+ *                                  -> infer-branch-1 -> */
+
+#define PIPELINE_MAX_BRANCHES PIPELINE_MAX_BATCH_SIZES
+
+typedef struct {
+    GstElement *bin;            /* queue -> pgie -> ... -> [tiler]; NULL unless selected */
+    guint batch_size;           /* the pgie's, 0: the config file's */
+    GstElement *pgie;
+    GstElement *tracker;
+    GstElement *nvvidconv;      /* NULL offline into a fakesink */
+    GstElement *nvosd;          /* NULL offline into a fakesink */
+    GstElement *tiler;
+} PipelineBranch;
+
+typedef struct {
+    GstElement *pipeline;
+    GstElement *streammux;
+    PipelineBranch branches[PIPELINE_MAX_BRANCHES];    /* as built, [0] selected */
+    guint num_branches;         /* 0 without inference */
+    GstElement *branch_select;  /* output-selector, selected branches only */
+    GstElement *branch_merge;   /* input-selector */
+    GstElement *transform;      /* Tegra renderer only */
+    GstElement *sink;
+} PipelineGraph;
+
+/* On failure nothing is left behind and `graph` is cleared. */
+gboolean pipeline_graph_build(PipelineGraph *graph, const PipelineDesc *desc, StageQueues *stage_queues,
+                              StartupTimes *times, GError **error);
+
+/* A standalone inference chain named `name`, for the selectors, with the
+ * engine for `batch_size` (0: as configured). `times` may be NULL. */
+gboolean pipeline_branch_build(PipelineBranch *branch, const PipelineDesc *desc, const gchar *name,
+                               guint batch_size, StartupTimes *times, GError **error);
+
+/* Adds a built branch to the pipeline between the selectors. It stays in
+ * NULL state; on failure detach it. */
+gboolean pipeline_branch_attach(PipelineGraph *graph, PipelineBranch *branch);
+
+/* Routes batches through `branch` and its output to the sink. */
+void pipeline_branch_select(PipelineGraph *graph, PipelineBranch *branch);
+
+/* The two halves of pipeline_branch_select(): the output-selector feeding
+ * `branch`, and the input-selector passing its output on (dropping the
+ * other branches'). */
+void pipeline_branch_route(PipelineGraph *graph, PipelineBranch *branch);
+void pipeline_branch_merge(PipelineGraph *graph, PipelineBranch *branch);
+
+/* Stops the branch, releases its selector pads and drops it; clears
+ * `branch`. */
+void pipeline_branch_detach(PipelineGraph *graph, PipelineBranch *branch);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,344 @@
+#include <string.h>
+#include "pipeline_desc.h"
+#include "mux_scaling.h"
+#include "source_bin.h"
+
+#define DEFAULT_PGIE_CONFIG "dstest1_pgie_config.txt"
+#define DEFAULT_TRACKER_LIB "/opt/nvidia/deepstream/deepstream-4.0/lib/libnvds_mot_klt.so"
+/* files decoded at a time in an offline replay without max-sources */
+#define DEFAULT_OFFLINE_SOURCES 8
+#define DEFAULT_LATENCY_SLO_MS 100
+
+static const gchar *sink_names[] = {"render", "encode", "fake"};
+
+const gchar *pipeline_sink_type_name(PipelineSinkType type) {
+    return sink_names[type];
+}
+
+PipelineDesc *pipeline_desc_new(void) {
+    PipelineDesc *desc = g_new0(PipelineDesc, 1);
+
+    desc->uris = g_ptr_array_new_with_free_func(g_free);
+    /* The muxer output resolution must be set if the input streams will be
+     * of different resolution. */
+    desc->muxer_width = 1920;
+    desc->muxer_height = 1080;
+    /* Should ideally be set based on the fastest source's framerate. */
+    desc->batched_push_timeout = 4000000;
+    desc->infer = TRUE;
+    desc->pgie_config = g_strdup(DEFAULT_PGIE_CONFIG);
+    desc->latency_slo_ms = DEFAULT_LATENCY_SLO_MS;
+    /* the usual tracker input size */
+    desc->tracker_lib = g_strdup(DEFAULT_TRACKER_LIB);
+    desc->tracker_width = 640;
+    desc->tracker_height = 384;
+    desc->sink = PIPELINE_SINK_RENDER;
+    desc->encode_bitrate = 4000;
+    desc->tiler_width = 1280;
+    desc->tiler_height = 720;
+    return desc;
+}
+
+/* Setters for keys that may be missing; a present key with a bad value
+ * is an error. */
+static gboolean load_uint(GKeyFile *key_file, const gchar *group, const gchar *key, guint *value, GError **error) {
+    GError *local = NULL;
+    gint v;
+
+    if (!g_key_file_has_key(key_file, group, key, NULL))
+        return TRUE;
+    v = g_key_file_get_integer(key_file, group, key, &local);
+    if (local) {
+        g_propagate_prefixed_error(error, local, "[%s] ", group);
+        return FALSE;
+    }
+    if (v < 0) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE, "[%s] %s must not be negative",
+                    group, key);
+        return FALSE;
+    }
+    *value = (guint) v;
+    return TRUE;
+}
+
+static gboolean load_bool(GKeyFile *key_file, const gchar *group, const gchar *key, gboolean *value,
+                          GError **error) {
+    GError *local = NULL;
+    gboolean v;
+
+    if (!g_key_file_has_key(key_file, group, key, NULL))
+        return TRUE;
+    v = g_key_file_get_boolean(key_file, group, key, &local);
+    if (local) {
+        g_propagate_prefixed_error(error, local, "[%s] ", group);
+        return FALSE;
+    }
+    *value = v;
+    return TRUE;
+}
+
+static void load_string(GKeyFile *key_file, const gchar *group, const gchar *key, gchar **value) {
+    gchar *v = g_key_file_get_string(key_file, group, key, NULL);
+
+    if (!v)
+        return;
+    g_free(*value);
+    *value = *g_strstrip(v) ? v : NULL;
+    if (!*value)
+        g_free(v);
+}
+
+gboolean pipeline_desc_set_batch_sizes(PipelineDesc *desc, const gchar *list, GError **error) {
+    gchar **sizes = g_strsplit_set(list, ",;", -1);
+    guint n = 0;
+    gboolean ok = TRUE;
+
+    for (gchar **size = sizes; *size && ok; size++) {
+        gchar *end;
+        guint64 v;
+        if (!*g_strstrip(*size))
+            continue;
+        v = g_ascii_strtoull(*size, &end, 10);
+        ok = *end == '\0' && v > 0 && v <= MUX_SCALING_MAX_SOURCES && n < PIPELINE_MAX_BATCH_SIZES
+             && (n == 0 || v > desc->batch_sizes[n - 1]);
+        if (ok)
+            desc->batch_sizes[n++] = (guint) v;
+    }
+    g_strfreev(sizes);
+    if (!ok || n == 0) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "batch sizes \"%s\": up to %d ascending sizes from 1 to %d", list, PIPELINE_MAX_BATCH_SIZES,
+                    MUX_SCALING_MAX_SOURCES);
+        return FALSE;
+    }
+    desc->num_batch_sizes = n;
+    return TRUE;
+}
+
+/* uri0, uri1, ... without gaps. */
+static gboolean load_uris(GKeyFile *key_file, PipelineDesc *desc, GError **error) {
+    gchar **keys = g_key_file_get_keys(key_file, "sources", NULL, NULL);
+    guint num_uris = 0;
+
+    for (gchar **k = keys; k && *k; k++) {
+        if (g_str_has_prefix(*k, "uri"))
+            num_uris++;
+    }
+    g_strfreev(keys);
+    for (guint i = 0; i < num_uris; i++) {
+        gchar key[16];
+        gchar *uri;
+        g_snprintf(key, sizeof(key), "uri%u", i);
+        uri = g_key_file_get_string(key_file, "sources", key, NULL);
+        if (!uri) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                        "[sources] %s missing, uris are numbered from 0", key);
+            return FALSE;
+        }
+        g_ptr_array_add(desc->uris, g_strstrip(uri));
+    }
+    return TRUE;
+}
+
+gboolean pipeline_desc_load(PipelineDesc *desc, const gchar *path, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    gchar *sink = NULL, *batch_sizes = NULL;
+    gboolean ok;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(key_file);
+        return FALSE;
+    }
+    ok = load_uris(key_file, desc, error)
+         && load_uint(key_file, "sources", "max-sources", &desc->max_sources, error)
+         && load_bool(key_file, "sources", "offline", &desc->offline, error)
+         && load_uint(key_file, "streammux", "width", &desc->muxer_width, error)
+         && load_uint(key_file, "streammux", "height", &desc->muxer_height, error)
+         && load_bool(key_file, "streammux", "network-res", &desc->mux_network_res, error)
+         && load_uint(key_file, "streammux", "batched-push-timeout", &desc->batched_push_timeout, error)
+         && load_bool(key_file, "streammux", "live-source", &desc->live_source, error)
+         && load_bool(key_file, "primary-gie", "enable", &desc->infer, error)
+         && load_bool(key_file, "primary-gie", "standby", &desc->standby, error)
+         && load_uint(key_file, "primary-gie", "latency-slo-ms", &desc->latency_slo_ms, error)
+         && load_bool(key_file, "tracker", "enable", &desc->tracker, error)
+         && load_uint(key_file, "tracker", "tracker-width", &desc->tracker_width, error)
+         && load_uint(key_file, "tracker", "tracker-height", &desc->tracker_height, error)
+         && load_uint(key_file, "sink", "bitrate", &desc->encode_bitrate, error)
+         && load_uint(key_file, "sink", "tiler-width", &desc->tiler_width, error)
+         && load_uint(key_file, "sink", "tiler-height", &desc->tiler_height, error);
+    if (ok) {
+        load_string(key_file, "primary-gie", "config-file", &desc->pgie_config);
+        load_string(key_file, "primary-gie", "model-engine-pattern", &desc->engine_pattern);
+        load_string(key_file, "primary-gie", "batch-sizes", &batch_sizes);
+        load_string(key_file, "tracker", "ll-lib-file", &desc->tracker_lib);
+        load_string(key_file, "analytics", "config-file", &desc->analytics_config);
+        load_string(key_file, "analytics", "roi-config-file", &desc->roi_config);
+        load_string(key_file, "sink", "location", &desc->sink_location);
+        load_string(key_file, "sink", "type", &sink);
+    }
+    if (ok && sink) {
+        guint i;
+        for (i = 0; i < G_N_ELEMENTS (sink_names) && strcmp(sink, sink_names[i]) != 0; i++);
+        if (i == G_N_ELEMENTS (sink_names)) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "[sink] type is render, encode or fake, not \"%s\"", sink);
+            ok = FALSE;
+        } else {
+            desc->sink = (PipelineSinkType) i;
+        }
+    }
+    if (ok && batch_sizes) {
+        ok = pipeline_desc_set_batch_sizes(desc, batch_sizes, error);
+        if (!ok)
+            g_prefix_error(error, "[primary-gie] ");
+    }
+    g_free(sink);
+    g_free(batch_sizes);
+    g_key_file_free(key_file);
+    if (!ok)
+        g_prefix_error(error, "%s: ", path);
+    return ok;
+}
+
+static gboolean check_file(const gchar *what, const gchar *path, GError **error) {
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+        return TRUE;
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "%s %s not found", what, path);
+    return FALSE;
+}
+
+gboolean pipeline_desc_validate(PipelineDesc *desc, GError **error) {
+    /* Offline the files queue up for a batch slot, and nothing waits on
+     * the clock or the display. */
+    if (desc->offline) {
+        for (guint i = 0; i < desc->uris->len; i++) {
+            if (source_uri_is_live(g_ptr_array_index(desc->uris, i))) {
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "offline replay takes files, %s is live",
+                            (const gchar *) g_ptr_array_index(desc->uris, i));
+                return FALSE;
+            }
+        }
+        if (desc->max_sources == 0)
+            desc->max_sources = DEFAULT_OFFLINE_SOURCES;
+        desc->max_sources = MIN(desc->max_sources, MAX(desc->uris->len, 1));
+        desc->live_source = FALSE;
+        if (desc->sink == PIPELINE_SINK_RENDER)
+            desc->sink = PIPELINE_SINK_FAKE;
+        desc->batch_size = desc->max_sources;
+    } else {
+        desc->batch_size = MAX(desc->uris->len, desc->max_sources);
+    }
+    if (desc->batch_size == 0) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "no sources, and no max-sources to add them later");
+        return FALSE;
+    }
+    if (desc->batch_size > MUX_SCALING_MAX_SOURCES) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%u sources, at most %d supported",
+                    desc->batch_size, MUX_SCALING_MAX_SOURCES);
+        return FALSE;
+    }
+    if (desc->muxer_width < 2 || desc->muxer_height < 2) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "muxer size %ux%u too small",
+                    desc->muxer_width, desc->muxer_height);
+        return FALSE;
+    }
+
+    /* The network size is only required to mux at it; otherwise it just
+     * feeds the bandwidth comparison in the metrics. */
+    if (desc->infer || desc->mux_network_res) {
+        if (!desc->pgie_config) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "[primary-gie] needs a config-file");
+            return FALSE;
+        }
+        if (!check_file("pgie config", desc->pgie_config, error))
+            return FALSE;
+    }
+    desc->have_network_info = desc->pgie_config &&
+            mux_scaling_read_network_info(desc->pgie_config, &desc->network_info,
+                                          desc->mux_network_res ? error : NULL);
+    if (desc->mux_network_res && !desc->have_network_info)
+        return FALSE;
+    desc->output_width = desc->mux_network_res ? desc->network_info.width : desc->muxer_width;
+    desc->output_height = desc->mux_network_res ? desc->network_info.height : desc->muxer_height;
+
+    /* line and zone analytics count tracked objects */
+    if (desc->analytics_config) {
+        if (!check_file("analytics config", desc->analytics_config, error))
+            return FALSE;
+        desc->tracker = TRUE;
+    }
+    if (desc->roi_config && !check_file("ROI config", desc->roi_config, error))
+        return FALSE;
+    if (!desc->infer && desc->standby) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "a standby needs [primary-gie] enabled");
+        return FALSE;
+    }
+    if (desc->num_batch_sizes > 1) {
+        if (!desc->infer || desc->standby) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "several batch sizes need [primary-gie] enabled and no standby");
+            return FALSE;
+        }
+        if (desc->latency_slo_ms == 0) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "several batch sizes need a latency-slo-ms");
+            return FALSE;
+        }
+    }
+    /* the only conversion in it is a single %u */
+    if (desc->engine_pattern) {
+        const gchar *conversion = strchr(desc->engine_pattern, '%');
+        if (!conversion || conversion[1] != 'u' || strchr(conversion + 2, '%') || desc->num_batch_sizes == 0) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                        "model-engine-pattern %s needs one %%u for the batch size, and batch-sizes",
+                        desc->engine_pattern);
+            return FALSE;
+        }
+        for (guint i = 0; i < desc->num_batch_sizes; i++) {
+            gchar *engine = g_strdup_printf(desc->engine_pattern, desc->batch_sizes[i]);
+            gboolean found = check_file("engine", engine, error);
+            g_free(engine);
+            if (!found)
+                return FALSE;
+        }
+    }
+    if (!desc->infer && desc->tracker) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "the tracker and analytics need [primary-gie] enabled");
+        return FALSE;
+    }
+    if (desc->tracker) {
+        if (!desc->tracker_lib || !check_file("tracker library", desc->tracker_lib, error))
+            return FALSE;
+        if (desc->tracker_width == 0 || desc->tracker_height == 0) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "tracker size %ux%u invalid",
+                        desc->tracker_width, desc->tracker_height);
+            return FALSE;
+        }
+    }
+
+    if (desc->sink == PIPELINE_SINK_ENCODE && !desc->sink_location) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "the encode sink needs a location");
+        return FALSE;
+    }
+    /* the renderer shows a single surface, so several sources are
+     * composited into one grid first; nobody looks at a fakesink */
+    desc->use_tiler = desc->batch_size > 1 && desc->infer && desc->sink != PIPELINE_SINK_FAKE;
+    if (desc->use_tiler && (desc->tiler_width < 2 || desc->tiler_height < 2)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "tiler size %ux%u too small",
+                    desc->tiler_width, desc->tiler_height);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void pipeline_desc_free(PipelineDesc *desc) {
+    if (!desc)
+        return;
+    g_ptr_array_free(desc->uris, TRUE);
+    g_free(desc->pgie_config);
+    g_free(desc->engine_pattern);
+    g_free(desc->tracker_lib);
+    g_free(desc->analytics_config);
+    g_free(desc->roi_config);
+    g_free(desc->sink_location);
+    g_free(desc);
+}
@@ -0,0 +1,90 @@
+#ifndef PIPELINE_DESC_H
+#define PIPELINE_DESC_H
+
+#include <gst/gst.h>
+#include "nvdsinfer.h"
+
+G_BEGIN_DECLS
+
+/* Declarative description of the pipeline topology, see
+ * dstest1_pipeline.txt:
+ *
+ *   [sources]       uri0, uri1, ..., max-sources, offline
+ *   [streammux]     width, height, network-res, batched-push-timeout, live-source
+ *   [primary-gie]   enable, config-file, standby, batch-sizes, model-engine-pattern, latency-slo-ms
+ *   [tracker]       enable, ll-lib-file, tracker-width, tracker-height
+ *   [analytics]     config-file (lines and zones, needs the tracker), roi-config-file
+ *   [sink]          type (render, encode, fake), location, bitrate, tiler-width, tiler-height
+ *
+ * Command line options are applied on top of the file. pipeline_desc_validate()
+ * checks the whole description before anything is created and fills in
+ * the derived values the builder and the probes need. */
+
+/* Engines to choose from at runtime, see batch_controller.h. */
+#define PIPELINE_MAX_BATCH_SIZES 4
+
+typedef enum {
+    PIPELINE_SINK_RENDER,
+    PIPELINE_SINK_ENCODE,
+    PIPELINE_SINK_FAKE
+} PipelineSinkType;
+
+typedef struct {
+    GPtrArray *uris;                /* gchar *, source i plays uris[i] */
+    guint max_sources;              /* batch size for sources added later, 0: number of uris */
+    gboolean offline;               /* replay files unsynced, max_sources at a time */
+
+    guint muxer_width;              /* fixed muxer output size */
+    guint muxer_height;
+    gboolean mux_network_res;       /* scale to the pgie input size instead */
+    guint batched_push_timeout;     /* us */
+    gboolean live_source;
+    gboolean cpu_access;            /* batches are read on the CPU (ingest) */
+
+    gboolean infer;                 /* FALSE: stop after the muxer */
+    gchar *pgie_config;
+    gboolean standby;               /* a second, idle inference chain to fail over to */
+    guint batch_sizes[PIPELINE_MAX_BATCH_SIZES];   /* ascending; one overrides the config's */
+    guint num_batch_sizes;
+    gchar *engine_pattern;          /* engine file of a batch size, with one %u */
+    guint latency_slo_ms;           /* for choosing among batch sizes */
+    gboolean tracker;
+    gchar *tracker_lib;
+    guint tracker_width;
+    guint tracker_height;
+    gchar *analytics_config;
+    gchar *roi_config;
+
+    PipelineSinkType sink;
+    gchar *sink_location;           /* encode target, see encode_output.h */
+    guint encode_bitrate;           /* kbps */
+    guint tiler_width;
+    guint tiler_height;
+
+    /* filled in by pipeline_desc_validate() */
+    guint batch_size;
+    gboolean use_tiler;
+    gboolean have_network_info;
+    NvDsInferNetworkInfo network_info;
+    guint output_width;             /* actual muxer output size */
+    guint output_height;
+} PipelineDesc;
+
+/* The built-in topology: one pgie, rendered. */
+PipelineDesc *pipeline_desc_new(void);
+
+/* Overrides the fields present in the key file at `path`. */
+gboolean pipeline_desc_load(PipelineDesc *desc, const gchar *path, GError **error);
+
+/* Parses "1,4,8" (or ';' separated) into the batch sizes. */
+gboolean pipeline_desc_set_batch_sizes(PipelineDesc *desc, const gchar *list, GError **error);
+
+gboolean pipeline_desc_validate(PipelineDesc *desc, GError **error);
+
+const gchar *pipeline_sink_type_name(PipelineSinkType type);
+
+void pipeline_desc_free(PipelineDesc *desc);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,98 @@
+#include "pipeline_metrics.h"
+
+typedef struct {
+    gchar *name;
+    MetricsCollectFunc func;
+    gpointer user_data;
+} MetricsCollector;
+
+static GMutex metrics_lock;
+static GCond metrics_cond;
+static GPtrArray *collectors = NULL;
+static GThread *reporter = NULL;
+static gboolean stopping = FALSE;
+static guint interval = 10;
+static gchar *report_path = NULL;
+
+static void collector_free(gpointer data) {
+    MetricsCollector *c = data;
+    g_free(c->name);
+    g_free(c);
+}
+
+void metrics_register(const gchar *name, MetricsCollectFunc func, gpointer user_data) {
+    MetricsCollector *c = g_new0(MetricsCollector, 1);
+    c->name = g_strdup(name);
+    c->func = func;
+    c->user_data = user_data;
+
+    g_mutex_lock(&metrics_lock);
+    if (!collectors)
+        collectors = g_ptr_array_new_with_free_func(collector_free);
+    g_ptr_array_add(collectors, c);
+    g_mutex_unlock(&metrics_lock);
+}
+
+void metrics_unregister(const gchar *name) {
+    g_mutex_lock(&metrics_lock);
+    for (guint i = 0; collectors && i < collectors->len; i++) {
+        MetricsCollector *c = g_ptr_array_index(collectors, i);
+        if (g_strcmp0(c->name, name) == 0) {
+            g_ptr_array_remove_index(collectors, i);
+            break;
+        }
+    }
+    g_mutex_unlock(&metrics_lock);
+}
+
+/* Called with metrics_lock held. */
+static void write_report(void) {
+    GString *out = g_string_new(NULL);
+    GError *error = NULL;
+
+    for (guint i = 0; collectors && i < collectors->len; i++) {
+        MetricsCollector *c = g_ptr_array_index(collectors, i);
+        c->func(out, c->user_data);
+    }
+    if (report_path) {
+        if (!g_file_set_contents(report_path, out->str, (gssize) out->len, &error)) {
+            g_printerr("metrics: %s\n", error->message);
+            g_error_free(error);
+        }
+    } else {
+        g_print("%s", out->str);
+    }
+    g_string_free(out, TRUE);
+}
+
+static gpointer reporter_thread(gpointer data) {
+    g_mutex_lock(&metrics_lock);
+    while (!stopping) {
+        gint64 deadline = g_get_monotonic_time() + (gint64) interval * G_USEC_PER_SEC;
+        while (!stopping && g_cond_wait_until(&metrics_cond, &metrics_lock, deadline));
+        write_report();
+    }
+    g_mutex_unlock(&metrics_lock);
+    return NULL;
+}
+
+void metrics_start(guint interval_sec, const gchar *path) {
+    if (reporter)
+        return;
+    interval = interval_sec ? interval_sec : 10;
+    g_free(report_path);
+    report_path = g_strdup(path);
+    stopping = FALSE;
+    reporter = g_thread_new("metrics", reporter_thread, NULL);
+}
+
+void metrics_stop(void) {
+    if (!reporter)
+        return;
+    g_mutex_lock(&metrics_lock);
+    stopping = TRUE;
+    g_cond_signal(&metrics_cond);
+    g_mutex_unlock(&metrics_lock);
+    g_thread_join(reporter);
+    reporter = NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef PIPELINE_METRICS_H
+#define PIPELINE_METRICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Periodic metrics report shared by all pipeline stages.
+ *
+ * Stages register a collect function that appends lines in the Prometheus
+ * text exposition format ("name{label=\"x\"} value\n") to a GString. A
+ * reporter thread calls every collector once per interval and writes the
+ * result to a file (atomically replaced, suitable for the node_exporter
+ * textfile collector) or to stdout when no file is configured. Collectors
+ * run on the reporter thread, so they must only read atomics or
+ * thread-safe properties. */
+
+typedef void (*MetricsCollectFunc)(GString *out, gpointer user_data);
+
+void metrics_register(const gchar *name, MetricsCollectFunc func, gpointer user_data);
+
+void metrics_unregister(const gchar *name);
+
+/* Starts the reporter thread. `path` may be NULL to print to stdout. */
+void metrics_start(guint interval_sec, const gchar *path);
+
+/* Writes one final report and joins the reporter thread. */
+void metrics_stop(void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pipeline_trace.h"
+
+typedef struct {
+    gint64 time;          /* CLOCK_MONOTONIC nanoseconds */
+    guint64 pts;
+    guint32 pad;          /* index into trace->pads */
+    guint32 thread;       /* filled in when writing */
+} TraceEvent;
+
+typedef struct {
+    guint32 id;
+    gchar name[16];
+    guint64 count;        /* events ever recorded, the ring keeps the last ones */
+    TraceEvent *events;
+} TraceThread;
+
+typedef struct {
+    PipelineTrace *trace;
+    guint32 index;
+    guint32 element;      /* index into trace->elements */
+    gboolean sink;
+    gchar *name;
+} TracePad;
+
+struct _PipelineTrace {
+    gchar *path;
+    guint events_per_thread;
+    gint recording;
+    guint instance;
+
+    /* rings allocated up front, claimed by threads in order */
+    TraceThread *threads;
+    guint max_threads;
+    gint claimed;
+    gint dropped;         /* events of threads left without a ring */
+
+    GMutex lock;          /* everything below */
+    GPtrArray *pads;
+    GPtrArray *elements;  /* element names */
+    GHashTable *element_index;
+};
+
+/* The ring of the calling thread in the trace identified by
+ * `thread_instance`, NULL once all rings were claimed. */
+static __thread guint thread_instance;
+static __thread TraceThread *thread_ring;
+static gint next_instance = 1;
+
+static TraceThread *get_thread(PipelineTrace *trace) {
+    guint index;
+
+    if (thread_instance == trace->instance)
+        return thread_ring;
+    thread_instance = trace->instance;
+    index = (guint) g_atomic_int_add(&trace->claimed, 1);
+    if (index >= trace->max_threads) {
+        thread_ring = NULL;
+        return NULL;
+    }
+    thread_ring = &trace->threads[index];
+    pthread_getname_np(pthread_self(), thread_ring->name, sizeof(thread_ring->name));
+    return thread_ring;
+}
+
+static GstPadProbeReturn trace_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    TracePad *trace_pad = user_data;
+    TraceThread *thread;
+    TraceEvent *event;
+    struct timespec now;
+
+    if (!g_atomic_int_get(&trace_pad->trace->recording))
+        return GST_PAD_PROBE_OK;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    thread = get_thread(trace_pad->trace);
+    if (!thread) {
+        g_atomic_int_inc(&trace_pad->trace->dropped);
+        return GST_PAD_PROBE_OK;
+    }
+    event = &thread->events[thread->count++ % trace_pad->trace->events_per_thread];
+    event->time = (gint64) now.tv_sec * 1000000000 + now.tv_nsec;
+    event->pts = GST_BUFFER_PTS (GST_PAD_PROBE_INFO_BUFFER (info));
+    event->pad = trace_pad->index;
+    return GST_PAD_PROBE_OK;
+}
+
+static void attach_pad(PipelineTrace *trace, GstElement *element, GstPad *pad) {
+    TracePad *trace_pad = g_new0(TracePad, 1);
+    gpointer index;
+
+    trace_pad->trace = trace;
+    trace_pad->sink = GST_PAD_IS_SINK (pad);
+    trace_pad->name = g_strdup_printf("%s.%s", GST_ELEMENT_NAME (element), GST_PAD_NAME (pad));
+    g_mutex_lock(&trace->lock);
+    if (!g_hash_table_lookup_extended(trace->element_index, element, NULL, &index)) {
+        index = GUINT_TO_POINTER (trace->elements->len);
+        g_hash_table_insert(trace->element_index, element, index);
+        g_ptr_array_add(trace->elements, g_strdup(GST_ELEMENT_NAME (element)));
+    }
+    trace_pad->element = GPOINTER_TO_UINT (index);
+    trace_pad->index = trace->pads->len;
+    g_ptr_array_add(trace->pads, trace_pad);
+    g_mutex_unlock(&trace->lock);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, trace_probe, trace_pad, NULL);
+}
+
+static void on_pad_added(GstElement *element, GstPad *pad, gpointer user_data) {
+    attach_pad(user_data, element, pad);
+}
+
+static void attach_element(PipelineTrace *trace, GstElement *element) {
+    GstIterator *it = gst_element_iterate_pads(element);
+    GValue item = G_VALUE_INIT;
+
+    /* bins are traced through their children, ghost pads would only
+     * repeat the same buffers */
+    if (GST_IS_BIN (element))
+        return;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        attach_pad(trace, element, g_value_get_object(&item));
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    g_signal_connect(element, "pad-added", G_CALLBACK (on_pad_added), trace);
+}
+
+static void on_deep_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data) {
+    attach_element(user_data, element);
+}
+
+void pipeline_trace_attach(PipelineTrace *trace, GstElement *pipeline) {
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN (pipeline));
+    GValue item = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        attach_element(trace, g_value_get_object(&item));
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    g_signal_connect(pipeline, "deep-element-added", G_CALLBACK (on_deep_element_added), trace);
+}
+
+PipelineTrace *pipeline_trace_new(const gchar *path, guint events_per_thread, guint max_threads,
+                                  gboolean recording) {
+    PipelineTrace *trace = g_new0(PipelineTrace, 1);
+
+    trace->path = g_strdup(path);
+    trace->events_per_thread = MAX(events_per_thread, 1024);
+    trace->max_threads = MAX(max_threads, 1);
+    trace->recording = recording;
+    trace->instance = (guint) g_atomic_int_add(&next_instance, 1);
+    trace->threads = g_new0(TraceThread, trace->max_threads);
+    for (guint i = 0; i < trace->max_threads; i++) {
+        trace->threads[i].id = i + 1;
+        trace->threads[i].events = g_new0(TraceEvent, trace->events_per_thread);
+    }
+    g_mutex_init(&trace->lock);
+    trace->pads = g_ptr_array_new();
+    trace->elements = g_ptr_array_new_with_free_func(g_free);
+    trace->element_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    return trace;
+}
+
+void pipeline_trace_set_recording(PipelineTrace *trace, gboolean recording) {
+    g_atomic_int_set(&trace->recording, recording);
+}
+
+gboolean pipeline_trace_get_recording(PipelineTrace *trace) {
+    return g_atomic_int_get(&trace->recording);
+}
+
+typedef struct {
+    guint32 element;
+    guint64 pts;
+} PendingKey;
+
+static guint pending_hash(gconstpointer key) {
+    const PendingKey *k = key;
+    return (guint) (k->pts ^ (k->pts >> 32)) * 31 + k->element;
+}
+
+static gboolean pending_equal(gconstpointer a, gconstpointer b) {
+    const PendingKey *x = a, *y = b;
+    return x->element == y->element && x->pts == y->pts;
+}
+
+static gint compare_events(gconstpointer a, gconstpointer b) {
+    const TraceEvent *x = a, *y = b;
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+static void write_event(FILE *file, gboolean *first, const gchar *fmt, ...) G_GNUC_PRINTF (3, 4);
+
+static void write_event(FILE *file, gboolean *first, const gchar *fmt, ...) {
+    va_list ap;
+
+    fputs(*first ? "\n" : ",\n", file);
+    *first = FALSE;
+    va_start(ap, fmt);
+    vfprintf(file, fmt, ap);
+    va_end(ap);
+}
+
+static void write_instant(FILE *file, gboolean *first, gint pid, const TracePad *pad, const TraceEvent *event,
+                          gint64 base) {
+    write_event(file, first, "{\"name\":\"%s %s\",\"cat\":\"pad\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%u,\"args\":{\"pts\":%" G_GUINT64_FORMAT "}}",
+                pad->name, pad->sink ? "enter" : "exit", (event->time - base) / 1000.0, pid, event->thread,
+                event->pts);
+}
+
+/* Pairs enters and exits per element and PTS, in time order. */
+static void write_trace(PipelineTrace *trace, FILE *file) {
+    GArray *events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+    GHashTable *pending = g_hash_table_new_full(pending_hash, pending_equal, g_free, g_free);
+    GHashTableIter iter;
+    gpointer value;
+    gboolean first = TRUE;
+    gint pid = getpid();
+    gint64 base = G_MAXINT64;
+    guint64 async_id = 0;
+    guint num_threads = MIN((guint) g_atomic_int_get(&trace->claimed), trace->max_threads);
+
+    for (guint t = 0; t < num_threads; t++) {
+        TraceThread *thread = &trace->threads[t];
+        guint64 n = MIN(thread->count, trace->events_per_thread);
+        for (guint64 i = thread->count - n; i < thread->count; i++) {
+            TraceEvent event = thread->events[i % trace->events_per_thread];
+            event.thread = thread->id;
+            base = MIN(base, event.time);
+            g_array_append_val(events, event);
+        }
+    }
+    g_array_sort(events, compare_events);
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    for (guint t = 0; t < num_threads; t++) {
+        TraceThread *thread = &trace->threads[t];
+        write_event(file, &first, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"name\":\"%s\"}}", pid, thread->id, thread->name[0] ? thread->name : "thread");
+    }
+    for (guint i = 0; i < events->len; i++) {
+        TraceEvent *event = &g_array_index(events, TraceEvent, i);
+        const TracePad *pad = g_ptr_array_index(trace->pads, event->pad);
+        PendingKey key = {pad->element, event->pts};
+        TraceEvent *enter;
+
+        if (pad->sink) {
+            PendingKey *new_key = g_memdup(&key, sizeof(key));
+            enter = g_hash_table_lookup(pending, &key);
+            /* a second enter before the exit: the first stays unpaired */
+            if (enter)
+                write_instant(file, &first, pid, g_ptr_array_index(trace->pads, enter->pad), enter, base);
+            g_hash_table_replace(pending, new_key, g_memdup(event, sizeof(*event)));
+            continue;
+        }
+        enter = g_hash_table_lookup(pending, &key);
+        if (!enter) {
+            write_instant(file, &first, pid, pad, event, base);
+        } else if (enter->thread == event->thread) {
+            write_event(file, &first, "{\"name\":\"%s\",\"cat\":\"element\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"pid\":%d,\"tid\":%u,\"args\":{\"pts\":%" G_GUINT64_FORMAT "}}",
+                        (const gchar *) g_ptr_array_index(trace->elements, pad->element),
+                        (enter->time - base) / 1000.0, (event->time - enter->time) / 1000.0, pid, event->thread,
+                        event->pts);
+            g_hash_table_remove(pending, &key);
+        } else {
+            const gchar *name = g_ptr_array_index(trace->elements, pad->element);
+            async_id++;
+            write_event(file, &first, "{\"name\":\"%s\",\"cat\":\"element\",\"ph\":\"b\",\"id\":%" G_GUINT64_FORMAT
+                        ",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"pts\":%" G_GUINT64_FORMAT "}}",
+                        name, async_id, (enter->time - base) / 1000.0, pid, enter->thread, event->pts);
+            write_event(file, &first, "{\"name\":\"%s\",\"cat\":\"element\",\"ph\":\"e\",\"id\":%" G_GUINT64_FORMAT
+                        ",\"ts\":%.3f,\"pid\":%d,\"tid\":%u}",
+                        name, async_id, (event->time - base) / 1000.0, pid, event->thread);
+            g_hash_table_remove(pending, &key);
+        }
+    }
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        TraceEvent *enter = value;
+        write_instant(file, &first, pid, g_ptr_array_index(trace->pads, enter->pad), enter, base);
+    }
+    fputs("\n]}\n", file);
+    g_hash_table_destroy(pending);
+    g_array_free(events, TRUE);
+}
+
+void pipeline_trace_free(PipelineTrace *trace) {
+    FILE *file;
+
+    if (!trace)
+        return;
+    file = fopen(trace->path, "w");
+    if (file) {
+        write_trace(trace, file);
+        fclose(file);
+    } else {
+        g_printerr("Unable to write trace %s\n", trace->path);
+    }
+    if (trace->dropped)
+        g_printerr("Trace: %d events dropped, more than %u threads\n", trace->dropped, trace->max_threads);
+    for (guint i = 0; i < trace->max_threads; i++)
+        g_free(trace->threads[i].events);
+    g_free(trace->threads);
+    for (guint i = 0; i < trace->pads->len; i++) {
+        TracePad *pad = g_ptr_array_index(trace->pads, i);
+        g_free(pad->name);
+        g_free(pad);
+    }
+    g_ptr_array_free(trace->pads, TRUE);
+    g_ptr_array_free(trace->elements, TRUE);
+    g_hash_table_destroy(trace->element_index);
+    g_mutex_clear(&trace->lock);
+    g_free(trace->path);
+    g_free(trace);
+}
@@ -0,0 +1,45 @@
+#ifndef PIPELINE_TRACE_H
+#define PIPELINE_TRACE_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Per-buffer tracing of every element of a pipeline, written as a
+ * Chrome / Perfetto trace (chrome://tracing, ui.perfetto.dev).
+ *
+ * A buffer probe on every pad records when a buffer enters an element
+ * (sink pad) and leaves it (src pad): monotonic time, buffer PTS and pad,
+ * into a ring of the calling thread. `max_threads` rings are allocated up
+ * front and a thread claims the next one with an atomic increment on its
+ * first event, so recording takes no lock and no allocation; threads past
+ * `max_threads` are not recorded and their events counted as dropped.
+ * Each ring keeps the latest `events_per_thread` events. While not
+ * recording the probes return after a single branch.
+ *
+ * At the end the events are paired per element by PTS:
+ *
+ *   same thread        "X" slice on that thread (decode, convert, OSD)
+ *   different threads  async "b"/"e" span (queues, inference, muxing)
+ *   unpaired           instant event on the thread that saw it
+ *
+ * Elements added later (source bins, decodebin children) and their new
+ * pads are traced as well. */
+
+typedef struct _PipelineTrace PipelineTrace;
+
+PipelineTrace *pipeline_trace_new(const gchar *path, guint events_per_thread, guint max_threads,
+                                  gboolean recording);
+
+/* Installs the probes on all elements of `pipeline`, now and later. */
+void pipeline_trace_attach(PipelineTrace *trace, GstElement *pipeline);
+
+void pipeline_trace_set_recording(PipelineTrace *trace, gboolean recording);
+gboolean pipeline_trace_get_recording(PipelineTrace *trace);
+
+/* Writes the trace file; call once the pipeline has been released. */
+void pipeline_trace_free(PipelineTrace *trace);
+
+G_END_DECLS
+
+#endif
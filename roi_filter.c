@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <string.h>
+#include "roi_filter.h"
+#include "pipeline_metrics.h"
+
+typedef gfloat v4f __attribute__((vector_size(16)));
+typedef gint32 v4i __attribute__((vector_size(16)));
+
+typedef struct {
+    guint source_id;
+    guint num_vertices;
+    gfloat *vx;
+    gfloat *vy;
+    /* bounding box of the polygon, the crop fed to the muxer */
+    gint crop_left, crop_top, crop_width, crop_height;
+    /* full decoded resolution, learned from the caps before the crop */
+    gint source_width, source_height;
+    gint frames;
+    gint objects_filtered;
+} RoiPolygon;
+
+struct _RoiConfig {
+    RoiPolygon *sources[ROI_MAX_SOURCES];
+    /* scratch space reused by roi_filter_batch (single streaming thread) */
+    guint scratch_size;
+    gfloat *xs, *ys;
+    guint8 *inside;
+    NvDsObjectMeta **objs;
+};
+
+static void roi_polygon_free(RoiPolygon *roi) {
+    if (!roi)
+        return;
+    g_free(roi->vx);
+    g_free(roi->vy);
+    g_free(roi);
+}
+
+static RoiPolygon *parse_polygon(guint source_id, const gchar *text, GError **error) {
+    gchar **points = g_strsplit(text, ";", -1);
+    guint n = g_strv_length(points);
+    RoiPolygon *roi = g_new0(RoiPolygon, 1);
+    gfloat min_x = G_MAXFLOAT, min_y = G_MAXFLOAT, max_x = 0, max_y = 0;
+
+    roi->source_id = source_id;
+    roi->vx = g_new0(gfloat, n);
+    roi->vy = g_new0(gfloat, n);
+    for (guint i = 0; i < n; i++) {
+        gchar **xy = g_strsplit(points[i], ",", 2);
+        gchar *end_x = NULL, *end_y = NULL;
+        if (g_strv_length(xy) == 2) {
+            gchar *text_x = g_strstrip(xy[0]), *text_y = g_strstrip(xy[1]);
+            gfloat x = (gfloat) g_ascii_strtod(text_x, &end_x);
+            gfloat y = (gfloat) g_ascii_strtod(text_y, &end_y);
+            /* an empty coordinate parses as 0 with nothing consumed */
+            if (end_x != text_x && *end_x == '\0' && end_y != text_y && *end_y == '\0' && x >= 0 && y >= 0) {
+                roi->vx[roi->num_vertices] = x;
+                roi->vy[roi->num_vertices] = y;
+                roi->num_vertices++;
+                min_x = MIN(min_x, x);
+                min_y = MIN(min_y, y);
+                max_x = MAX(max_x, x);
+                max_y = MAX(max_y, y);
+            }
+        }
+        g_strfreev(xy);
+    }
+    g_strfreev(points);
+
+    if (roi->num_vertices < 3 || roi->num_vertices != n || max_x <= min_x || max_y <= min_y) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "source%u: roi needs at least 3 \"x,y\" vertices", source_id);
+        roi_polygon_free(roi);
+        return NULL;
+    }
+    /* Even offsets and sizes keep NV12 chroma planes aligned. */
+    roi->crop_left = (gint) min_x & ~1;
+    roi->crop_top = (gint) min_y & ~1;
+    roi->crop_width = ((gint) (max_x + 0.5f) - roi->crop_left + 1) & ~1;
+    roi->crop_height = ((gint) (max_y + 0.5f) - roi->crop_top + 1) & ~1;
+    return roi;
+}
+
+static void collect_roi_metrics(GString *out, gpointer user_data) {
+    RoiConfig *cfg = user_data;
+
+    for (guint i = 0; i < ROI_MAX_SOURCES; i++) {
+        RoiPolygon *roi = cfg->sources[i];
+        gint64 full, saved;
+        if (!roi)
+            continue;
+        full = (gint64) g_atomic_int_get(&roi->source_width) * g_atomic_int_get(&roi->source_height);
+        saved = full > 0 ? full - (gint64) roi->crop_width * roi->crop_height : 0;
+        g_string_append_printf(out, "ds_roi_pixels_saved_per_frame{source=\"%u\"} %" G_GINT64_FORMAT "\n",
+                               i, MAX(saved, 0));
+        g_string_append_printf(out, "ds_roi_pixels_saved_total{source=\"%u\"} %" G_GINT64_FORMAT "\n",
+                               i, MAX(saved, 0) * g_atomic_int_get(&roi->frames));
+        g_string_append_printf(out, "ds_roi_objects_filtered_total{source=\"%u\"} %d\n",
+                               i, g_atomic_int_get(&roi->objects_filtered));
+    }
+}
+
+RoiConfig *roi_config_load(const gchar *path, GError **error) {
+    GKeyFile *key_file = g_key_file_new();
+    RoiConfig *cfg = NULL;
+    gchar **groups;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(key_file);
+        return NULL;
+    }
+    cfg = g_new0(RoiConfig, 1);
+    groups = g_key_file_get_groups(key_file, NULL);
+    for (guint i = 0; groups[i]; i++) {
+        guint source_id;
+        gchar *text;
+        if (sscanf(groups[i], "source%u", &source_id) != 1)
+            continue;
+        if (source_id >= ROI_MAX_SOURCES) {
+            g_printerr("ROI config: ignoring [%s], at most %d sources\n", groups[i], ROI_MAX_SOURCES);
+            continue;
+        }
+        text = g_key_file_get_string(key_file, groups[i], "roi", NULL);
+        if (!text)
+            continue;
+        roi_polygon_free(cfg->sources[source_id]);
+        cfg->sources[source_id] = parse_polygon(source_id, text, error);
+        g_free(text);
+        if (!cfg->sources[source_id]) {
+            g_strfreev(groups);
+            g_key_file_free(key_file);
+            roi_config_free(cfg);
+            return NULL;
+        }
+    }
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+    metrics_register("roi", collect_roi_metrics, cfg);
+    return cfg;
+}
+
+void roi_config_free(RoiConfig *cfg) {
+    if (!cfg)
+        return;
+    metrics_unregister("roi");
+    for (guint i = 0; i < ROI_MAX_SOURCES; i++)
+        roi_polygon_free(cfg->sources[i]);
+    g_free(cfg->xs);
+    g_free(cfg->ys);
+    g_free(cfg->inside);
+    g_free(cfg->objs);
+    g_free(cfg);
+}
+
+gboolean roi_config_has_source(RoiConfig *cfg, guint source_id) {
+    return cfg && source_id < ROI_MAX_SOURCES && cfg->sources[source_id];
+}
+
+gboolean roi_config_get_origin(RoiConfig *cfg, guint source_id, gint *x, gint *y) {
+    if (!roi_config_has_source(cfg, source_id))
+        return FALSE;
+    *x = cfg->sources[source_id]->crop_left;
+    *y = cfg->sources[source_id]->crop_top;
+    return TRUE;
+}
+
+static GstPadProbeReturn
+crop_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    RoiPolygon *roi = (RoiPolygon *) u_data;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    GstCaps *caps = NULL;
+    gint width, height;
+
+    if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+        return GST_PAD_PROBE_OK;
+    gst_event_parse_caps(event, &caps);
+    if (gst_structure_get_int(gst_caps_get_structure(caps, 0), "width", &width)
+        && gst_structure_get_int(gst_caps_get_structure(caps, 0), "height", &height)) {
+        g_atomic_int_set(&roi->source_width, width);
+        g_atomic_int_set(&roi->source_height, height);
+        if (roi->crop_left + roi->crop_width > width || roi->crop_top + roi->crop_height > height)
+            g_printerr("Source %u: ROI exceeds the %dx%d frame\n", roi->source_id, width, height);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+GstElement *roi_config_make_crop(RoiConfig *cfg, guint source_id) {
+    RoiPolygon *roi;
+    GstElement *crop;
+    GstPad *sinkpad;
+    gchar *name, *rect;
+
+    if (!roi_config_has_source(cfg, source_id))
+        return NULL;
+    roi = cfg->sources[source_id];
+    name = g_strdup_printf("roi-crop-%u", source_id);
+    crop = gst_element_factory_make("nvvideoconvert", name);
+    g_free(name);
+    if (!crop)
+        return NULL;
+    rect = g_strdup_printf("%d:%d:%d:%d", roi->crop_left, roi->crop_top,
+                           roi->crop_width, roi->crop_height);
+    g_object_set(G_OBJECT (crop), "src-crop", rect, NULL);
+    g_free(rect);
+
+    sinkpad = gst_element_get_static_pad(crop, "sink");
+    gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, crop_caps_probe, roi, NULL);
+    gst_object_unref(sinkpad);
+    return crop;
+}
+
+/* Crossing number, four points per iteration. An edge (i, j) toggles the
+ * points whose horizontal ray to +x crosses it. The per-edge slope is
+ * computed once; horizontal edges never pass the straddle test, so their
+ * slope value is irrelevant. */
+void roi_points_in_polygon(const gfloat *vx, const gfloat *vy, guint num_vertices,
+                           const gfloat *xs, const gfloat *ys, guint n, guint8 *inside) {
+    for (guint p = 0; p < n; p += 4) {
+        gfloat bx[4] = {0}, by[4] = {0};
+        guint lanes = MIN(4u, n - p);
+        v4f px, py;
+        v4i in = {0, 0, 0, 0};
+
+        memcpy(bx, xs + p, lanes * sizeof(gfloat));
+        memcpy(by, ys + p, lanes * sizeof(gfloat));
+        memcpy(&px, bx, sizeof(px));
+        memcpy(&py, by, sizeof(py));
+        for (guint i = 0, j = num_vertices - 1; i < num_vertices; j = i++) {
+            gfloat dy = vy[j] - vy[i];
+            gfloat slope = dy != 0.0f ? (vx[j] - vx[i]) / dy : 0.0f;
+            v4i straddle = (py < vy[i]) ^ (py < vy[j]);
+            v4f cross_x = (py - vy[i]) * slope + vx[i];
+            in ^= straddle & (px < cross_x);
+        }
+        for (guint l = 0; l < lanes; l++)
+            inside[p + l] = in[l] != 0;
+    }
+}
+
+static void ensure_scratch(RoiConfig *cfg, guint n) {
+    if (n <= cfg->scratch_size)
+        return;
+    cfg->scratch_size = MAX(n, cfg->scratch_size * 2);
+    cfg->xs = g_renew(gfloat, cfg->xs, cfg->scratch_size);
+    cfg->ys = g_renew(gfloat, cfg->ys, cfg->scratch_size);
+    cfg->inside = g_renew(guint8, cfg->inside, cfg->scratch_size);
+    cfg->objs = g_renew(NvDsObjectMeta *, cfg->objs, cfg->scratch_size);
+}
+
+void roi_filter_batch(RoiConfig *cfg, NvDsBatchMeta *batch_meta,
+                      guint muxer_width, guint muxer_height) {
+    NvDsMetaList *l_frame, *l_obj;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        RoiPolygon *roi;
+        gfloat scale_x, scale_y;
+        guint n = 0, removed = 0;
+
+        if (!roi_config_has_source(cfg, frame_meta->source_id))
+            continue;
+        roi = cfg->sources[frame_meta->source_id];
+        g_atomic_int_inc(&roi->frames);
+
+        /* rect_params are in muxer coordinates of the cropped frame; map
+         * the anchors back to source pixels for the polygon test. */
+        scale_x = (gfloat) roi->crop_width / muxer_width;
+        scale_y = (gfloat) roi->crop_height / muxer_height;
+        ensure_scratch(cfg, frame_meta->num_obj_meta);
+        for (l_obj = frame_meta->obj_meta_list; l_obj != NULL && n < cfg->scratch_size; l_obj = l_obj->next) {
+            NvDsObjectMeta *obj_meta = (NvDsObjectMeta *) l_obj->data;
+            NvOSD_RectParams *r = &obj_meta->rect_params;
+            cfg->objs[n] = obj_meta;
+            cfg->xs[n] = roi->crop_left + (r->left + r->width * 0.5f) * scale_x;
+            cfg->ys[n] = roi->crop_top + (r->top + r->height) * scale_y;
+            n++;
+        }
+        roi_points_in_polygon(roi->vx, roi->vy, roi->num_vertices, cfg->xs, cfg->ys, n, cfg->inside);
+        for (guint i = 0; i < n; i++) {
+            if (!cfg->inside[i]) {
+                nvds_remove_obj_meta_from_frame(frame_meta, cfg->objs[i]);
+                removed++;
+            }
+        }
+        if (removed)
+            g_atomic_int_add(&roi->objects_filtered, (gint) removed);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef ROI_FILTER_H
+#define ROI_FILTER_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+
+G_BEGIN_DECLS
+
+/* Per-source polygon regions of interest.
+ *
+ * The config file uses the same key file layout as the nvinfer config, one
+ * group per source with the polygon vertices in source pixel coordinates:
+ *
+ *   [source0]
+ *   roi=600,400;1300,400;1500,1080;400,1080
+ *
+ * For every source with a ROI the pipeline crops the decoded frame to the
+ * polygon's bounding box before the muxer (nvvideoconvert src-crop, which
+ * is an NvBufSurfTransform crop), so the muxer and the detector only see
+ * that region. After inference, objects whose bottom-center anchor lies
+ * outside the polygon are removed from the frame. */
+
+#define ROI_MAX_SOURCES 64
+
+typedef struct _RoiConfig RoiConfig;
+
+RoiConfig *roi_config_load(const gchar *path, GError **error);
+
+void roi_config_free(RoiConfig *cfg);
+
+gboolean roi_config_has_source(RoiConfig *cfg, guint source_id);
+
+/* Creates the nvvideoconvert that crops `source_id` to its ROI bounding
+ * box; link it between the source bin and the muxer. Returns NULL if the
+ * source has no ROI. */
+GstElement *roi_config_make_crop(RoiConfig *cfg, guint source_id);
+
+/* Top left corner of the crop in source pixels, FALSE without a ROI. */
+gboolean roi_config_get_origin(RoiConfig *cfg, guint source_id, gint *x, gint *y);
+
+/* Removes objects outside the polygons. `muxer_width`/`muxer_height` are
+ * the muxer output resolution the crop was scaled to. Call on the pgie src
+ * pad, before anything else consumes the objects. */
+void roi_filter_batch(RoiConfig *cfg, NvDsBatchMeta *batch_meta,
+                      guint muxer_width, guint muxer_height);
+
+/* Vectorized crossing-number test: inside[i] is set for every point
+ * (xs[i], ys[i]) inside the polygon with `num_vertices` vertices. */
+void roi_points_in_polygon(const gfloat *vx, const gfloat *vy, guint num_vertices,
+                           const gfloat *xs, const gfloat *ys, guint n, guint8 *inside);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,202 @@
+#include <string.h>
+#include <gst/gst.h>
+#include "segmentation_rle.h"
+#include "gstnvdsinfer.h"
+#include "pipeline_metrics.h"
+
+typedef gfloat v4f __attribute__((vector_size(16)));
+typedef gint32 v4i __attribute__((vector_size(16)));
+
+/* Pixels per argmax block: best value and index of a block stay in L1
+ * while every class plane streams through it. */
+#define ARGMAX_BLOCK 1024
+
+struct _SegRle {
+    NvDsMetaType meta_type;
+    /* scratch reused by seg_rle_process_batch (single streaming thread) */
+    guint16 *class_map;
+    guint class_map_size;
+    SegRun *runs;
+    guint runs_size;
+
+    GMutex stats_lock;
+    guint64 frames;
+    guint64 raw_bytes;
+    guint64 rle_bytes;
+    gint64 argmax_us;
+};
+
+void seg_rle_argmax(const gfloat *probs, guint classes, guint num_pixels, guint16 *out) {
+    gfloat best[ARGMAX_BLOCK] __attribute__((aligned(16)));
+    gint32 index[ARGMAX_BLOCK] __attribute__((aligned(16)));
+
+    for (guint start = 0; start < num_pixels; start += ARGMAX_BLOCK) {
+        guint n = MIN(ARGMAX_BLOCK, num_pixels - start);
+        guint vec_n = n & ~3u;
+
+        memcpy(best, probs + start, n * sizeof(gfloat));
+        memset(index, 0, n * sizeof(gint32));
+        for (guint c = 1; c < classes; c++) {
+            const gfloat *plane = probs + (gsize) c * num_pixels + start;
+            v4i class_id = {(gint32) c, (gint32) c, (gint32) c, (gint32) c};
+            guint p;
+
+            for (p = 0; p < vec_n; p += 4) {
+                v4f v, b;
+                v4i i, greater;
+                memcpy(&v, plane + p, sizeof(v));
+                memcpy(&b, best + p, sizeof(b));
+                memcpy(&i, index + p, sizeof(i));
+                greater = v > b;
+                b = (v4f) (((v4i) v & greater) | ((v4i) b & ~greater));
+                i = (class_id & greater) | (i & ~greater);
+                memcpy(best + p, &b, sizeof(b));
+                memcpy(index + p, &i, sizeof(i));
+            }
+            for (; p < n; p++) {
+                if (plane[p] > best[p]) {
+                    best[p] = plane[p];
+                    index[p] = (gint32) c;
+                }
+            }
+        }
+        for (guint p = 0; p < n; p++)
+            out[start + p] = (guint16) index[p];
+    }
+}
+
+static void ensure_scratch(SegRle *seg, guint num_pixels) {
+    if (num_pixels <= seg->class_map_size)
+        return;
+    seg->class_map_size = num_pixels;
+    seg->class_map = g_renew(guint16, seg->class_map, num_pixels);
+    /* worst case: every pixel starts a run */
+    seg->runs_size = num_pixels;
+    seg->runs = g_renew(SegRun, seg->runs, num_pixels);
+}
+
+static guint encode_runs(const guint16 *class_map, guint num_pixels, SegRun *runs) {
+    guint n = 0;
+
+    for (guint p = 0; p < num_pixels; p++) {
+        if (n > 0 && runs[n - 1].class_id == class_map[p]) {
+            runs[n - 1].length++;
+        } else {
+            runs[n].class_id = class_map[p];
+            runs[n].reserved = 0;
+            runs[n].length = 1;
+            n++;
+        }
+    }
+    return n;
+}
+
+static gpointer copy_rle_meta(gpointer data, gpointer user_data) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    const SegRleMap *src = user_meta->user_meta_data;
+    SegRleMap *dst = g_memdup(src, sizeof(SegRleMap));
+
+    dst->runs = g_memdup(src->runs, src->num_runs * sizeof(SegRun));
+    return dst;
+}
+
+static void release_rle_meta(gpointer data, gpointer user_data) {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *) data;
+    SegRleMap *map = user_meta->user_meta_data;
+
+    if (map) {
+        g_free(map->runs);
+        g_free(map);
+        user_meta->user_meta_data = NULL;
+    }
+}
+
+static void collect_seg_metrics(GString *out, gpointer user_data) {
+    SegRle *seg = user_data;
+
+    g_mutex_lock(&seg->stats_lock);
+    if (seg->frames) {
+        g_string_append_printf(out, "ds_seg_frames_total %" G_GUINT64_FORMAT "\n", seg->frames);
+        g_string_append_printf(out, "ds_seg_raw_bytes_per_frame %" G_GUINT64_FORMAT "\n",
+                               seg->raw_bytes / seg->frames);
+        g_string_append_printf(out, "ds_seg_rle_bytes_per_frame %" G_GUINT64_FORMAT "\n",
+                               seg->rle_bytes / seg->frames);
+        g_string_append_printf(out, "ds_seg_argmax_ms %.3f\n", seg->argmax_us / 1000.0 / seg->frames);
+    }
+    g_mutex_unlock(&seg->stats_lock);
+}
+
+SegRle *seg_rle_new(void) {
+    SegRle *seg = g_new0(SegRle, 1);
+
+    seg->meta_type = nvds_get_user_meta_type(SEG_RLE_META_DESCRIPTOR);
+    g_mutex_init(&seg->stats_lock);
+    metrics_register("segmentation", collect_seg_metrics, seg);
+    return seg;
+}
+
+void seg_rle_free(SegRle *seg) {
+    if (!seg)
+        return;
+    metrics_unregister("segmentation");
+    g_mutex_clear(&seg->stats_lock);
+    g_free(seg->class_map);
+    g_free(seg->runs);
+    g_free(seg);
+}
+
+static void process_frame(SegRle *seg, NvDsBatchMeta *batch_meta, NvDsFrameMeta *frame_meta,
+                          NvDsUserMeta *raw_meta) {
+    const NvDsInferSegmentationMeta *raw = raw_meta->user_meta_data;
+    guint num_pixels = raw->width * raw->height;
+    NvDsUserMeta *user_meta;
+    SegRleMap *map;
+    gint64 start;
+    guint64 raw_bytes;
+
+    if (!num_pixels || !raw->classes || raw->classes > G_MAXUINT16 || !raw->class_probabilities_map)
+        return;
+    ensure_scratch(seg, num_pixels);
+    start = g_get_monotonic_time();
+    seg_rle_argmax(raw->class_probabilities_map, raw->classes, num_pixels, seg->class_map);
+
+    map = g_new(SegRleMap, 1);
+    map->classes = raw->classes;
+    map->width = raw->width;
+    map->height = raw->height;
+    map->num_runs = encode_runs(seg->class_map, num_pixels, seg->runs);
+    map->runs = g_memdup(seg->runs, map->num_runs * sizeof(SegRun));
+
+    user_meta = nvds_acquire_user_meta_from_pool(batch_meta);
+    user_meta->user_meta_data = map;
+    user_meta->base_meta.meta_type = seg->meta_type;
+    user_meta->base_meta.copy_func = copy_rle_meta;
+    user_meta->base_meta.release_func = release_rle_meta;
+    nvds_add_user_meta_to_frame(frame_meta, user_meta);
+
+    raw_bytes = (guint64) num_pixels * (raw->classes * sizeof(gfloat) + sizeof(gint));
+    /* Releasing the raw meta hands the probability and class map buffers
+     * back to nvinfer. */
+    nvds_remove_user_meta_from_frame(frame_meta, raw_meta);
+
+    g_mutex_lock(&seg->stats_lock);
+    seg->frames++;
+    seg->raw_bytes += raw_bytes;
+    seg->rle_bytes += sizeof(SegRleMap) + map->num_runs * sizeof(SegRun);
+    seg->argmax_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&seg->stats_lock);
+}
+
+void seg_rle_process_batch(SegRle *seg, NvDsBatchMeta *batch_meta) {
+    NvDsMetaList *l_frame, *l_user, *next;
+
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        for (l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = next) {
+            NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+            next = l_user->next;
+            if (user_meta->base_meta.meta_type == NVDSINFER_SEGMENTATION_META)
+                process_frame(seg, batch_meta, frame_meta, user_meta);
+        }
+    }
+}
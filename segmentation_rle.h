@@ -0,0 +1,54 @@
+#ifndef SEGMENTATION_RLE_H
+#define SEGMENTATION_RLE_H
+
+#include <glib.h>
+#include "gstnvdsmeta.h"
+
+G_BEGIN_DECLS
+
+/* Run-length encoded segmentation output.
+ *
+ * nvinfer attaches an NvDsInferSegmentationMeta to every frame of a
+ * segmentation model: classes x width x height float probabilities plus an
+ * int class map, several MB per frame. The post-processor recomputes the
+ * class map from the probabilities with a vectorized argmax, attaches it as
+ * a SegRleMap user meta (type SEG_RLE_META_DESCRIPTOR) and removes the raw
+ * segmentation meta, so nvinfer gets its buffers back early and downstream
+ * consumers only ever see the runs, looking the meta type up with
+ * nvds_get_user_meta_type(SEG_RLE_META_DESCRIPTOR). Raw and encoded bytes
+ * per frame are published through pipeline_metrics. */
+
+#define SEG_RLE_META_DESCRIPTOR "DSTEST1.SEGMENTATION.RLE"
+
+/* `length` consecutive pixels of class `class_id` in row-major order; runs
+ * continue across row ends. */
+typedef struct {
+    guint16 class_id;
+    guint16 reserved;
+    guint32 length;
+} SegRun;
+
+typedef struct {
+    guint classes;
+    guint width;
+    guint height;
+    guint num_runs;
+    SegRun *runs;
+} SegRleMap;
+
+typedef struct _SegRle SegRle;
+
+SegRle *seg_rle_new(void);
+
+void seg_rle_free(SegRle *seg);
+
+/* Replaces the segmentation meta of every frame in the batch with its RLE
+ * user meta. Frames without segmentation meta are left alone. */
+void seg_rle_process_batch(SegRle *seg, NvDsBatchMeta *batch_meta);
+
+/* out[p] = argmax over c of probs[c * num_pixels + p]. */
+void seg_rle_argmax(const gfloat *probs, guint classes, guint num_pixels, guint16 *out);
+
+G_END_DECLS
+
+#endif
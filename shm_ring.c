@@ -0,0 +1,205 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "shm_ring.h"
+
+struct _ShmRing {
+    gchar *name;
+    gboolean owner;
+    gsize size;
+    guint8 *base;
+    ShmRingHeader *header;
+    /* producer: sequence of the next slot */
+    guint64 next_seq;
+};
+
+#define SLOT_ALIGN 64
+
+static ShmRingSlot *slot_at(ShmRing *ring, guint64 seq) {
+    return (ShmRingSlot *) (ring->base + sizeof(ShmRingHeader)
+                            + (gsize) ((seq - 1) % ring->header->num_slots) * ring->header->slot_size);
+}
+
+static gchar *shm_path(const gchar *name) {
+    return name[0] == '/' ? g_strdup(name) : g_strconcat("/", name, NULL);
+}
+
+static ShmRing *map_ring(const gchar *name, int fd, gsize size, gboolean owner, GError **error) {
+    ShmRing *ring;
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+    if (base == MAP_FAILED) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "mmap %s: %s", name, g_strerror(errno));
+        return NULL;
+    }
+    ring = g_new0(ShmRing, 1);
+    ring->name = shm_path(name);
+    ring->owner = owner;
+    ring->size = size;
+    ring->base = base;
+    ring->header = base;
+    return ring;
+}
+
+ShmRing *shm_ring_create(const gchar *name, guint num_slots, guint payload_size, GError **error) {
+    gchar *path = shm_path(name);
+    guint slot_size = (guint) ((sizeof(ShmRingSlot) + payload_size + SLOT_ALIGN - 1) & ~(SLOT_ALIGN - 1));
+    gsize size = sizeof(ShmRingHeader) + (gsize) slot_size * num_slots;
+    ShmRing *ring;
+    int fd;
+
+    if (num_slots == 0 || payload_size == 0) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: empty ring", name);
+        g_free(path);
+        return NULL;
+    }
+    shm_unlink(path);
+    fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t) size) != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "shm %s: %s", path, g_strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(path);
+        }
+        g_free(path);
+        return NULL;
+    }
+    g_free(path);
+    ring = map_ring(name, fd, size, TRUE, error);
+    if (!ring)
+        return NULL;
+    /* ftruncate zero-fills, so every slot starts with seq 0 (unwritten) */
+    ring->header->num_slots = num_slots;
+    ring->header->slot_size = slot_size;
+    ring->header->payload_size = slot_size - (guint32) sizeof(ShmRingSlot);
+    ring->header->producer_pid = getpid();
+    ring->header->version = SHM_RING_VERSION;
+    __atomic_store_n(&ring->header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    ring->next_seq = 1;
+    return ring;
+}
+
+ShmRing *shm_ring_open(const gchar *name, GError **error) {
+    gchar *path = shm_path(name);
+    int fd = shm_open(path, O_RDWR, 0);
+    struct stat st;
+    ShmRing *ring;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "shm %s: %s", path, g_strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        g_free(path);
+        return NULL;
+    }
+    g_free(path);
+    if ((gsize) st.st_size < sizeof(ShmRingHeader)) {
+        close(fd);
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: not a ring", name);
+        return NULL;
+    }
+    ring = map_ring(name, fd, (gsize) st.st_size, FALSE, error);
+    if (!ring)
+        return NULL;
+    if (__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC
+        || ring->header->version != SHM_RING_VERSION
+        || sizeof(ShmRingHeader) + (gsize) ring->header->slot_size * ring->header->num_slots > ring->size) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: not a ring", name);
+        shm_ring_close(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void shm_ring_close(ShmRing *ring) {
+    if (!ring)
+        return;
+    munmap(ring->base, ring->size);
+    if (ring->owner)
+        shm_unlink(ring->name);
+    g_free(ring->name);
+    g_free(ring);
+}
+
+const ShmRingHeader *shm_ring_header(ShmRing *ring) {
+    return ring->header;
+}
+
+guint32 *shm_ring_user(ShmRing *ring) {
+    return ring->header->user;
+}
+
+gpointer shm_ring_begin_write(ShmRing *ring) {
+    ShmRingSlot *slot = slot_at(ring, ring->next_seq);
+
+    /* Invalidate before touching the payload, so a reader still on the
+     * old sequence sees the change when it re-checks. */
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return slot->payload;
+}
+
+guint64 shm_ring_commit(ShmRing *ring, guint32 size) {
+    guint64 seq = ring->next_seq++;
+    ShmRingSlot *slot = slot_at(ring, seq);
+
+    slot->size = MIN(size, ring->header->payload_size);
+    slot->publish_ns = shm_ring_now_ns();
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->header->write_seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->header->futex, (guint32) seq, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &ring->header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    return seq;
+}
+
+const ShmRingSlot *shm_ring_wait(ShmRing *ring, guint64 *seq, gint timeout_ms) {
+    gint64 deadline = timeout_ms < 0 ? G_MAXINT64 : g_get_monotonic_time() + (gint64) timeout_ms * 1000;
+
+    for (;;) {
+        guint64 published = __atomic_load_n(&ring->header->write_seq, __ATOMIC_ACQUIRE);
+        guint32 word = __atomic_load_n(&ring->header->futex, __ATOMIC_ACQUIRE);
+        gint64 now;
+
+        if (published >= *seq) {
+            ShmRingSlot *slot;
+            if (published - *seq >= ring->header->num_slots)
+                *seq = published - ring->header->num_slots + 1;
+            slot = slot_at(ring, *seq);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == *seq)
+                return slot;
+            /* overwritten between the two loads, skip ahead */
+            (*seq)++;
+            continue;
+        }
+        now = g_get_monotonic_time();
+        if (now >= deadline)
+            return NULL;
+        if (timeout_ms < 0) {
+            syscall(SYS_futex, &ring->header->futex, FUTEX_WAIT, word, NULL, NULL, 0);
+        } else {
+            struct timespec ts;
+            gint64 left = deadline - now;
+            ts.tv_sec = left / G_USEC_PER_SEC;
+            ts.tv_nsec = (left % G_USEC_PER_SEC) * 1000;
+            syscall(SYS_futex, &ring->header->futex, FUTEX_WAIT, word, &ts, NULL, 0);
+        }
+    }
+}
+
+guint64 shm_ring_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (guint64) ts.tv_sec * 1000000000u + (guint64) ts.tv_nsec;
+}
@@ -0,0 +1,98 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Single-producer ring of fixed-size slots in POSIX shared memory
+ * (/dev/shm/<name>), read by any number of consumer processes.
+ *
+ * The producer never waits: it fills the next slot and overwrites the
+ * oldest one when consumers fall behind. Every slot carries the sequence
+ * number it was written with, so a consumer detects both a slot that is not
+ * written yet and one that was overwritten while it was reading it
+ * (shm_ring_slot_valid() after use, like a seqlock). Consumers sleep on a
+ * futex on the published sequence instead of polling.
+ *
+ * Payloads are read in place from the mapping; the only copy is the
+ * producer's write into the slot. */
+
+#define SHM_RING_MAGIC 0x474e4952u /* "RING" */
+#define SHM_RING_VERSION 1
+
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    guint32 num_slots;
+    guint32 slot_size;
+    /* payload bytes per slot, slot_size minus the slot header */
+    guint32 payload_size;
+    /* futex word, low 32 bits of the last published sequence */
+    volatile guint32 futex;
+    /* last published sequence, 0 before the first write */
+    volatile guint64 write_seq;
+    /* pid of the producer, for consumers reporting a dead peer */
+    gint32 producer_pid;
+    /* producer-defined, e.g. the geometry of the payloads */
+    guint32 user[4];
+    guint32 reserved[3];
+} ShmRingHeader;
+
+typedef struct {
+    /* sequence the payload belongs to, 0 while being written */
+    volatile guint64 seq;
+    /* CLOCK_MONOTONIC ns when the slot was published */
+    guint64 publish_ns;
+    guint32 size;
+    guint32 reserved;
+    guint8 payload[];
+} ShmRingSlot;
+
+typedef struct _ShmRing ShmRing;
+
+/* Producer side: creates (or replaces) /dev/shm/<name>. */
+ShmRing *shm_ring_create(const gchar *name, guint num_slots, guint payload_size, GError **error);
+
+/* Consumer side: maps an existing ring. */
+ShmRing *shm_ring_open(const gchar *name, GError **error);
+
+/* Unmaps the ring; the creator also unlinks it. */
+void shm_ring_close(ShmRing *ring);
+
+const ShmRingHeader *shm_ring_header(ShmRing *ring);
+
+/* Producer: the user words of the header, to be filled in before the
+ * first commit. */
+guint32 *shm_ring_user(ShmRing *ring);
+
+/* Producer: returns the payload of the next slot (payload_size bytes). The
+ * slot is marked invalid until shm_ring_commit() publishes it. */
+gpointer shm_ring_begin_write(ShmRing *ring);
+
+/* Producer: publishes `size` bytes written to the slot and wakes waiting
+ * consumers. Returns the sequence number of the slot. */
+guint64 shm_ring_commit(ShmRing *ring, guint32 size);
+
+/* Consumer: waits until sequence `seq` (starting at 1) is published or
+ * `timeout_ms` passes (-1 waits forever). Returns the slot, or NULL on
+ * timeout. If the producer already lapped `seq`, *seq is advanced to the
+ * oldest slot still in the ring; the difference is the number of dropped
+ * slots. */
+const ShmRingSlot *shm_ring_wait(ShmRing *ring, guint64 *seq, gint timeout_ms);
+
+/* Consumer: TRUE if the slot still holds `seq`, i.e. was not overwritten
+ * while the payload was being read. */
+static inline gboolean shm_ring_slot_valid(const ShmRingSlot *slot, guint64 seq) {
+    /* the payload loads must not move past the reload (weakly ordered
+     * CPUs such as aarch64) */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/* CLOCK_MONOTONIC in ns; comparable across processes on the same host. */
+guint64 shm_ring_now_ns(void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,457 @@
+#include "source_bin.h"
+#include "async_log.h"
+#include "pipeline_metrics.h"
+
+#define RTSP_LATENCY_MS 2000
+
+/* Longest GOP a warm start gate holds; a longer one is dropped and the
+ * gate waits for the next keyframe. */
+#define SOURCE_GATE_MAX_BUFFERS 600
+
+/* Compressed formats the bins can depayload/parse/decode. The encoding
+ * name is the one rtspsrc reports in its application/x-rtp caps. */
+typedef struct {
+    const gchar *codec;
+    const gchar *encoding_name;
+    const gchar *depay;
+    const gchar *parse;
+    const gchar *hw_decoder;
+    const gchar *sw_decoder;
+    /* the hardware decoder outputs system memory, uploaded for the muxer */
+    gboolean hw_upload;
+} SourceCodec;
+
+static const SourceCodec source_codecs[] = {
+        {"h264", "H264", "rtph264depay", "h264parse", "nvv4l2decoder", "avdec_h264", FALSE},
+        {"h265", "H265", "rtph265depay", "h265parse", "nvv4l2decoder", "avdec_h265", FALSE},
+#ifdef PLATFORM_TEGRA
+        /* decodes MJPEG into NVMM once told so */
+        {"mjpeg", "JPEG", "rtpjpegdepay", "jpegparse", "nvv4l2decoder", "jpegdec", FALSE},
+#else
+        {"mjpeg", "JPEG", "rtpjpegdepay", "jpegparse", "nvjpegdec", "jpegdec", TRUE},
+#endif
+};
+
+typedef struct {
+    guint index;
+    DecodePolicy *policy;
+    GstElement *bin;
+    GstPad *ghost;
+    /* set once the first video pad has been linked */
+    gboolean linked;
+    /* compressed bytes entering the parser, for codec/bitrate stats */
+    const SourceCodec *codec;
+    volatile gsize bytes;
+    gsize last_bytes;
+    gint64 last_time;
+    gchar *metrics_name;
+    /* warm start gate between parser and decoder */
+    gboolean holds;
+    GMutex gate_lock;
+    gboolean gate_closed;
+    GQueue gate_held;         /* the latest GOP, from its keyframe */
+    guint gate_dropped;
+} SourceBinContext;
+
+static gboolean software_decode = FALSE;
+static gboolean warm_start = FALSE;
+
+void source_bin_set_software_decode(gboolean software) {
+    software_decode = software;
+}
+
+void source_bin_set_warm_start(gboolean warm) {
+    warm_start = warm;
+}
+
+static gboolean have_factory(const gchar *name) {
+    GstElementFactory *factory = gst_element_factory_find(name);
+
+    if (!factory)
+        return FALSE;
+    gst_object_unref(factory);
+    return TRUE;
+}
+
+static const SourceCodec *find_codec_by_encoding(const gchar *encoding_name) {
+    for (guint i = 0; encoding_name && i < G_N_ELEMENTS(source_codecs); i++)
+        if (g_ascii_strcasecmp(source_codecs[i].encoding_name, encoding_name) == 0)
+            return &source_codecs[i];
+    return NULL;
+}
+
+static const SourceCodec *find_codec(const gchar *codec) {
+    for (guint i = 0; codec && i < G_N_ELEMENTS(source_codecs); i++)
+        if (g_strcmp0(source_codecs[i].codec, codec) == 0)
+            return &source_codecs[i];
+    return NULL;
+}
+
+static GstElement *make_element(SourceBinContext *ctx, const gchar *factory, const gchar *role) {
+    gchar *name = g_strdup_printf("%s-%u", role, ctx->index);
+    GstElement *element = gst_element_factory_make(factory, name);
+
+    if (!element)
+        g_printerr("Source %u: %s could not be created.\n", ctx->index, factory);
+    g_free(name);
+    return element;
+}
+
+static GstPadProbeReturn
+count_bytes_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    SourceBinContext *ctx = (SourceBinContext *) u_data;
+    g_atomic_pointer_add(&ctx->bytes, (gssize) gst_buffer_get_size((GstBuffer *) info->data));
+    return GST_PAD_PROBE_OK;
+}
+
+/* Runs on the metrics thread; last_bytes/last_time are only touched here. */
+static void collect_source_metrics(GString *out, gpointer user_data) {
+    SourceBinContext *ctx = user_data;
+    const SourceCodec *codec = g_atomic_pointer_get(&ctx->codec);
+    gsize bytes = (gsize) g_atomic_pointer_get(&ctx->bytes);
+    gint64 now = g_get_monotonic_time();
+    gdouble kbps = 0;
+
+    if (!codec)
+        return;
+    if (ctx->last_time && now > ctx->last_time)
+        kbps = (bytes - ctx->last_bytes) * 8.0 * 1000.0 / (now - ctx->last_time);
+    ctx->last_bytes = bytes;
+    ctx->last_time = now;
+    g_string_append_printf(out, "ds_source_bytes_total{source=\"%u\",codec=\"%s\"} %" G_GSIZE_FORMAT "\n",
+                           ctx->index, codec->codec, bytes);
+    g_string_append_printf(out, "ds_source_bitrate_kbps{source=\"%u\",codec=\"%s\"} %.1f\n",
+                           ctx->index, codec->codec, kbps);
+}
+
+static void drop_held(SourceBinContext *ctx) {
+    GstBuffer *buf;
+
+    ctx->gate_dropped += ctx->gate_held.length;
+    while ((buf = g_queue_pop_head(&ctx->gate_held)))
+        gst_buffer_unref(buf);
+}
+
+/* Until source_bin_release() only the latest GOP reaches this far; caps
+ * and segment pass, so the decoder is set up and only waits for data.
+ * Once released the held GOP goes to the decoder ahead of the next
+ * buffer and the probe removes itself. */
+static GstPadProbeReturn
+gate_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    SourceBinContext *ctx = (SourceBinContext *) u_data;
+    GQueue held = G_QUEUE_INIT;
+    GstBuffer *buf;
+    GstPad *peer;
+    guint dropped;
+
+    if ((info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) &&
+        GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_EOS)
+        return GST_PAD_PROBE_OK;
+
+    g_mutex_lock(&ctx->gate_lock);
+    if (ctx->gate_closed && (info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+        buf = GST_PAD_PROBE_INFO_BUFFER (info);
+        if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT) ||
+            ctx->gate_held.length >= SOURCE_GATE_MAX_BUFFERS)
+            drop_held(ctx);
+        if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT) || ctx->gate_held.length > 0)
+            g_queue_push_tail(&ctx->gate_held, gst_buffer_ref(buf));
+        else
+            ctx->gate_dropped++;
+        g_mutex_unlock(&ctx->gate_lock);
+        return GST_PAD_PROBE_DROP;
+    }
+    /* a stream ending before the release has nothing worth decoding */
+    if (ctx->gate_closed)
+        drop_held(ctx);
+    held = ctx->gate_held;
+    g_queue_init(&ctx->gate_held);
+    dropped = ctx->gate_dropped;
+    g_mutex_unlock(&ctx->gate_lock);
+
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: released with %u held frames, %u dropped while waiting",
+             ctx->index, held.length, dropped);
+    peer = gst_pad_get_peer(pad);
+    while ((buf = g_queue_pop_head(&held))) {
+        if (peer)
+            gst_pad_chain(peer, buf);
+        else
+            gst_buffer_unref(buf);
+    }
+    if (peer)
+        gst_object_unref(peer);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/* Adds parse -> decoder [-> nvvideoconvert] for `codec` to the bin, points
+ * the ghost pad at the tail and returns the parser, or NULL on failure.
+ * Called from pad-added as well, hence the state sync. */
+static GstElement *add_decode_chain(SourceBinContext *ctx, const SourceCodec *codec) {
+    gboolean hardware = !software_decode && have_factory(codec->hw_decoder);
+    GstElement *parse, *decoder, *convert = NULL, *tail;
+    GstPad *pad;
+
+    parse = make_element(ctx, codec->parse, "parse");
+    decoder = make_element(ctx, hardware ? codec->hw_decoder : codec->sw_decoder, "decoder");
+    if (!hardware || codec->hw_upload)
+        convert = make_element(ctx, "nvvideoconvert", "upload");
+    if (!parse || !decoder || ((!hardware || codec->hw_upload) && !convert))
+        return NULL;
+#ifdef PLATFORM_TEGRA
+    if (hardware && g_strcmp0(codec->codec, "mjpeg") == 0 && g_strcmp0(codec->hw_decoder, "nvv4l2decoder") == 0)
+        g_object_set(G_OBJECT (decoder), "mjpeg", TRUE, NULL);
+#endif
+
+    gst_bin_add_many(GST_BIN (ctx->bin), parse, decoder, NULL);
+    if (convert)
+        gst_bin_add(GST_BIN (ctx->bin), convert);
+    if (!gst_element_link_many(parse, decoder, convert, NULL)) {
+        nvds_log(DSLOG_CAT_APP, LOG_ERR, "Source %u: unable to link %s decoder", ctx->index, codec->codec);
+        return NULL;
+    }
+    if (ctx->policy && !decode_policy_attach(ctx->policy, decoder))
+        return NULL;
+
+    pad = gst_element_get_static_pad(parse, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, count_bytes_probe, ctx, NULL);
+    gst_object_unref(pad);
+    if (ctx->holds) {
+        pad = gst_element_get_static_pad(parse, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, gate_probe, ctx, NULL);
+        gst_object_unref(pad);
+    }
+    g_atomic_pointer_set(&ctx->codec, codec);
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: %s, %s decode", ctx->index, codec->codec,
+             hardware ? "hardware" : "software");
+
+    tail = convert ? convert : decoder;
+    pad = gst_element_get_static_pad(tail, "src");
+    gst_ghost_pad_set_target(GST_GHOST_PAD (ctx->ghost), pad);
+    gst_object_unref(pad);
+
+    gst_element_sync_state_with_parent(parse);
+    gst_element_sync_state_with_parent(decoder);
+    if (convert)
+        gst_element_sync_state_with_parent(convert);
+    return parse;
+}
+
+/* Audio (and anything else that is not video) is never set up, so the
+ * camera does not even send it. */
+static gboolean cb_rtspsrc_select_stream(GstElement *element, guint num, GstCaps *caps, gpointer data) {
+    SourceBinContext *ctx = (SourceBinContext *) data;
+    const gchar *media = gst_structure_get_string(gst_caps_get_structure(caps, 0), "media");
+
+    if (g_strcmp0(media, "video") == 0)
+        return TRUE;
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: skipping %s stream %u", ctx->index, media ? media : "unknown", num);
+    return FALSE;
+}
+
+/* rtspsrc pads are application/x-rtp; encoding-name tells the payload. */
+static void cb_new_rtspsrc_pad(GstElement *element, GstPad *pad, gpointer data) {
+    SourceBinContext *ctx = (SourceBinContext *) data;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    const GstStructure *s;
+    const gchar *media, *encoding;
+    const SourceCodec *codec = NULL;
+    GstElement *depay, *parse;
+    GstPad *sinkpad;
+
+    if (!caps)
+        caps = gst_pad_query_caps(pad, NULL);
+    s = gst_caps_get_structure(caps, 0);
+    media = gst_structure_get_string(s, "media");
+    encoding = gst_structure_get_string(s, "encoding-name");
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: new RTP pad %s (media=%s, encoding=%s)", ctx->index,
+             GST_OBJECT_NAME (pad), media ? media : "?", encoding ? encoding : "?");
+
+    /* Audio pads are left unlinked; rtspsrc tolerates not-linked streams
+     * as long as one stream is linked. */
+    if (g_strcmp0(media, "video") == 0)
+        codec = find_codec_by_encoding(encoding);
+    gst_caps_unref(caps);
+
+    if (!codec || ctx->linked) {
+        nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: pad %s not used", ctx->index, GST_OBJECT_NAME (pad));
+        return;
+    }
+
+    depay = make_element(ctx, codec->depay, "depay");
+    if (!depay)
+        return;
+    gst_bin_add(GST_BIN (ctx->bin), depay);
+    parse = add_decode_chain(ctx, codec);
+    if (!parse || !gst_element_link(depay, parse)) {
+        nvds_log(DSLOG_CAT_APP, LOG_ERR, "Source %u: unable to build %s chain", ctx->index, codec->codec);
+        return;
+    }
+    gst_element_sync_state_with_parent(depay);
+
+    sinkpad = gst_element_get_static_pad(depay, "sink");
+    if (gst_pad_link(pad, sinkpad) != GST_PAD_LINK_OK)
+        nvds_log(DSLOG_CAT_APP, LOG_ERR, "Source %u: failed to link %s", ctx->index, GST_OBJECT_NAME (pad));
+    else
+        ctx->linked = TRUE;
+    gst_object_unref(sinkpad);
+}
+
+/* uridecodebin already decodes; frames that are not in NVMM memory still
+ * need nvvideoconvert before the muxer. */
+static void cb_new_decodebin_pad(GstElement *element, GstPad *pad, gpointer data) {
+    SourceBinContext *ctx = (SourceBinContext *) data;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    const GstStructure *s;
+    gboolean nvmm;
+    GstPad *target;
+
+    if (!caps)
+        caps = gst_pad_query_caps(pad, NULL);
+    s = gst_caps_get_structure(caps, 0);
+    if (!g_str_has_prefix(gst_structure_get_name(s), "video/") || ctx->linked) {
+        gst_caps_unref(caps);
+        return;
+    }
+    nvmm = gst_caps_features_contains(gst_caps_get_features(caps, 0), "memory:NVMM");
+    gst_caps_unref(caps);
+
+    if (nvmm) {
+        target = gst_object_ref(pad);
+    } else {
+        GstElement *convert = make_element(ctx, "nvvideoconvert", "upload");
+        GstPad *sinkpad;
+        if (!convert)
+            return;
+        gst_bin_add(GST_BIN (ctx->bin), convert);
+        gst_element_sync_state_with_parent(convert);
+        sinkpad = gst_element_get_static_pad(convert, "sink");
+        gst_pad_link(pad, sinkpad);
+        gst_object_unref(sinkpad);
+        target = gst_element_get_static_pad(convert, "src");
+    }
+    if (gst_ghost_pad_set_target(GST_GHOST_PAD (ctx->ghost), target))
+        ctx->linked = TRUE;
+    else
+        nvds_log(DSLOG_CAT_APP, LOG_ERR, "Source %u: failed to link decoded pad", ctx->index);
+    gst_object_unref(target);
+}
+
+/* Elementary stream files keep the original filesrc -> parse -> decode
+ * chain; the extension tells h264 from h265. */
+static const SourceCodec *elementary_codec(const gchar *path) {
+    static const gchar *h264[] = {".h264", ".264", ".avc", NULL};
+    static const gchar *h265[] = {".h265", ".265", ".hevc", NULL};
+    static const gchar *mjpeg[] = {".mjpeg", ".mjpg", NULL};
+    gchar *lower = g_ascii_strdown(path, -1);
+    const gchar *codec = NULL;
+
+    for (guint i = 0; !codec && h264[i]; i++)
+        if (g_str_has_suffix(lower, h264[i]))
+            codec = "h264";
+    for (guint i = 0; !codec && h265[i]; i++)
+        if (g_str_has_suffix(lower, h265[i]))
+            codec = "h265";
+    for (guint i = 0; !codec && mjpeg[i]; i++)
+        if (g_str_has_suffix(lower, mjpeg[i]))
+            codec = "mjpeg";
+    g_free(lower);
+    return find_codec(codec);
+}
+
+gboolean source_uri_is_live(const gchar *uri) {
+    return g_str_has_prefix(uri, "rtsp://") || g_str_has_prefix(uri, "rtsps://");
+}
+
+gboolean source_bin_holds(GstElement *bin) {
+    SourceBinContext *ctx = g_object_get_data(G_OBJECT (bin), "source-bin-context");
+    return ctx && ctx->holds;
+}
+
+void source_bin_release(GstElement *bin) {
+    SourceBinContext *ctx = g_object_get_data(G_OBJECT (bin), "source-bin-context");
+
+    if (!ctx || !ctx->holds)
+        return;
+    g_mutex_lock(&ctx->gate_lock);
+    ctx->gate_closed = FALSE;
+    g_mutex_unlock(&ctx->gate_lock);
+}
+
+static void source_bin_context_free(gpointer data) {
+    SourceBinContext *ctx = data;
+    metrics_unregister(ctx->metrics_name);
+    g_free(ctx->metrics_name);
+    drop_held(ctx);
+    g_mutex_clear(&ctx->gate_lock);
+    g_free(ctx);
+}
+
+GstElement *create_source_bin(guint index, const gchar *uri, DecodePolicy *policy) {
+    SourceBinContext *ctx = g_new0(SourceBinContext, 1);
+    gchar *bin_name = g_strdup_printf("source-bin-%02u", index);
+    gchar *scheme = g_uri_parse_scheme(uri);
+    gchar *path = NULL;
+    const SourceCodec *codec;
+    GstElement *source;
+
+    ctx->index = index;
+    ctx->policy = policy;
+    ctx->bin = gst_bin_new(bin_name);
+    g_free(bin_name);
+    ctx->metrics_name = g_strdup_printf("source-%u", index);
+    g_mutex_init(&ctx->gate_lock);
+    g_queue_init(&ctx->gate_held);
+    metrics_register(ctx->metrics_name, collect_source_metrics, ctx);
+    g_object_set_data_full(G_OBJECT (ctx->bin), "source-bin-context", ctx, source_bin_context_free);
+    ctx->ghost = gst_ghost_pad_new_no_target("src", GST_PAD_SRC);
+    gst_element_add_pad(ctx->bin, ctx->ghost);
+
+    if (!scheme)
+        path = g_strdup(uri);
+    else if (g_ascii_strcasecmp(scheme, "file") == 0)
+        path = g_filename_from_uri(uri, NULL, NULL);
+    codec = path ? elementary_codec(path) : NULL;
+
+    if (scheme && (g_ascii_strcasecmp(scheme, "rtsp") == 0 || g_ascii_strcasecmp(scheme, "rtsps") == 0)) {
+        source = make_element(ctx, "rtspsrc", "rtsp-source");
+        if (!source)
+            goto fail;
+        g_object_set(G_OBJECT (source), "location", uri, "latency", RTSP_LATENCY_MS, NULL);
+        ctx->holds = ctx->gate_closed = warm_start;
+        gst_bin_add(GST_BIN (ctx->bin), source);
+        g_signal_connect(source, "select-stream", G_CALLBACK(cb_rtspsrc_select_stream), ctx);
+        g_signal_connect(source, "pad-added", G_CALLBACK(cb_new_rtspsrc_pad), ctx);
+    } else if (codec) {
+        GstElement *parse;
+        source = make_element(ctx, "filesrc", "file-source");
+        if (!source)
+            goto fail;
+        g_object_set(G_OBJECT (source), "location", path, NULL);
+        gst_bin_add(GST_BIN (ctx->bin), source);
+        parse = add_decode_chain(ctx, codec);
+        if (!parse || !gst_element_link(source, parse))
+            goto fail;
+        ctx->linked = TRUE;
+    } else {
+        gchar *full_uri = scheme ? g_strdup(uri) : gst_filename_to_uri(uri, NULL);
+        source = make_element(ctx, "uridecodebin", "uri-decode-bin");
+        if (!source || !full_uri) {
+            g_free(full_uri);
+            goto fail;
+        }
+        g_object_set(G_OBJECT (source), "uri", full_uri, NULL);
+        g_free(full_uri);
+        gst_bin_add(GST_BIN (ctx->bin), source);
+        g_signal_connect(source, "pad-added", G_CALLBACK(cb_new_decodebin_pad), ctx);
+    }
+    g_free(scheme);
+    g_free(path);
+    return ctx->bin;
+
+fail:
+    g_printerr("Source %u: unable to create source bin for %s\n", index, uri);
+    g_free(scheme);
+    g_free(path);
+    gst_object_unref(ctx->bin);
+    return NULL;
+}
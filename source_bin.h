@@ -0,0 +1,47 @@
+#ifndef SOURCE_BIN_H
+#define SOURCE_BIN_H
+
+#include <gst/gst.h>
+#include "decode_policy.h"
+
+G_BEGIN_DECLS
+
+/* One source bin per input, picked by URI scheme:
+ *
+ *   rtsp://...              rtspsrc; depayloader, parser and decoder are
+ *                           chosen from the caps of every new pad (H.264,
+ *                           H.265, MJPEG); audio streams are not set up
+ *   path, file://x.h264     filesrc -> h264parse/h265parse/jpegparse ->
+ *   (.h264 .265 .mjpeg ...) decoder for elementary streams
+ *   anything else           uridecodebin
+ *
+ * Every bin exposes a single "src" ghost pad carrying decoded NVMM frames,
+ * ready to be linked to an nvstreammux request pad. The hardware decoder is
+ * used when available; otherwise libav decodes and nvvideoconvert uploads.
+ * `policy` (may be NULL) is applied to every decoder the bin creates.
+ * Codec and compressed bitrate of every source are published through
+ * pipeline_metrics. */
+GstElement *create_source_bin(guint index, const gchar *uri, DecodePolicy *policy);
+
+/* TRUE for live sources (rtsp), which need
+ * nvstreammux live-source mode. */
+gboolean source_uri_is_live(const gchar *uri);
+
+/* Forces the software decoder even when nvv4l2decoder exists. */
+void source_bin_set_software_decode(gboolean software);
+
+/* Warm start: live bins created afterwards hold their stream between
+ * parser and decoder, keeping only the latest GOP, until
+ * source_bin_release(). Started ahead of the pipeline they connect and
+ * set up the decoder while inference engines load, and start decoding
+ * from a keyframe. */
+void source_bin_set_warm_start(gboolean warm);
+
+/* Whether `bin` holds its stream until released. */
+gboolean source_bin_holds(GstElement *bin);
+
+void source_bin_release(GstElement *bin);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+#include "source_set.h"
+#include "source_bin.h"
+#include "pipeline_metrics.h"
+#include "async_log.h"
+
+typedef struct {
+    GstElement *bin;
+    GstElement *crop;
+    gboolean early;         /* started ahead of the pipeline, state locked */
+    guint64 frames;
+    guint64 pixels;
+    gint64 infer_us;
+    gint64 first_frame_at;
+    GstClockTime first_pts;     /* span of media time delivered */
+    GstClockTime last_pts;
+} SourceEntry;
+
+struct _SourceSet {
+    GstElement *pipeline;
+    GstElement *streammux;
+    guint max_sources;
+    RoiConfig *roi;
+    DecodePolicy *policy;
+    SourceEntry *entries;
+    guint stdin_watch;
+    guint batch_size;           /* shrinks as sources end */
+    gboolean manage_batch_size;
+    gint num_sources;           /* atomic, read by streaming threads */
+    GQueue *pending;            /* uris waiting for an id to free up */
+
+    /* counters, shared with the pgie probe and the metrics thread */
+    GMutex lock;
+    gint64 first_frame_at;
+    guint finished;             /* sources removed at their end of stream */
+    guint64 finished_frames;
+    GstClockTime finished_media;
+};
+
+static GstClockTime media_time(const SourceEntry *entry) {
+    return entry->frames ? entry->last_pts - entry->first_pts : 0;
+}
+
+static guint count_sources(SourceSet *set) {
+    return (guint) g_atomic_int_get(&set->num_sources);
+}
+
+/* Nothing plays and nothing more can be added: ends the pipeline as the
+ * EOS of a last source would have. The muxer has no sink pad left to send
+ * one through, so it goes out of its src pad. */
+static void end_if_done(SourceSet *set) {
+    GstPad *pad;
+
+    if (count_sources(set) > 0 || set->stdin_watch || !g_queue_is_empty(set->pending))
+        return;
+    nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "No sources left and none to come, ending");
+    pad = gst_element_get_static_pad(set->streammux, "src");
+    gst_pad_push_event(pad, gst_event_new_eos());
+    gst_object_unref(pad);
+}
+
+/* Frames per second of the replay so far, with the lock held. */
+static gdouble replay_fps(SourceSet *set, guint64 *frames) {
+    gint64 us = set->first_frame_at ? g_get_monotonic_time() - set->first_frame_at : 0;
+
+    *frames = set->finished_frames;
+    for (guint i = 0; i < set->max_sources; i++) {
+        if (set->entries[i].bin)
+            *frames += set->entries[i].frames;
+    }
+    return us > 0 ? *frames * 1e6 / us : 0.0;
+}
+
+/* Media time replayed so far, with the lock held. */
+static GstClockTime replay_media(SourceSet *set) {
+    GstClockTime media = set->finished_media;
+
+    for (guint i = 0; i < set->max_sources; i++) {
+        if (set->entries[i].bin)
+            media += media_time(&set->entries[i]);
+    }
+    return media;
+}
+
+static void collect_source_set_metrics(GString *out, gpointer user_data) {
+    SourceSet *set = user_data;
+    guint active = 0;
+    guint64 frames;
+
+    g_mutex_lock(&set->lock);
+    for (guint i = 0; i < set->max_sources; i++) {
+        SourceEntry *entry = &set->entries[i];
+        if (!entry->bin)
+            continue;
+        active++;
+        g_string_append_printf(out, "ds_source_frames_total{source=\"%u\"} %" G_GUINT64_FORMAT "\n",
+                               i, entry->frames);
+        g_string_append_printf(out, "ds_source_pixels_total{source=\"%u\"} %" G_GUINT64_FORMAT "\n",
+                               i, entry->pixels);
+        g_string_append_printf(out, "ds_source_infer_ms_total{source=\"%u\"} %.3f\n",
+                               i, entry->infer_us / 1000.0);
+    }
+    g_string_append_printf(out, "ds_sources_active %u\n", active);
+    g_string_append_printf(out, "ds_sources_finished_total %u\n", set->finished);
+    g_string_append_printf(out, "ds_replay_fps %.1f\n", replay_fps(set, &frames));
+    g_string_append_printf(out, "ds_replay_media_seconds_total %.1f\n", replay_media(set) / 1e9);
+    g_mutex_unlock(&set->lock);
+}
+
+SourceSet *source_set_new(GstElement *pipeline, GstElement *streammux, guint max_sources,
+                          RoiConfig *roi, DecodePolicy *policy) {
+    SourceSet *set = g_new0(SourceSet, 1);
+
+    set->pipeline = pipeline;
+    set->streammux = streammux;
+    set->max_sources = MAX(max_sources, 1);
+    set->batch_size = set->max_sources;
+    set->manage_batch_size = TRUE;
+    set->pending = g_queue_new();
+    set->roi = roi;
+    set->policy = policy;
+    set->entries = g_new0(SourceEntry, set->max_sources);
+    g_mutex_init(&set->lock);
+    metrics_register("source-set", collect_source_set_metrics, set);
+    return set;
+}
+
+gboolean source_set_add_bin(SourceSet *set, guint id, GstElement *bin) {
+    SourceEntry *entry;
+    GstElement *crop = NULL;
+    GstPad *sinkpad, *srcpad;
+    gchar pad_name_sink[16];
+    gboolean linked;
+
+    if (!bin)
+        return FALSE;
+    if (id >= set->max_sources || set->entries[id].bin) {
+        g_printerr("Source %u: %s\n", id, id >= set->max_sources ? "id out of range" : "already in use");
+        gst_object_unref(gst_object_ref_sink(bin));
+        return FALSE;
+    }
+    entry = &set->entries[id];
+    gst_bin_add(GST_BIN (set->pipeline), bin);
+    srcpad = gst_element_get_static_pad(bin, "src");
+    /* Sources with a ROI are cropped to its bounding box before the
+     * muxer, so only that region is scaled and inferred on. */
+    if (roi_config_has_source(set->roi, id)) {
+        GstPad *crop_sinkpad;
+        crop = roi_config_make_crop(set->roi, id);
+        if (!crop) {
+            g_printerr("Failed to create ROI crop.\n");
+            gst_object_unref(srcpad);
+            gst_bin_remove(GST_BIN (set->pipeline), bin);
+            return FALSE;
+        }
+        gst_bin_add(GST_BIN (set->pipeline), crop);
+        crop_sinkpad = gst_element_get_static_pad(crop, "sink");
+        linked = gst_pad_link(srcpad, crop_sinkpad) == GST_PAD_LINK_OK;
+        gst_object_unref(crop_sinkpad);
+        gst_object_unref(srcpad);
+        srcpad = gst_element_get_static_pad(crop, "src");
+        if (!linked) {
+            g_printerr("Failed to link ROI crop.\n");
+            goto fail;
+        }
+    }
+
+    g_snprintf(pad_name_sink, sizeof(pad_name_sink), "sink_%u", id);
+    sinkpad = gst_element_get_request_pad(set->streammux, pad_name_sink);
+    if (!sinkpad) {
+        g_printerr("Streammux request sink pad failed.\n");
+        goto fail;
+    }
+    linked = gst_pad_link(srcpad, sinkpad) == GST_PAD_LINK_OK;
+    if (!linked) {
+        gst_element_release_request_pad(set->streammux, sinkpad);
+        gst_object_unref(sinkpad);
+        g_printerr("Failed to link source bin to stream muxer.\n");
+        goto fail;
+    }
+    gst_object_unref(sinkpad);
+    gst_object_unref(srcpad);
+
+    /* no-op while the pipeline is still being built */
+    if (crop)
+        gst_element_sync_state_with_parent(crop);
+    gst_element_sync_state_with_parent(bin);
+    g_mutex_lock(&set->lock);
+    entry->bin = bin;
+    entry->crop = crop;
+    entry->frames = 0;
+    entry->pixels = 0;
+    entry->infer_us = 0;
+    entry->first_frame_at = 0;
+    entry->first_pts = 0;
+    entry->last_pts = 0;
+    g_mutex_unlock(&set->lock);
+    g_atomic_int_inc(&set->num_sources);
+    if (set->policy)
+        decode_policy_set_num_sources(set->policy, count_sources(set));
+    /* back up after sources ended */
+    if (set->manage_batch_size && count_sources(set) > set->batch_size) {
+        set->batch_size = count_sources(set);
+        g_object_set(G_OBJECT (set->streammux), "batch-size", set->batch_size, NULL);
+    }
+    return TRUE;
+
+fail:
+    gst_object_unref(srcpad);
+    if (crop)
+        gst_bin_remove(GST_BIN (set->pipeline), crop);
+    gst_bin_remove(GST_BIN (set->pipeline), bin);
+    return FALSE;
+}
+
+gboolean source_set_add_uri(SourceSet *set, guint id, const gchar *uri) {
+    GstElement *bin;
+
+    if (source_uri_is_live(uri))
+        g_object_set(G_OBJECT (set->streammux), "live-source", TRUE, NULL);
+    bin = create_source_bin(id, uri, set->policy);
+    if (!bin) {
+        g_printerr("Failed to create source bin for %s.\n", uri);
+        return FALSE;
+    }
+    return source_set_add_bin(set, id, bin);
+}
+
+gboolean source_set_remove(SourceSet *set, guint id) {
+    SourceEntry *entry;
+    GstElement *bin, *crop;
+    gchar pad_name_sink[16];
+    GstPad *sinkpad;
+
+    if (id >= set->max_sources || !set->entries[id].bin)
+        return FALSE;
+    entry = &set->entries[id];
+    g_mutex_lock(&set->lock);
+    bin = entry->bin;
+    crop = entry->crop;
+    entry->bin = NULL;
+    entry->crop = NULL;
+    entry->early = FALSE;
+    g_mutex_unlock(&set->lock);
+    g_atomic_int_add(&set->num_sources, -1);
+    if (set->policy)
+        decode_policy_set_num_sources(set->policy, count_sources(set));
+
+    gst_element_set_state(bin, GST_STATE_NULL);
+    if (crop)
+        gst_element_set_state(crop, GST_STATE_NULL);
+    /* the muxer may still wait on the pad; flush it before releasing */
+    g_snprintf(pad_name_sink, sizeof(pad_name_sink), "sink_%u", id);
+    sinkpad = gst_element_get_static_pad(set->streammux, pad_name_sink);
+    if (sinkpad) {
+        gst_pad_send_event(sinkpad, gst_event_new_flush_stop(FALSE));
+        gst_element_release_request_pad(set->streammux, sinkpad);
+        gst_object_unref(sinkpad);
+    }
+    if (crop)
+        gst_bin_remove(GST_BIN (set->pipeline), crop);
+    gst_bin_remove(GST_BIN (set->pipeline), bin);
+    return TRUE;
+}
+
+gboolean source_set_stream_eos(SourceSet *set, guint id) {
+    SourceEntry *entry;
+    guint remaining = 0;
+    guint64 frames;
+    gint64 us;
+    gchar *next;
+
+    if (id >= set->max_sources || !set->entries[id].bin)
+        return FALSE;
+    remaining = count_sources(set) - 1;
+
+    entry = &set->entries[id];
+    g_mutex_lock(&set->lock);
+    frames = entry->frames;
+    us = entry->first_frame_at ? g_get_monotonic_time() - entry->first_frame_at : 0;
+    g_mutex_unlock(&set->lock);
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u ended: %" G_GUINT64_FORMAT " frames in %.1f s, %.1f fps, %u left",
+             id, frames, us / 1e6, us > 0 ? frames * 1e6 / us : 0.0, remaining + g_queue_get_length(set->pending));
+
+    /* The last one stays: its EOS goes on through the muxer and ends the
+     * pipeline, unless more can still be added. */
+    if (remaining == 0 && !set->stdin_watch && g_queue_is_empty(set->pending))
+        return FALSE;
+    g_mutex_lock(&set->lock);
+    set->finished++;
+    set->finished_frames += frames;
+    set->finished_media += media_time(entry);
+    g_mutex_unlock(&set->lock);
+    source_set_remove(set, id);
+
+    /* the next queued file takes over the id, so the batch stays full */
+    while ((next = g_queue_pop_head(set->pending))) {
+        gboolean added = source_set_add_uri(set, id, next);
+        if (added)
+            nvds_log(DSLOG_CAT_APP, LOG_INFO, "Source %u: %s", id, next);
+        g_free(next);
+        if (added)
+            return TRUE;
+    }
+    if (set->manage_batch_size && remaining > 0 && remaining < set->batch_size) {
+        set->batch_size = remaining;
+        g_object_set(G_OBJECT (set->streammux), "batch-size", set->batch_size, NULL);
+    }
+    /* none of the queued files could be added, or stdin closed meanwhile */
+    end_if_done(set);
+    return TRUE;
+}
+
+guint source_set_count(SourceSet *set) {
+    return count_sources(set);
+}
+
+void source_set_manage_batch_size(SourceSet *set, gboolean manage) {
+    set->manage_batch_size = manage;
+}
+
+void source_set_enqueue_uri(SourceSet *set, const gchar *uri) {
+    g_queue_push_tail(set->pending, g_strdup(uri));
+}
+
+void source_set_report_replay(SourceSet *set) {
+    GstClockTime media;
+    guint64 frames;
+    gdouble fps;
+    gint64 us;
+
+    g_mutex_lock(&set->lock);
+    fps = replay_fps(set, &frames);
+    media = replay_media(set);
+    us = set->first_frame_at ? g_get_monotonic_time() - set->first_frame_at : 0;
+    g_mutex_unlock(&set->lock);
+    if (frames)
+        nvds_log(DSLOG_CAT_APP, LOG_NOTICE, "Replayed %" G_GUINT64_FORMAT " frames, %.1f s of media, in %.1f s: "
+                 "%.1f fps, %.1fx real time", frames, media / 1e9, us / 1e6, fps, us > 0 ? media / 1e3 / us : 0.0);
+}
+
+guint source_set_start_early(SourceSet *set) {
+    GstClock *clock;
+    GstClockTime base_time;
+    guint started = 0, present = 0;
+
+    for (guint i = 0; i < set->max_sources; i++) {
+        if (!set->entries[i].bin)
+            continue;
+        present++;
+        started += source_bin_holds(set->entries[i].bin);
+    }
+    /* A file started now would be late by the time the pipeline plays. */
+    if (started == 0 || started < present)
+        return 0;
+
+    /* The pipeline keeps this base time instead of picking one when it
+     * goes to PLAYING, so early and late elements agree on running time. */
+    clock = gst_system_clock_obtain();
+    base_time = gst_clock_get_time(clock);
+    gst_pipeline_use_clock(GST_PIPELINE (set->pipeline), clock);
+    gst_element_set_start_time(set->pipeline, GST_CLOCK_TIME_NONE);
+    gst_element_set_base_time(set->pipeline, base_time);
+    for (guint i = 0; i < set->max_sources; i++) {
+        SourceEntry *entry = &set->entries[i];
+        if (!entry->bin)
+            continue;
+        gst_element_set_locked_state(entry->bin, TRUE);
+        gst_element_set_clock(entry->bin, clock);
+        gst_element_set_start_time(entry->bin, GST_CLOCK_TIME_NONE);
+        gst_element_set_base_time(entry->bin, base_time);
+        gst_element_set_state(entry->bin, GST_STATE_PLAYING);
+        entry->early = TRUE;
+    }
+    gst_object_unref(clock);
+    return started;
+}
+
+void source_set_release_early(SourceSet *set) {
+    for (guint i = 0; i < set->max_sources; i++) {
+        SourceEntry *entry = &set->entries[i];
+        if (!entry->bin)
+            continue;
+        if (entry->early)
+            gst_element_set_locked_state(entry->bin, FALSE);
+        /* also the holding sources of a warm start that did not happen */
+        source_bin_release(entry->bin);
+        entry->early = FALSE;
+    }
+}
+
+void source_set_observe_batch(SourceSet *set, NvDsBatchMeta *batch_meta, gint64 infer_us) {
+    gint64 share = batch_meta->num_frames_in_batch ? infer_us / (gint64) batch_meta->num_frames_in_batch : 0;
+    NvDsMetaList *l_frame;
+
+    g_mutex_lock(&set->lock);
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        SourceEntry *entry;
+        if (frame_meta->source_id >= set->max_sources)
+            continue;
+        entry = &set->entries[frame_meta->source_id];
+        if (!entry->first_frame_at) {
+            entry->first_frame_at = g_get_monotonic_time();
+            entry->first_pts = frame_meta->buf_pts;
+            if (!set->first_frame_at)
+                set->first_frame_at = entry->first_frame_at;
+        }
+        entry->last_pts = MAX(entry->last_pts, frame_meta->buf_pts);
+        entry->frames++;
+        entry->pixels += (guint64) frame_meta->source_frame_width * frame_meta->source_frame_height;
+        entry->infer_us += share;
+    }
+    g_mutex_unlock(&set->lock);
+}
+
+static void run_command(SourceSet *set, gchar *line) {
+    gchar **argv = g_strsplit(g_strstrip(line), " ", 3);
+    guint n = g_strv_length(argv);
+    gboolean ok = FALSE;
+
+    if (n >= 2 && strcmp(argv[0], "remove") == 0)
+        ok = source_set_remove(set, (guint) strtoul(argv[1], NULL, 10));
+    else if (n == 3 && strcmp(argv[0], "add") == 0)
+        ok = source_set_add_uri(set, (guint) strtoul(argv[1], NULL, 10), g_strstrip(argv[2]));
+    else if (n > 0 && argv[0][0])
+        g_printerr("Unknown command \"%s\", expected \"add <id> <uri>\" or \"remove <id>\"\n", line);
+    if (n >= 2)
+        g_print("%s %s %s\n", ok ? "ok" : "failed", argv[0], argv[1]);
+    g_strfreev(argv);
+}
+
+static gboolean stdin_cb(GIOChannel *channel, GIOCondition condition, gpointer data) {
+    SourceSet *set = data;
+    gchar *line = NULL;
+    GIOStatus status;
+
+    while ((status = g_io_channel_read_line(channel, &line, NULL, NULL, NULL)) == G_IO_STATUS_NORMAL) {
+        run_command(set, line);
+        g_free(line);
+    }
+    if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR) {
+        set->stdin_watch = 0;
+        /* the last source was removed at its EOS waiting for more */
+        end_if_done(set);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void source_set_watch_stdin(SourceSet *set) {
+    GIOChannel *channel = g_io_channel_unix_new(0);
+
+    g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+    set->stdin_watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, stdin_cb, set);
+    g_io_channel_unref(channel);
+}
+
+void source_set_stop(SourceSet *set) {
+    gchar *uri;
+
+    while ((uri = g_queue_pop_head(set->pending)))
+        g_free(uri);
+    if (set->stdin_watch) {
+        g_source_remove(set->stdin_watch);
+        set->stdin_watch = 0;
+    }
+    end_if_done(set);
+}
+
+void source_set_free(SourceSet *set) {
+    if (!set)
+        return;
+    if (set->stdin_watch)
+        g_source_remove(set->stdin_watch);
+    metrics_unregister("source-set");
+    g_queue_free_full(set->pending, g_free);
+    g_mutex_clear(&set->lock);
+    g_free(set->entries);
+    g_free(set);
+}
@@ -0,0 +1,102 @@
+#ifndef SOURCE_SET_H
+#define SOURCE_SET_H
+
+#include <gst/gst.h>
+#include "gstnvdsmeta.h"
+#include "decode_policy.h"
+#include "roi_filter.h"
+
+G_BEGIN_DECLS
+
+/* The sources feeding nvstreammux, by muxer pad index (the source_id of
+ * their frames). Sources can be added and removed while the pipeline runs;
+ * with source_set_watch_stdin() a controlling process does that with one
+ * command per line:
+ *
+ *   add <id> <uri>
+ *   remove <id>
+ *
+ * The measured cost of every source is published via pipeline_metrics:
+ * frames and decoded pixels delivered to the muxer, and its share of the
+ * primary inference time (each batch's time split over its frames):
+ *
+ *   ds_source_frames_total{source="3"}
+ *   ds_source_pixels_total{source="3"}
+ *   ds_source_infer_ms_total{source="3"}
+ *
+ * The counters restart when an id is reused for another source.
+ *
+ * A source that reaches its end of stream is removed and the muxer batch
+ * shrinks to the sources left, so a replay of several files runs until
+ * the last one ends instead of stalling on the finished ones. Files queued
+ * with source_set_enqueue_uri() take over the id of the next one to end
+ * instead. The replay rate and the media time (PTS span) over all sources,
+ * finished or not:
+ *
+ *   ds_sources_finished_total
+ *   ds_replay_fps
+ *   ds_replay_media_seconds_total */
+
+typedef struct _SourceSet SourceSet;
+
+/* `max_sources` bounds the ids (the muxer batch size). Sources with a ROI
+ * in `roi` (may be NULL) are cropped before the muxer. */
+SourceSet *source_set_new(GstElement *pipeline, GstElement *streammux, guint max_sources,
+                          RoiConfig *roi, DecodePolicy *policy);
+
+/* Adds a bin with a "src" pad of NVMM frames as source `id`. */
+gboolean source_set_add_bin(SourceSet *set, guint id, GstElement *bin);
+
+/* Creates the source bin for `uri` (see source_bin.h) and adds it. */
+gboolean source_set_add_uri(SourceSet *set, guint id, const gchar *uri);
+
+/* Stops source `id` and releases its muxer pad. */
+gboolean source_set_remove(SourceSet *set, guint id);
+
+/* Number of sources playing; cheap enough for a probe. */
+guint source_set_count(SourceSet *set);
+
+/* FALSE leaves the muxer batch size to someone else, see
+ * batch_controller.h. */
+void source_set_manage_batch_size(SourceSet *set, gboolean manage);
+
+/* Queues `uri` for the next id to become free at an end of stream. */
+void source_set_enqueue_uri(SourceSet *set, const gchar *uri);
+
+/* Call on the muxer's stream-eos message for source `id`, from the main
+ * loop. Removes the source, replacing it with the next queued uri, unless
+ * it is the last one and no more can be added (nothing queued, stdin
+ * closed or not watched); returns whether it did. */
+gboolean source_set_stream_eos(SourceSet *set, guint id);
+
+/* Logs the frames, media time and rate of the whole replay. */
+void source_set_report_replay(SourceSet *set);
+
+/* Warm start: when every source holds its stream (live sources created
+ * with source_bin_set_warm_start()), fixes the pipeline clock and base
+ * time and takes the sources to PLAYING right away, outside the pipeline's
+ * state change. Returns the number started, 0 if it did not. */
+guint source_set_start_early(SourceSet *set);
+
+/* Once the rest of the pipeline is up: hands the sources back to it and
+ * lets the held streams of every source through, whether or not they were
+ * started early. */
+void source_set_release_early(SourceSet *set);
+
+/* Attributes a batch's frames and `infer_us` of inference time to their
+ * sources; call on the pgie src pad. */
+void source_set_observe_batch(SourceSet *set, NvDsBatchMeta *batch_meta, gint64 infer_us);
+
+/* Executes add/remove commands read from stdin on the main loop. */
+void source_set_watch_stdin(SourceSet *set);
+
+/* No more sources come: queued uris are dropped and stdin is no longer
+ * read, so the last source to end ends the pipeline (ends it at once if
+ * there is none). */
+void source_set_stop(SourceSet *set);
+
+void source_set_free(SourceSet *set);
+
+G_END_DECLS
+
+#endif
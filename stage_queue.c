@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include "stage_queue.h"
+#include "pipeline_metrics.h"
+
+#define STAGE_QUEUE_DEFAULT_BUFFERS 4
+
+typedef struct {
+    GstElement *queue;
+    gchar *stage;
+    cpu_set_t *cpus;
+    gint overruns;
+} StageQueue;
+
+struct _StageQueues {
+    guint max_buffers;
+    /* stage name -> cpu_set_t*, parsed from the pin spec */
+    GHashTable *pins;
+    /* GstElement* (queue) -> StageQueue* */
+    GHashTable *queues;
+};
+
+/* Parses a Linux cpu list ("0-3,8,10-11") into `set`. */
+static gboolean parse_cpu_list(const gchar *list, cpu_set_t *set) {
+    gchar **ranges = g_strsplit(list, ",", -1);
+    gboolean ok = TRUE;
+
+    for (guint i = 0; ranges[i] && ok; i++) {
+        gchar *range = g_strstrip(ranges[i]);
+        gchar *end = NULL;
+        guint64 first, last;
+
+        if (*range == '\0')
+            continue;
+        first = last = g_ascii_strtoull(range, &end, 10);
+        if (end == range) {
+            ok = FALSE;
+        } else if (*end == '-') {
+            gchar *last_str = end + 1;
+            last = g_ascii_strtoull(last_str, &end, 10);
+            ok = end != last_str && *end == '\0' && last >= first;
+        } else {
+            ok = *end == '\0';
+        }
+        for (guint64 cpu = first; ok && cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+    }
+    g_strfreev(ranges);
+    return ok;
+}
+
+/* "node:N" expands to the CPUs sysfs lists for NUMA node N. */
+static gboolean parse_cpu_set(const gchar *text, cpu_set_t *set) {
+    CPU_ZERO(set);
+    if (g_str_has_prefix(text, "node:")) {
+        gchar *path = g_strdup_printf("/sys/devices/system/node/node%s/cpulist", text + 5);
+        gchar *list = NULL;
+        gboolean ok = g_file_get_contents(path, &list, NULL, NULL)
+                      && parse_cpu_list(g_strstrip(list), set);
+        g_free(list);
+        g_free(path);
+        return ok && CPU_COUNT(set) > 0;
+    }
+    return parse_cpu_list(text, set) && CPU_COUNT(set) > 0;
+}
+
+StageQueues *stage_queues_new(guint max_buffers, const gchar *pin_spec) {
+    StageQueues *sq = g_new0(StageQueues, 1);
+    sq->max_buffers = max_buffers ? max_buffers : STAGE_QUEUE_DEFAULT_BUFFERS;
+    sq->pins = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    sq->queues = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (pin_spec) {
+        gchar **stages = g_strsplit(pin_spec, ";", -1);
+        for (guint i = 0; stages[i]; i++) {
+            gchar **kv = g_strsplit(stages[i], "=", 2);
+            cpu_set_t *set = g_new0(cpu_set_t, 1);
+            if (kv[0] && kv[1] && parse_cpu_set(g_strstrip(kv[1]), set)) {
+                g_hash_table_replace(sq->pins, g_strdup(g_strstrip(kv[0])), set);
+            } else {
+                if (*g_strstrip(stages[i]) != '\0')
+                    g_printerr("Ignoring invalid CPU pinning \"%s\"\n", stages[i]);
+                g_free(set);
+            }
+            g_strfreev(kv);
+        }
+        g_strfreev(stages);
+    }
+    return sq;
+}
+
+static void on_overrun(GstElement *queue, gpointer user_data) {
+    g_atomic_int_inc(&((StageQueue *) user_data)->overruns);
+}
+
+static void collect_queue_metrics(GString *out, gpointer user_data) {
+    StageQueues *sq = user_data;
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, sq->queues);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        StageQueue *q = value;
+        guint level = 0;
+        g_object_get(G_OBJECT (q->queue), "current-level-buffers", &level, NULL);
+        g_string_append_printf(out, "ds_queue_level_buffers{stage=\"%s\"} %u\n", q->stage, level);
+        g_string_append_printf(out, "ds_queue_max_buffers{stage=\"%s\"} %u\n", q->stage, sq->max_buffers);
+        g_string_append_printf(out, "ds_queue_overruns_total{stage=\"%s\"} %d\n", q->stage,
+                               g_atomic_int_get(&q->overruns));
+    }
+}
+
+static GstElement *make_stage_queue(StageQueues *sq, GstElement *stage) {
+    gchar *name = g_strdup_printf("%s-queue", GST_ELEMENT_NAME (stage));
+    GstElement *queue = gst_element_factory_make("queue", name);
+    StageQueue *q;
+
+    g_free(name);
+    if (!queue)
+        return NULL;
+    /* Bounded by buffer count only: batches are few but large. */
+    g_object_set(G_OBJECT (queue), "max-size-buffers", sq->max_buffers,
+                 "max-size-bytes", 0, "max-size-time", (guint64) 0, NULL);
+
+    q = g_new0(StageQueue, 1);
+    q->queue = queue;
+    q->stage = g_strdup(GST_ELEMENT_NAME (stage));
+    q->cpus = g_hash_table_lookup(sq->pins, q->stage);
+    g_signal_connect(queue, "overrun", G_CALLBACK(on_overrun), q);
+    if (g_hash_table_size(sq->queues) == 0)
+        metrics_register("stage-queues", collect_queue_metrics, sq);
+    g_hash_table_insert(sq->queues, queue, q);
+    return queue;
+}
+
+gboolean stage_queues_link_many(StageQueues *sq, GstBin *bin, GstElement *first, ...) {
+    GstElement *prev = first, *next;
+    gboolean ok = TRUE;
+    va_list args;
+
+    va_start(args, first);
+    while (ok && (next = va_arg(args, GstElement *)) != NULL) {
+        GstElement *queue = make_stage_queue(sq, next);
+        if (!queue) {
+            g_printerr("Unable to create queue for %s\n", GST_ELEMENT_NAME (next));
+            ok = FALSE;
+            break;
+        }
+        gst_bin_add(bin, queue);
+        ok = gst_element_link_many(prev, queue, next, NULL);
+        prev = next;
+    }
+    va_end(args);
+    return ok;
+}
+
+/* STREAM_STATUS ENTER is posted synchronously from the new streaming
+ * thread itself, so the sync handler can name and pin it in place. */
+GstBusSyncReply stage_queues_handle_sync_message(StageQueues *sq, GstMessage *msg) {
+    GstStreamStatusType type;
+    GstElement *owner = NULL;
+    StageQueue *q;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STREAM_STATUS)
+        return GST_BUS_PASS;
+    gst_message_parse_stream_status(msg, &type, &owner);
+    if (type != GST_STREAM_STATUS_TYPE_ENTER || !(q = g_hash_table_lookup(sq->queues, owner)))
+        return GST_BUS_PASS;
+
+    {
+        /* Linux limits thread names to 15 characters. */
+        gchar thread_name[16];
+        g_snprintf(thread_name, sizeof(thread_name), "q:%s", q->stage);
+        pthread_setname_np(pthread_self(), thread_name);
+    }
+    if (q->cpus && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), q->cpus) != 0)
+        g_printerr("Unable to pin %s thread\n", q->stage);
+    return GST_BUS_PASS;
+}
+
+static void stage_queue_free(gpointer data) {
+    StageQueue *q = data;
+    g_free(q->stage);
+    g_free(q);
+}
+
+void stage_queues_free(StageQueues *sq) {
+    GHashTableIter iter;
+    gpointer value;
+
+    if (!sq)
+        return;
+    metrics_unregister("stage-queues");
+    g_hash_table_iter_init(&iter, sq->queues);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        stage_queue_free(value);
+    g_hash_table_destroy(sq->queues);
+    g_hash_table_destroy(sq->pins);
+    g_free(sq);
+}
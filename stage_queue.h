@@ -0,0 +1,42 @@
+#ifndef STAGE_QUEUE_H
+#define STAGE_QUEUE_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Queue-decoupled pipeline stages.
+ *
+ * gst_element_link_many(streammux, pgie, nvvidconv, nvosd, sink) runs every
+ * element in the muxer's streaming thread. StageQueues links the same chain
+ * with a bounded queue in front of every element after the first, so each
+ * stage gets its own streaming thread. The thread of the queue feeding
+ * stage "x" (the element name) is named "q:x" and can be pinned to a CPU
+ * set:
+ *
+ *   "primary-nvinference-engine=2-3;nvvideo-converter=4,5;nv-onscreendisplay=node:1"
+ *
+ * where "node:N" selects every CPU of NUMA node N (dual-socket hosts). Fill
+ * levels and overrun counts of every queue are published via
+ * pipeline_metrics; a queue that keeps overrunning sits in front of the
+ * bottleneck. */
+
+typedef struct _StageQueues StageQueues;
+
+/* `max_buffers` bounds every queue (0 selects 4). `pin_spec` may be NULL. */
+StageQueues *stage_queues_new(guint max_buffers, const gchar *pin_spec);
+
+/* Adds the queues to `bin` and links first -> q -> second -> q -> ... The
+ * element list is NULL terminated, like gst_element_link_many(). */
+gboolean stage_queues_link_many(StageQueues *sq, GstBin *bin,
+                                GstElement *first, ...) G_GNUC_NULL_TERMINATED;
+
+/* Names and pins queue threads as they start; call from the pipeline bus
+ * sync handler, installed before going to PLAYING. */
+GstBusSyncReply stage_queues_handle_sync_message(StageQueues *sq, GstMessage *msg);
+
+void stage_queues_free(StageQueues *sq);
+
+G_END_DECLS
+
+#endif
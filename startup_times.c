@@ -0,0 +1,203 @@
+#include "startup_times.h"
+#include "async_log.h"
+#include "pipeline_metrics.h"
+
+/* Steps named in the startup report, slowest first. */
+#define STARTUP_TIMES_REPORTED_STEPS 5
+
+typedef struct {
+    gchar *name;
+    gint64 us;
+} Phase;
+
+typedef struct {
+    gchar *element;
+    const gchar *step;
+    gint64 us;
+} ElementStep;
+
+struct _StartupTimes {
+    GMutex lock;                /* everything below */
+    gint64 start;
+    gint64 last_mark;           /* end of the last phase */
+    gint64 last_state_change;
+    gint64 playing_at;          /* 0 until PLAYING */
+    gint64 first_batch_at;      /* 0 until then */
+    gint64 first_detection_at;
+    gint milestones_done;       /* atomic, the per-batch fast path */
+    GArray *phases;
+    GArray *steps;
+};
+
+static const gchar *state_names[] = {"void-pending", "null", "ready", "paused", "playing"};
+
+static void collect_startup_metrics(GString *out, gpointer user_data) {
+    StartupTimes *times = user_data;
+
+    g_mutex_lock(&times->lock);
+    for (guint i = 0; i < times->phases->len; i++) {
+        const Phase *phase = &g_array_index(times->phases, Phase, i);
+        g_string_append_printf(out, "ds_startup_phase_ms{phase=\"%s\"} %.1f\n", phase->name, phase->us / 1000.0);
+    }
+    for (guint i = 0; i < times->steps->len; i++) {
+        const ElementStep *step = &g_array_index(times->steps, ElementStep, i);
+        g_string_append_printf(out, "ds_startup_element_ms{element=\"%s\",step=\"%s\"} %.1f\n",
+                               step->element, step->step, step->us / 1000.0);
+    }
+    if (times->playing_at)
+        g_string_append_printf(out, "ds_startup_total_ms %.1f\n", (times->playing_at - times->start) / 1000.0);
+    if (times->first_batch_at)
+        g_string_append_printf(out, "ds_startup_first_batch_ms %.1f\n",
+                               (times->first_batch_at - times->start) / 1000.0);
+    if (times->first_detection_at)
+        g_string_append_printf(out, "ds_startup_first_detection_ms %.1f\n",
+                               (times->first_detection_at - times->start) / 1000.0);
+    g_mutex_unlock(&times->lock);
+}
+
+StartupTimes *startup_times_new(void) {
+    StartupTimes *times = g_new0(StartupTimes, 1);
+
+    g_mutex_init(&times->lock);
+    times->start = times->last_mark = g_get_monotonic_time();
+    times->phases = g_array_new(FALSE, FALSE, sizeof(Phase));
+    times->steps = g_array_new(FALSE, FALSE, sizeof(ElementStep));
+    metrics_register("startup", collect_startup_metrics, times);
+    return times;
+}
+
+void startup_times_phase(StartupTimes *times, const gchar *phase) {
+    gint64 now = g_get_monotonic_time();
+    Phase p = {g_strdup(phase), 0};
+
+    g_mutex_lock(&times->lock);
+    p.us = now - times->last_mark;
+    times->last_mark = now;
+    g_array_append_val(times->phases, p);
+    g_mutex_unlock(&times->lock);
+}
+
+void startup_times_add(StartupTimes *times, const gchar *element, const gchar *step, gint64 us) {
+    ElementStep s = {g_strdup(element), step, us};
+
+    g_mutex_lock(&times->lock);
+    g_array_append_val(times->steps, s);
+    g_mutex_unlock(&times->lock);
+}
+
+static gint compare_steps(gconstpointer a, gconstpointer b) {
+    const ElementStep *sa = *(ElementStep *const *) a, *sb = *(ElementStep *const *) b;
+    return sa->us < sb->us ? 1 : sa->us > sb->us ? -1 : 0;
+}
+
+/* Called once, with the lock held. */
+static void report(StartupTimes *times) {
+    GString *text = g_string_new(NULL);
+    GPtrArray *sorted = g_ptr_array_sized_new(times->steps->len);
+
+    for (guint i = 0; i < times->phases->len; i++) {
+        const Phase *phase = &g_array_index(times->phases, Phase, i);
+        g_string_append_printf(text, "%s%s %.0f ms", i ? ", " : "", phase->name, phase->us / 1000.0);
+    }
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Startup %.0f ms: %s", (times->playing_at - times->start) / 1000.0, text->str);
+
+    for (guint i = 0; i < times->steps->len; i++)
+        g_ptr_array_add(sorted, &g_array_index(times->steps, ElementStep, i));
+    g_ptr_array_sort(sorted, compare_steps);
+    g_string_truncate(text, 0);
+    for (guint i = 0; i < MIN(sorted->len, STARTUP_TIMES_REPORTED_STEPS); i++) {
+        const ElementStep *step = g_ptr_array_index(sorted, i);
+        g_string_append_printf(text, "%s%s %s %.0f ms", i ? ", " : "", step->element, step->step, step->us / 1000.0);
+    }
+    if (sorted->len)
+        nvds_log(DSLOG_CAT_APP, LOG_INFO, "Slowest startup steps: %s", text->str);
+    g_ptr_array_free(sorted, TRUE);
+    g_string_free(text, TRUE);
+}
+
+void startup_times_sync_message(StartupTimes *times, GstElement *pipeline, GstMessage *msg) {
+    GstState old_state, new_state;
+    gint64 now;
+
+    if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_STATE_CHANGED)
+        return;
+    gst_message_parse_state_changed(msg, &old_state, &new_state, NULL);
+    if (new_state <= old_state)
+        return;
+    now = g_get_monotonic_time();
+
+    g_mutex_lock(&times->lock);
+    if (!times->playing_at) {
+        gint64 since = MAX(times->last_mark, times->last_state_change);
+        if (GST_MESSAGE_SRC (msg) == GST_OBJECT (pipeline)) {
+            if (new_state == GST_STATE_PLAYING) {
+                Phase p = {g_strdup("to-playing"), now - times->last_mark};
+                g_array_append_val(times->phases, p);
+                times->playing_at = times->last_mark = now;
+                report(times);
+            }
+        } else {
+            ElementStep s = {g_strdup(GST_OBJECT_NAME (GST_MESSAGE_SRC (msg))), state_names[new_state], now - since};
+            g_array_append_val(times->steps, s);
+            times->last_state_change = now;
+        }
+    }
+    g_mutex_unlock(&times->lock);
+}
+
+/* Offsets from the start, with the lock held. */
+static void report_timeline(StartupTimes *times) {
+    GString *text = g_string_new(NULL);
+    gint64 at = 0;
+
+    for (guint i = 0; i < times->phases->len; i++) {
+        const Phase *phase = &g_array_index(times->phases, Phase, i);
+        at += phase->us;
+        g_string_append_printf(text, "%s %.0f, ", phase->name, at / 1000.0);
+    }
+    g_string_append_printf(text, "first-batch %.0f, first-detection %.0f",
+                           (times->first_batch_at - times->start) / 1000.0,
+                           (times->first_detection_at - times->start) / 1000.0);
+    nvds_log(DSLOG_CAT_APP, LOG_INFO, "Startup timeline (ms): %s", text->str);
+    g_string_free(text, TRUE);
+}
+
+void startup_times_batch(StartupTimes *times, guint num_objects) {
+    gint64 now;
+
+    if (g_atomic_int_get(&times->milestones_done))
+        return;
+    now = g_get_monotonic_time();
+    g_mutex_lock(&times->lock);
+    if (!times->first_batch_at)
+        times->first_batch_at = now;
+    if (num_objects && !times->first_detection_at) {
+        times->first_detection_at = now;
+        report_timeline(times);
+        g_atomic_int_set(&times->milestones_done, 1);
+    }
+    g_mutex_unlock(&times->lock);
+}
+
+gint64 startup_times_total_us(StartupTimes *times) {
+    gint64 us;
+
+    g_mutex_lock(&times->lock);
+    us = times->playing_at ? times->playing_at - times->start : 0;
+    g_mutex_unlock(&times->lock);
+    return us;
+}
+
+void startup_times_free(StartupTimes *times) {
+    if (!times)
+        return;
+    metrics_unregister("startup");
+    for (guint i = 0; i < times->phases->len; i++)
+        g_free(g_array_index(times->phases, Phase, i).name);
+    for (guint i = 0; i < times->steps->len; i++)
+        g_free(g_array_index(times->steps, ElementStep, i).element);
+    g_array_free(times->phases, TRUE);
+    g_array_free(times->steps, TRUE);
+    g_mutex_clear(&times->lock);
+    g_free(times);
+}
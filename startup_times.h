@@ -0,0 +1,55 @@
+#ifndef STARTUP_TIMES_H
+#define STARTUP_TIMES_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Where startup time goes, per phase and per element.
+ *
+ * The app ends each phase with startup_times_phase() (validate, create,
+ * configure, link, ...) and the graph builder adds the time every element
+ * took to create. Fed from the bus sync handler, state changes are timed
+ * as they are posted: an element's step is the time since the previous
+ * state change, which for the sequential changes of a bin is the element's
+ * own change (nvinfer loading its engine on the way to PAUSED; a sink's
+ * PAUSED waits for the first frame). Once the pipeline reaches PLAYING
+ * the phases and the slowest steps are logged, and all of them published
+ * via pipeline_metrics:
+ *
+ *   ds_startup_phase_ms{phase="link"}
+ *   ds_startup_element_ms{element="primary-nvinference-engine",step="paused"}
+ *   ds_startup_total_ms
+ *
+ * What startup is for is the first detection, which on a live pipeline
+ * comes after PLAYING; startup_times_batch() marks it, and the first
+ * batch, and logs the timeline of phases and both milestones:
+ *
+ *   ds_startup_first_batch_ms
+ *   ds_startup_first_detection_ms */
+
+typedef struct _StartupTimes StartupTimes;
+
+/* Starts the clock. */
+StartupTimes *startup_times_new(void);
+
+/* Ends `phase`, which began where the previous one ended. */
+void startup_times_phase(StartupTimes *times, const gchar *phase);
+
+void startup_times_add(StartupTimes *times, const gchar *element, const gchar *step, gint64 us);
+
+/* Call from the bus sync handler of `pipeline`, for every message. */
+void startup_times_sync_message(StartupTimes *times, GstElement *pipeline, GstMessage *msg);
+
+/* Call for every inferred batch; after the first detection it is a single
+ * atomic read. */
+void startup_times_batch(StartupTimes *times, guint num_objects);
+
+/* Microseconds from startup_times_new() to PLAYING, 0 before. */
+gint64 startup_times_total_us(StartupTimes *times);
+
+void startup_times_free(StartupTimes *times);
+
+G_END_DECLS
+
+#endif
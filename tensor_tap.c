@@ -0,0 +1,156 @@
+#include <string.h>
+#include "tensor_tap.h"
+#include "gstnvdsmeta.h"
+#include "gstnvdsinfer.h"
+#include "pipeline_metrics.h"
+
+#define TENSOR_ALIGN 16
+
+struct _TensorTap {
+    ShmRing *ring;
+    guint payload_size;
+
+    GMutex stats_lock;
+    guint64 frames;
+    guint64 bytes;
+    guint64 oversized;
+    gint64 publish_us;
+};
+
+static guint element_size(NvDsInferDataType type) {
+    switch (type) {
+        case HALF:
+            return 2;
+        case INT8:
+            return 1;
+        case FLOAT:
+        case INT32:
+        default:
+            return 4;
+    }
+}
+
+static void collect_tap_metrics(GString *out, gpointer user_data) {
+    TensorTap *tap = user_data;
+
+    g_mutex_lock(&tap->stats_lock);
+    g_string_append_printf(out, "ds_tensor_tap_frames_total %" G_GUINT64_FORMAT "\n", tap->frames);
+    g_string_append_printf(out, "ds_tensor_tap_bytes_total %" G_GUINT64_FORMAT "\n", tap->bytes);
+    g_string_append_printf(out, "ds_tensor_tap_oversized_total %" G_GUINT64_FORMAT "\n", tap->oversized);
+    g_string_append_printf(out, "ds_tensor_tap_publish_us %.1f\n",
+                           tap->frames ? (gdouble) tap->publish_us / tap->frames : 0.0);
+    g_mutex_unlock(&tap->stats_lock);
+}
+
+TensorTap *tensor_tap_new(const gchar *shm_name, guint num_slots, guint slot_bytes, GError **error) {
+    TensorTap *tap;
+    ShmRing *ring = shm_ring_create(shm_name, num_slots, MAX(slot_bytes, sizeof(TensorTapFrame)), error);
+
+    if (!ring)
+        return NULL;
+    tap = g_new0(TensorTap, 1);
+    tap->ring = ring;
+    tap->payload_size = shm_ring_header(ring)->payload_size;
+    g_mutex_init(&tap->stats_lock);
+    metrics_register("tensor-tap", collect_tap_metrics, tap);
+    g_print("Tensor tap: /dev/shm/%s, %u slots of %u bytes\n", shm_name, num_slots, tap->payload_size);
+    return tap;
+}
+
+/* Lays out the frame's layers in the next slot and publishes it. Returns
+ * the payload size, 0 if the layers do not fit. */
+static guint publish_frame(TensorTap *tap, NvDsFrameMeta *frame_meta, NvDsInferTensorMeta *meta) {
+    guint8 *payload;
+    TensorTapFrame *frame;
+    guint first = (guint) ((sizeof(TensorTapFrame) + TENSOR_ALIGN - 1) & ~(TENSOR_ALIGN - 1));
+    guint offset = first;
+    guint num_layers = MIN(meta->num_output_layers, TENSOR_TAP_MAX_LAYERS);
+
+    /* sized before the slot is taken: begin_write invalidates the frame
+     * it held */
+    for (guint i = 0; i < num_layers; i++) {
+        const NvDsInferLayerInfo *info = &meta->output_layers_info[i];
+        guint size = info->dims.numElements * element_size(info->dataType);
+        if (offset + size > tap->payload_size)
+            return 0;
+        offset = (offset + size + TENSOR_ALIGN - 1) & ~(TENSOR_ALIGN - 1);
+    }
+
+    payload = shm_ring_begin_write(tap->ring);
+    frame = (TensorTapFrame *) payload;
+    offset = first;
+    frame->source_id = frame_meta->source_id;
+    frame->frame_num = frame_meta->frame_num;
+    frame->pts = frame_meta->buf_pts;
+    frame->unique_id = meta->unique_id;
+    frame->num_layers = num_layers;
+    for (guint i = 0; i < num_layers; i++) {
+        const NvDsInferLayerInfo *info = &meta->output_layers_info[i];
+        TensorTapLayer *layer = &frame->layers[i];
+        guint size = info->dims.numElements * element_size(info->dataType);
+
+        g_strlcpy(layer->name, info->layerName ? info->layerName : "", sizeof(layer->name));
+        layer->data_type = info->dataType;
+        layer->num_dims = MIN(info->dims.numDims, TENSOR_TAP_MAX_DIMS);
+        memcpy(layer->dims, info->dims.d, sizeof(layer->dims));
+        layer->num_elements = info->dims.numElements;
+        layer->offset = offset;
+        layer->size = size;
+        memcpy(payload + offset, meta->out_buf_ptrs_host[i], size);
+        offset = (offset + size + TENSOR_ALIGN - 1) & ~(TENSOR_ALIGN - 1);
+    }
+    shm_ring_commit(tap->ring, offset);
+    return offset;
+}
+
+static GstPadProbeReturn
+tensor_tap_probe(GstPad *pad, GstPadProbeInfo *info, gpointer u_data) {
+    TensorTap *tap = (TensorTap *) u_data;
+    NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *) info->data);
+    NvDsMetaList *l_frame, *l_user;
+    guint64 frames = 0, bytes = 0, oversized = 0;
+    gint64 start = g_get_monotonic_time();
+
+    if (!batch_meta)
+        return GST_PAD_PROBE_OK;
+    for (l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next) {
+        NvDsFrameMeta *frame_meta = (NvDsFrameMeta *) l_frame->data;
+        for (l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next) {
+            NvDsUserMeta *user_meta = (NvDsUserMeta *) l_user->data;
+            guint size;
+            if (user_meta->base_meta.meta_type != NVDSINFER_TENSOR_OUTPUT_META)
+                continue;
+            size = publish_frame(tap, frame_meta, (NvDsInferTensorMeta *) user_meta->user_meta_data);
+            if (size) {
+                frames++;
+                bytes += size;
+            } else {
+                oversized++;
+            }
+        }
+    }
+    g_mutex_lock(&tap->stats_lock);
+    tap->frames += frames;
+    tap->bytes += bytes;
+    tap->oversized += oversized;
+    tap->publish_us += g_get_monotonic_time() - start;
+    g_mutex_unlock(&tap->stats_lock);
+    return GST_PAD_PROBE_OK;
+}
+
+void tensor_tap_attach(TensorTap *tap, GstElement *pgie) {
+    GstPad *pad = gst_element_get_static_pad(pgie, "src");
+
+    g_object_set(G_OBJECT (pgie), "output-tensor-meta", TRUE, NULL);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, tensor_tap_probe, tap, NULL);
+    gst_object_unref(pad);
+}
+
+void tensor_tap_free(TensorTap *tap) {
+    if (!tap)
+        return;
+    metrics_unregister("tensor-tap");
+    shm_ring_close(tap->ring);
+    g_mutex_clear(&tap->stats_lock);
+    g_free(tap);
+}
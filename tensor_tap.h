@@ -0,0 +1,58 @@
+#ifndef TENSOR_TAP_H
+#define TENSOR_TAP_H
+
+#include <gst/gst.h>
+#include "shm_ring.h"
+
+G_BEGIN_DECLS
+
+/* Raw tensor tap: publishes the output layers nvinfer attaches as
+ * NvDsInferTensorMeta (output-tensor-meta=1) into a shared-memory ring, one
+ * slot per frame, for post-processing in another process. See
+ * tensor_tap_consumer.c for the reference reader.
+ *
+ * Slot payload: a TensorTapFrame followed by the layer data at the offsets
+ * given in its layer table, each 16-byte aligned. Host output buffers are
+ * owned by nvinfer and recycled after the batch, so they are copied into
+ * the slot once; readers use the slot in place. */
+
+#define TENSOR_TAP_DEFAULT_SHM "dstest1-tensors"
+#define TENSOR_TAP_MAX_LAYERS 8
+#define TENSOR_TAP_MAX_DIMS 8
+
+typedef struct {
+    gchar name[64];
+    /* NvDsInferDataType */
+    guint32 data_type;
+    guint32 num_dims;
+    guint32 dims[TENSOR_TAP_MAX_DIMS];
+    guint32 num_elements;
+    /* from the start of the payload */
+    guint32 offset;
+    guint32 size;
+} TensorTapLayer;
+
+typedef struct {
+    guint32 source_id;
+    gint32 frame_num;
+    guint64 pts;
+    guint32 unique_id;
+    guint32 num_layers;
+    TensorTapLayer layers[TENSOR_TAP_MAX_LAYERS];
+} TensorTapFrame;
+
+typedef struct _TensorTap TensorTap;
+
+/* Creates the ring /dev/shm/<shm_name> with `num_slots` slots of
+ * `slot_bytes` payload each. */
+TensorTap *tensor_tap_new(const gchar *shm_name, guint num_slots, guint slot_bytes, GError **error);
+
+/* Enables output-tensor-meta on `pgie` and publishes every frame from a
+ * probe on its src pad. */
+void tensor_tap_attach(TensorTap *tap, GstElement *pgie);
+
+void tensor_tap_free(TensorTap *tap);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,226 @@
+/* Reference consumer for the tensor tap (tensor_tap.h): maps the ring
+ * published by deepstream_test1_app_ --tensor-tap and post-processes every
+ * frame in place, e.g.
+ *
+ *   ./tensor_tap_consumer_ --shm dstest1-tensors --print
+ *
+ * Reports frames read, frames lost to overwrites and the publish-to-read
+ * latency (p50/p99/max) every --interval seconds.
+ *
+ * --bench N forks a synthetic producer writing N frames per second of
+ * detector-sized tensors, so the ring latency can be measured without a
+ * GPU. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tensor_tap.h"
+
+static gchar *opt_shm = NULL;
+static gboolean opt_print = FALSE;
+static gint opt_interval = 5;
+static gint opt_duration = 0;
+static gint opt_bench_fps = 0;
+static gint opt_bench_bytes = 0;
+
+static GOptionEntry entries[] = {
+        {"shm", 's', 0, G_OPTION_ARG_STRING, &opt_shm, "Ring name (default " TENSOR_TAP_DEFAULT_SHM ")", "NAME"},
+        {"print", 'p', 0, G_OPTION_ARG_NONE, &opt_print, "Print a line per frame", NULL},
+        {"interval", 'i', 0, G_OPTION_ARG_INT, &opt_interval, "Report interval (default 5)", "SEC"},
+        {"duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration, "Exit after SEC seconds", "SEC"},
+        {"bench", 0, 0, G_OPTION_ARG_INT, &opt_bench_fps, "Fork a synthetic producer at N frames/s", "N"},
+        {"bench-bytes", 0, 0, G_OPTION_ARG_INT, &opt_bench_bytes,
+                "Tensor bytes per synthetic frame (default resnet10 outputs)", "BYTES"},
+        {NULL}
+};
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int sig) {
+    quit = 1;
+}
+
+static gint compare_u64(gconstpointer a, gconstpointer b) {
+    guint64 x = *(const guint64 *) a, y = *(const guint64 *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(GArray *latencies, guint64 frames, guint64 lost, gdouble seconds) {
+    guint64 p50 = 0, p99 = 0, max = 0;
+
+    if (latencies->len) {
+        g_array_sort(latencies, compare_u64);
+        p50 = g_array_index(latencies, guint64, latencies->len / 2);
+        p99 = g_array_index(latencies, guint64, (guint) (latencies->len * 0.99));
+        max = g_array_index(latencies, guint64, latencies->len - 1);
+    }
+    g_printerr("%" G_GUINT64_FORMAT " frames (%.0f/s), %" G_GUINT64_FORMAT " lost, latency p50 %.1f us"
+               " p99 %.1f us max %.1f us\n", frames, seconds > 0 ? frames / seconds : 0.0, lost,
+               p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+    g_array_set_size(latencies, 0);
+}
+
+/* Example post-processing done in place: the maximum of every float
+ * layer, e.g. the best coverage score of a detector. The slot may be
+ * overwritten meanwhile, so offsets are bounds checked before use and the
+ * returned line is only printed if the slot is still valid afterwards. */
+static GString *process_frame(const guint8 *payload, guint payload_size) {
+    const TensorTapFrame *frame = (const TensorTapFrame *) payload;
+    GString *line;
+
+    if (!opt_print)
+        return NULL;
+    line = g_string_new(NULL);
+    g_string_append_printf(line, "source %u frame %d pts %" G_GUINT64_FORMAT, frame->source_id, frame->frame_num,
+                           frame->pts);
+    for (guint i = 0; i < MIN(frame->num_layers, TENSOR_TAP_MAX_LAYERS); i++) {
+        const TensorTapLayer *layer = &frame->layers[i];
+        if ((guint64) layer->offset + layer->size > payload_size
+            || (guint64) layer->num_elements * sizeof(gfloat) > layer->size)
+            break;
+        if (layer->data_type == 0 /* FLOAT */) {
+            const gfloat *data = (const gfloat *) (payload + layer->offset);
+            gfloat max = layer->num_elements ? data[0] : 0;
+            for (guint e = 1; e < layer->num_elements; e++)
+                max = MAX(max, data[e]);
+            g_string_append_printf(line, "  %.*s max %.3f", (gint) sizeof(layer->name), layer->name, max);
+        } else {
+            g_string_append_printf(line, "  %.*s %u bytes", (gint) sizeof(layer->name), layer->name, layer->size);
+        }
+    }
+    return line;
+}
+
+static int consume(const gchar *name) {
+    GError *error = NULL;
+    ShmRing *ring = NULL;
+    GArray *latencies = g_array_new(FALSE, FALSE, sizeof(guint64));
+    guint64 seq, frames = 0, lost = 0, interval_frames = 0;
+    gint64 start, last_report;
+
+    /* the producer may still be starting */
+    for (gint tries = 0; !ring && tries < 50 && !quit; tries++) {
+        g_clear_error(&error);
+        if (!(ring = shm_ring_open(name, &error)))
+            g_usleep(100000);
+    }
+    if (!ring) {
+        g_printerr("%s\n", error ? error->message : "interrupted");
+        g_clear_error(&error);
+        g_array_free(latencies, TRUE);
+        return -1;
+    }
+    /* start with the next frame rather than replaying the ring */
+    seq = shm_ring_header(ring)->write_seq + 1;
+    start = last_report = g_get_monotonic_time();
+    while (!quit) {
+        guint64 wanted = seq;
+        const ShmRingSlot *slot = shm_ring_wait(ring, &seq, 200);
+        gint64 now = g_get_monotonic_time();
+
+        if (slot) {
+            guint64 latency = shm_ring_now_ns() - slot->publish_ns;
+            GString *line;
+            lost += seq - wanted;
+            line = process_frame(slot->payload, shm_ring_header(ring)->payload_size);
+            if (shm_ring_slot_valid(slot, seq)) {
+                if (line)
+                    g_print("%s\n", line->str);
+                frames++;
+                interval_frames++;
+                g_array_append_val(latencies, latency);
+            } else {
+                lost++;
+            }
+            if (line)
+                g_string_free(line, TRUE);
+            seq++;
+        }
+        if (now - last_report >= (gint64) opt_interval * G_USEC_PER_SEC) {
+            report(latencies, interval_frames, lost, (now - last_report) / (gdouble) G_USEC_PER_SEC);
+            interval_frames = 0;
+            last_report = now;
+        }
+        if (opt_duration > 0 && now - start >= (gint64) opt_duration * G_USEC_PER_SEC)
+            break;
+    }
+    report(latencies, interval_frames, lost,
+           (g_get_monotonic_time() - last_report) / (gdouble) G_USEC_PER_SEC);
+    g_printerr("total %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " lost\n", frames, lost);
+    g_array_free(latencies, TRUE);
+    shm_ring_close(ring);
+    return 0;
+}
+
+/* Synthetic producer: resnet10 outputs for 640x368 (16x23x40 boxes and
+ * 4x23x40 coverage), or --bench-bytes of one float layer. */
+static void produce(const gchar *name, gint fps) {
+    guint bbox = 16 * 23 * 40 * sizeof(gfloat), cov = 4 * 23 * 40 * sizeof(gfloat);
+    guint bytes = opt_bench_bytes > 0 ? (guint) opt_bench_bytes : bbox + cov;
+    ShmRing *ring = shm_ring_create(name, 64, sizeof(TensorTapFrame) + bytes + 64, NULL);
+    gint64 period = G_USEC_PER_SEC / fps, next = g_get_monotonic_time();
+
+    if (!ring)
+        _exit(1);
+    for (gint32 n = 0; !quit; n++) {
+        guint8 *payload = shm_ring_begin_write(ring);
+        TensorTapFrame *frame = (TensorTapFrame *) payload;
+        guint offset = (sizeof(TensorTapFrame) + 15) & ~15u;
+        frame->source_id = 0;
+        frame->frame_num = n;
+        frame->pts = (guint64) n * period * 1000;
+        frame->num_layers = 1;
+        g_strlcpy(frame->layers[0].name, "synthetic", sizeof(frame->layers[0].name));
+        frame->layers[0].data_type = 0;
+        frame->layers[0].num_elements = bytes / sizeof(gfloat);
+        frame->layers[0].offset = offset;
+        frame->layers[0].size = bytes;
+        memset(payload + offset, 0, bytes);
+        shm_ring_commit(ring, offset + bytes);
+        next += period;
+        if (next > g_get_monotonic_time())
+            g_usleep((gulong) (next - g_get_monotonic_time()));
+    }
+    shm_ring_close(ring);
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    GOptionContext *ctx = g_option_context_new("- read the tensor tap ring");
+    GError *error = NULL;
+    const gchar *name;
+    pid_t producer = 0;
+    int ret;
+
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return -1;
+    }
+    g_option_context_free(ctx);
+    if (opt_interval <= 0)
+        opt_interval = 5;
+    name = opt_shm ? opt_shm : TENSOR_TAP_DEFAULT_SHM;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if (opt_bench_fps > 0) {
+        producer = fork();
+        if (producer == 0)
+            produce(name, opt_bench_fps);
+        if (producer < 0) {
+            g_printerr("fork failed\n");
+            return -1;
+        }
+    }
+    ret = consume(name);
+    if (producer > 0) {
+        kill(producer, SIGTERM);
+        waitpid(producer, NULL, 0);
+    }
+    return ret;
+}